@@ -1,7 +1,15 @@
 #include "benchmark.h"
+#include <cstdio>
+#include <cstring>
+#include <immintrin.h>
 #include "succinct-bitvector.hpp"
 #include "b-spsi.hpp"
 #include "unbuffered_packed_vector.hpp"
+#include "gap-vector.hpp"
+#include "adaptive-leaf.hpp"
+#include "hybrid-leaf.hpp"
+#include "int-vector.hpp"
+#include "wavelet.hpp"
 
 using namespace dyn;
 
@@ -56,7 +64,7 @@ inline uint64_t find_child4(const std::vector<uint64_t>& subtree_sizes, uint64_t
 	return low;
 }
 
-inline uint32_t find_child6(const std::vector<uint32_t>& subtree_sizes, uint32_t i)
+DYN_TARGET("avx2") inline uint32_t find_child6(const std::vector<uint32_t>& subtree_sizes, uint32_t i)
 {
 	uint32_t index = 0;
 	auto counter = _mm256_setzero_si256();
@@ -154,6 +162,11 @@ static void AVX2(benchmark::State& state) {
 		vals.push_back(i + 1);
 	}
 
+	if (!cpu.avx2) {
+		state.SkipWithError("not supported by this CPU");
+		return;
+	}
+
 	for (auto _ : state) {
 		for (int i = 0; i < 128; ++i) {
 			benchmark::DoNotOptimize(find_child6(vals, i));
@@ -162,6 +175,277 @@ static void AVX2(benchmark::State& state) {
 }
 BENCHMARK(AVX2);
 
+/*
+ * child search in an internal node of state.range(0) children, for
+ * pseudo-random keys: sizes and psums of children of 1000 to 2000 bits, the
+ * counters of find_child, find_1, find_0 and find_r
+ */
+template <class child_search, counter_of op, class T = uint64_t> static void ChildSearch(benchmark::State& state) {
+	uint32_t const n = state.range(0);
+	std::vector<T> sizes(n);
+	std::vector<T> psums(n);
+
+	uint64_t seed = 88172645463325252ull;
+	uint64_t size = 0;
+	uint64_t ones = 0;
+	for (uint32_t k = 0; k < n; ++k) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		auto const bits = 1000 + seed % 1000;
+		size += bits;
+		ones += (seed >> 16) % bits;
+		sizes[k] = size;
+		psums[k] = ones;
+	}
+
+	// find_r searches psums + sizes, the others sizes - psums at most
+	const T* a = op == counter_of::a_plus_b ? psums.data() : sizes.data();
+	const T* b = op == counter_of::a_plus_b ? sizes.data() : psums.data();
+	uint64_t const max = op == counter_of::a_plus_b ? size + ones : size;
+
+	uint64_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(child_search::template search<op>(a, b, n, i));
+		i = (i + 0x9E3779B97F4A7C15ull) % max;
+	}
+}
+
+#define CHILD_SEARCH_BENCHMARKS(policy) \
+	BENCHMARK_TEMPLATE(ChildSearch, policy, counter_of::a)->RangeMultiplier(4)->Range(8, 512); \
+	BENCHMARK_TEMPLATE(ChildSearch, policy, counter_of::a_minus_b)->RangeMultiplier(4)->Range(8, 512); \
+	BENCHMARK_TEMPLATE(ChildSearch, policy, counter_of::a_plus_b)->RangeMultiplier(4)->Range(8, 512)
+
+// counter_of::a is find_child on sizes and find_1 on psums
+CHILD_SEARCH_BENCHMARKS(linear_child_search);
+CHILD_SEARCH_BENCHMARKS(binary_child_search);
+CHILD_SEARCH_BENCHMARKS(simd_count_child_search);
+CHILD_SEARCH_BENCHMARKS(simd_child_search<>);
+CHILD_SEARCH_BENCHMARKS(simd_child_search<4>);
+CHILD_SEARCH_BENCHMARKS(simd_child_search<64>);
+
+// compact (32-bit) counters
+BENCHMARK_TEMPLATE(ChildSearch, simd_child_search<>, counter_of::a, uint32_t)->RangeMultiplier(4)->Range(8, 512);
+BENCHMARK_TEMPLATE(ChildSearch, simd_count_child_search, counter_of::a, uint32_t)->RangeMultiplier(4)->Range(8, 512);
+
+/*
+ * find_child in the nodes of a tree of order B = (N - 2) / 2, for
+ * pseudo-random keys: 32 MB of nodes of 64-bit counters, visited at random
+ * as a descent of a large tree would. The indexed policies search an index
+ * synced once per node.
+ */
+template <class child_search, uint32_t N> static void WideChildSearch(benchmark::State& state) {
+	using index = typename counter_index_of<child_search, uint64_t, uint64_t, N>::type;
+
+	uint32_t const nodes = std::max<uint64_t>(1, (32 << 20) / (N * sizeof(uint64_t) * 2));
+	std::vector<uint64_t> sizes(nodes * uint64_t(N));
+	std::vector<index> indexes(nodes);
+
+	uint64_t seed = 88172645463325252ull;
+	uint64_t size = 0;
+	for (uint32_t k = 0; k < N; ++k) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		size += 1000 + seed % 1000;
+		for (uint32_t x = 0; x < nodes; ++x) sizes[uint64_t(x) * N + k] = size;
+	}
+
+	for (uint32_t x = 0; x < nodes; ++x) indexes[x].sync(sizes.data() + uint64_t(x) * N, sizes.data() + uint64_t(x) * N, N);
+
+	uint64_t i = 0;
+	for (auto _ : state) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		uint32_t const x = seed % nodes;
+		const uint64_t* a = sizes.data() + uint64_t(x) * N;
+
+		if constexpr (index::indexed) {
+			auto const& ix = indexes[x];
+			benchmark::DoNotOptimize(ix.template search<counter_of::a>(a, a, ix.a(), ix.a(), N, i));
+		}
+		else {
+			benchmark::DoNotOptimize(child_search::template search<counter_of::a>(a, a, N, i));
+		}
+
+		i = (i + 0x9E3779B97F4A7C15ull) % size;
+	}
+}
+
+#define WIDE_CHILD_SEARCH_BENCHMARKS(policy) \
+	BENCHMARK_TEMPLATE(WideChildSearch, policy, 2 * 1024 + 2); \
+	BENCHMARK_TEMPLATE(WideChildSearch, policy, 2 * 4096 + 2); \
+	BENCHMARK_TEMPLATE(WideChildSearch, policy, 2 * 8192 + 2)
+
+WIDE_CHILD_SEARCH_BENCHMARKS(binary_child_search);
+WIDE_CHILD_SEARCH_BENCHMARKS(simd_child_search<>);
+WIDE_CHILD_SEARCH_BENCHMARKS(blocked_child_search<8>);
+WIDE_CHILD_SEARCH_BENCHMARKS(blocked_child_search<16>);
+
+/*
+ * the words of a full leaf of B_LEAF = state.range(0) bits per element, i.e.
+ * 2 * B_LEAF bits
+ */
+static std::vector<uint64_t> leaf_words(benchmark::State& state) {
+	std::vector<uint64_t> words(2 * state.range(0) / 64);
+
+	uint64_t seed = 88172645463325252ull;
+	for (auto& w : words) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		w = seed;
+	}
+
+	return words;
+}
+
+/*
+ * rank at the end of a full leaf: popcount of all of its words
+ */
+template <uint64_t (*kernel)(const uint64_t*, uint64_t)> static void LeafPopcount(benchmark::State& state) {
+	auto words = leaf_words(state);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(kernel(words.data(), words.size()));
+	}
+
+	state.SetBytesProcessed(state.iterations() * words.size() * sizeof(uint64_t));
+}
+
+/*
+ * select in a full leaf: prefix scan up to the word holding the x-th bit
+ * set, for x spread over the leaf
+ */
+template <word_prefix (*kernel)(const uint64_t*, uint64_t, uint64_t)> static void LeafSelect(benchmark::State& state) {
+	auto words = leaf_words(state);
+	auto const ones = popcount_words_scalar(words.data(), words.size());
+
+	uint64_t x = 1;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(kernel(words.data(), words.size(), x));
+		x = x * 7 % ones + 1;
+	}
+}
+
+BENCHMARK_TEMPLATE(LeafPopcount, popcount_words_scalar)->RangeMultiplier(2)->Range(1024, 16384);
+BENCHMARK_TEMPLATE(LeafSelect, words_below_scalar<word_weight::ones>)->RangeMultiplier(2)->Range(1024, 16384);
+
+// kernels of the active tier (see --simd_tier)
+BENCHMARK_TEMPLATE(LeafPopcount, popcount_words)->RangeMultiplier(2)->Range(1024, 16384);
+BENCHMARK_TEMPLATE(LeafSelect, words_below<word_weight::ones>)->RangeMultiplier(2)->Range(1024, 16384);
+
+#if DYN_X86_DISPATCH
+static bool supported(benchmark::State& state, bool const feature) {
+	if (!feature) state.SkipWithError("not supported by this CPU");
+	return feature;
+}
+
+static void LeafPopcountAVX2(benchmark::State& state) {
+	if (supported(state, cpu.avx2)) LeafPopcount<popcount_words_avx2>(state);
+}
+BENCHMARK(LeafPopcountAVX2)->RangeMultiplier(2)->Range(1024, 16384);
+
+static void LeafSelectAVX2(benchmark::State& state) {
+	if (supported(state, cpu.avx2)) LeafSelect<words_below_avx2<word_weight::ones>>(state);
+}
+BENCHMARK(LeafSelectAVX2)->RangeMultiplier(2)->Range(1024, 16384);
+
+static void LeafPopcountAVX512(benchmark::State& state) {
+	if (supported(state, cpu.avx512_popcnt)) LeafPopcount<popcount_words_avx512>(state);
+}
+BENCHMARK(LeafPopcountAVX512)->RangeMultiplier(2)->Range(1024, 16384);
+
+static void LeafSelectAVX512(benchmark::State& state) {
+	if (supported(state, cpu.avx512_popcnt)) LeafSelect<words_below_avx512<word_weight::ones>>(state);
+}
+BENCHMARK(LeafSelectAVX512)->RangeMultiplier(2)->Range(1024, 16384);
+#endif
+
+/*
+ * psum on 2^20 integers of range(0) bits (40 for 64, so that the sum
+ * does not overflow), packed by the integer leaves with the field kernels
+ * of the active tier (see --simd_tier); bits_per_int is the space taken
+ */
+static void IntPrefixSum(benchmark::State& state) {
+	uint64_t const n = uint64_t(1) << 20;
+	uint64_t const mask = state.range(0) == 64 ? ~uint64_t(0) >> 24 : (uint64_t(1) << state.range(0)) - 1;
+
+	packed_spsi<> tree;
+	uint64_t seed = 88172645463325252ull;
+
+	for (uint64_t i = 0; i < n; ++i) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		tree.push_back(seed & mask);
+	}
+
+	for (auto _ : state) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		benchmark::DoNotOptimize(tree.psum(seed % n));
+	}
+
+	state.counters["bits_per_int"] = double(tree.bit_size()) / n;
+}
+BENCHMARK(IntPrefixSum)->RangeMultiplier(4)->Range(1, 64);
+
+/*
+ * a bitvector whose insert_rank is a rank, then an insert: two descents,
+ * as wavelet levels updated without insert_rank
+ */
+template <class bitvector> struct rank_then_insert : bitvector {
+	using bitvector::bitvector;
+
+	uint64_t insert_rank(uint64_t i, bool b) {
+		uint64_t const r = this->rank(i, b);
+		this->insert(i, b);
+
+		return r;
+	}
+};
+
+/*
+ * random byte inserts into a wavelet structure of range(0) symbols
+ */
+template <class T> static void WaveletInsertion(benchmark::State& state) {
+	uint64_t const n = state.range(0);
+	uint64_t seed = 88172645463325252ull;
+
+	std::vector<uint64_t> symbols(n);
+	for (auto& c : symbols) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		c = seed & 255;
+	}
+
+	T seq(256, symbols.data(), n);
+
+	for (auto _ : state) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		seq.insert(seed % (seq.size() + 1), seed >> 56);
+	}
+}
+
+using wavelet_bitvector = succinct_bitvector<buffer_4_packed_vector<>, 4096, 16, 0, b_spsi>;
+
+BENCHMARK_TEMPLATE(WaveletInsertion, wavelet_tree<wavelet_bitvector>)->Range(1 << 16, 1 << 20);
+BENCHMARK_TEMPLATE(WaveletInsertion, wavelet_tree<rank_then_insert<wavelet_bitvector>>)->Range(1 << 16, 1 << 20);
+BENCHMARK_TEMPLATE(WaveletInsertion, wavelet_matrix<wavelet_bitvector>)->Range(1 << 16, 1 << 20);
+BENCHMARK_TEMPLATE(WaveletInsertion, wavelet_matrix<rank_then_insert<wavelet_bitvector>>)->Range(1 << 16, 1 << 20);
+
 static void TreeInsertion(benchmark::State& state) {
 	succinct_bitvector<packed_vector, 4096, 256, 0, b_spsi> tree;
 
@@ -178,6 +462,168 @@ static void TreeInsertion(benchmark::State& state) {
 
 //BENCHMARK(TreeInsertion);
 
+/*
+ * inserts at pseudo-random positions into a tree of state.range(0) bits:
+ * every leaf or node split allocates, through the allocation policy of the
+ * tree
+ */
+template <class T> static void RandomInsertion(benchmark::State& state) {
+	uint64_t const n = state.range(0);
+
+	for (auto _ : state) {
+		T tree;
+		uint64_t seed = 88172645463325252ull;
+
+		for (uint64_t k = 0; k < n; ++k) {
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			tree.insert(seed % (k + 1), seed & 2);
+		}
+
+		benchmark::DoNotOptimize(tree.size());
+	}
+
+	state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK_TEMPLATE(RandomInsertion, succinct_bitvector<packed_vector, 256, 16, 0, b_spsi>)->Range(1 << 16, 1 << 20);
+BENCHMARK_TEMPLATE(RandomInsertion, succinct_bitvector<packed_vector, 256, 16, 0, pooled_b_spsi>)->Range(1 << 16, 1 << 20);
+BENCHMARK_TEMPLATE(RandomInsertion, succinct_bitvector<packed_vector, 256, 16, 0, compact_b_spsi>)->Range(1 << 16, 1 << 20);
+BENCHMARK_TEMPLATE(RandomInsertion, succinct_bitvector<packed_vector, 256, 16, 16, b_spsi>)->Range(1 << 16, 1 << 20);
+BENCHMARK_TEMPLATE(RandomInsertion, succinct_bitvector<packed_vector, 256, 16, 64, b_spsi>)->Range(1 << 16, 1 << 20);
+
+/*
+ * inserts at a cursor that moves by at most 8 positions between two of them
+ * (a highly local edit stream)
+ */
+template <class T> static void LocalInsertion(benchmark::State& state) {
+	uint64_t const n = state.range(0);
+
+	for (auto _ : state) {
+		T tree;
+		uint64_t seed = 88172645463325252ull;
+		uint64_t cursor = 0;
+
+		for (uint64_t k = 0; k < n; ++k) {
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+
+			uint64_t const step = (seed >> 32) % 17;
+			cursor = std::min(k, cursor + step < 8 ? 0 : cursor + step - 8);
+
+			tree.insert(cursor, seed & 2);
+		}
+
+		benchmark::DoNotOptimize(tree.size());
+	}
+
+	state.SetItemsProcessed(state.iterations() * n);
+}
+
+enum class layout_query { rank, select1, select0 };
+
+/*
+ * rank, select1 or select0 at pseudo-random positions of a bulk-loaded tree
+ * of state.range(0) random bits, for each counter layout of the nodes
+ * (counter-layout.hpp). The bits_per_bit counter is the space of the tree.
+ */
+template <class T, layout_query q> static void CounterLayout(benchmark::State& state) {
+	uint64_t const n = state.range(0);
+	std::vector<uint64_t> words(n / 64 + 1);
+
+	uint64_t seed = 88172645463325252ull;
+	for (auto& w : words) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		w = seed;
+	}
+
+	T tree(words.data(), n);
+	uint64_t const ones = tree.rank(n);
+
+	for (auto _ : state) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		if constexpr (q == layout_query::rank) benchmark::DoNotOptimize(tree.rank(seed % n));
+		else if constexpr (q == layout_query::select1) benchmark::DoNotOptimize(tree.select1(seed % ones + 1));
+		else benchmark::DoNotOptimize(tree.select0(seed % (n - ones) + 1));
+	}
+
+	state.counters["bits_per_bit"] = double(tree.bit_size()) / n;
+}
+
+#define COUNTER_LAYOUT_BENCHMARKS(spsi) \
+	BENCHMARK_TEMPLATE(CounterLayout, succinct_bitvector<packed_vector, 256, 16, 0, spsi>, layout_query::rank)->Range(1 << 16, 1 << 24); \
+	BENCHMARK_TEMPLATE(CounterLayout, succinct_bitvector<packed_vector, 256, 16, 0, spsi>, layout_query::select1)->Range(1 << 16, 1 << 24); \
+	BENCHMARK_TEMPLATE(CounterLayout, succinct_bitvector<packed_vector, 256, 16, 0, spsi>, layout_query::select0)->Range(1 << 16, 1 << 24)
+
+COUNTER_LAYOUT_BENCHMARKS(b_spsi);
+COUNTER_LAYOUT_BENCHMARKS(zeros_b_spsi);
+COUNTER_LAYOUT_BENCHMARKS(compact_ones_b_spsi);
+COUNTER_LAYOUT_BENCHMARKS(compact_b_spsi);
+
+/*
+ * rank on 2^22 bits, one in range(0) set, with plain, adaptive and hybrid
+ * leaves; bits_per_bit is the space taken
+ */
+template <class T> static void Density(benchmark::State& state) {
+	uint64_t const n = uint64_t(1) << 22;
+	uint64_t const one_in = state.range(0);
+
+	std::vector<uint64_t> words(n / 64, 0);
+	uint64_t seed = 88172645463325252ull;
+
+	for (uint64_t i = 0; i < n; ++i) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		if (seed % one_in == 0) words[i >> 6] |= uint64_t(1) << (i & 63);
+	}
+
+	T tree(words.data(), n);
+
+	for (auto _ : state) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+
+		benchmark::DoNotOptimize(tree.rank(seed % n));
+	}
+
+	state.counters["bits_per_bit"] = double(tree.bit_size()) / n;
+}
+
+BENCHMARK_TEMPLATE(Density, succinct_bitvector<packed_vector, 4096, 16, 0, b_spsi>)->RangeMultiplier(8)->Range(2, 1 << 12);
+BENCHMARK_TEMPLATE(Density, adaptive_succinct_bitvector<>)->RangeMultiplier(8)->Range(2, 1 << 12);
+BENCHMARK_TEMPLATE(Density, hybrid_succinct_bitvector<>)->RangeMultiplier(8)->Range(2, 1 << 12);
+
+/*
+ * the same pseudo-random and local inserts with every leaf variant
+ * (packed-vector.hpp, gap-vector.hpp): insertions applied one by one with
+ * masked or bitwise shifts, buffered 2, 3, 4, 8, 16, 32 or 64 at a time, or
+ * filling a movable gap
+ */
+#define LEAF_BENCHMARKS(leaf) \
+	BENCHMARK_TEMPLATE(RandomInsertion, succinct_bitvector<leaf, 4096, 16, 0, b_spsi>)->Range(1 << 16, 1 << 20); \
+	BENCHMARK_TEMPLATE(LocalInsertion, succinct_bitvector<leaf, 4096, 16, 0, b_spsi>)->Range(1 << 16, 1 << 20)
+
+LEAF_BENCHMARKS(unbuffered_packed_vector<>);
+LEAF_BENCHMARKS(dynamic_packed_vector<>);
+LEAF_BENCHMARKS(buffer_2_packed_vector<>);
+LEAF_BENCHMARKS(buffer_3_packed_vector<>);
+LEAF_BENCHMARKS(buffer_4_packed_vector<>);
+LEAF_BENCHMARKS(buffer_k_packed_vector<8>);
+LEAF_BENCHMARKS(buffer_k_packed_vector<16>);
+LEAF_BENCHMARKS(buffer_k_packed_vector<32>);
+LEAF_BENCHMARKS(buffer_k_packed_vector<64>);
+LEAF_BENCHMARKS(gap_packed_vector<>);
+
 template <class T> static void Query(benchmark::State& state) {
 	T tree{};
 
@@ -277,6 +723,24 @@ template <class T> static void Select(benchmark::State& state) {
 
 int main(int argc, char** argv)
 {
+	// --simd_tier=scalar|sse42|avx2|avx512 caps the kernels used by the tree
+	int kept = 1;
+	for (int a = 1; a < argc; ++a) {
+		const char* flag = "--simd_tier=";
+
+		if (std::strncmp(argv[a], flag, std::strlen(flag)) != 0) {
+			argv[kept++] = argv[a];
+			continue;
+		}
+
+		const char* tier = argv[a] + std::strlen(flag);
+		for (auto t : { simd_tier::scalar, simd_tier::sse42, simd_tier::avx2, simd_tier::avx512 }) {
+			if (std::strcmp(tier, simd_tier_name(t)) == 0) force_simd_tier(t);
+		}
+	}
+	argc = kept;
+
+	std::printf("simd tier: %s\n", simd_tier_name(active_simd_tier));
 	::benchmark::Initialize(&argc, argv);
 
 	if (::benchmark::ReportUnrecognizedArguments(argc, argv))
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "b-spsi.hpp"
+#include "packed-vector.hpp"
+#include "rle-vector.hpp"
+#include "succinct-bitvector.hpp"
+#include <type_traits>
+#include <variant>
+
+/*
+ * a bitvector leaf of b_spsi that is either a plain leaf (a bit array) or a
+ * compressed one (run-length coded), whichever suits its content: the
+ * compressed form when its runs are min_run bits long on average, i.e. for
+ * sparse leaves (few ones) and leaves made of long runs.
+ *
+ * The form is picked when the leaf is built from words (bulk builds, the
+ * right half of a split) and again for the left half of a split, so that a
+ * tree over a vector whose density varies from region to region holds plain
+ * and compressed leaves where each fits best. bit_size() is that of the
+ * form in use.
+ */
+
+namespace dyn {
+	template <class plain = packed_bit_vector<>, class compressed = rle_bit_vector<>, uint32_t min_run = 16>
+	class adaptive_bit_vector {
+	public:
+		explicit adaptive_bit_vector(uint64_t const size = 0) : leaf(std::in_place_type<plain>, size) {}
+
+		explicit adaptive_bit_vector(std::vector<uint64_t>&& _words, uint64_t const new_size)
+			: leaf(make_form(std::move(_words), new_size)) {}
+
+		/*
+		 * true when the leaf is run-length coded
+		 */
+		bool is_compressed() const {
+			return std::holds_alternative<compressed>(leaf);
+		}
+
+		bool at(uint64_t const i) const {
+			return std::visit([&](auto const& l) { return bool(l.at(i)); }, leaf);
+		}
+
+		uint64_t psum() const {
+			return std::visit([](auto const& l) { return l.psum(); }, leaf);
+		}
+
+		/*
+		 * inclusive partial sum (i.e. up to element i included)
+		 */
+		uint64_t psum(uint64_t const i) const {
+			return std::visit([&](auto const& l) { return l.psum(i); }, leaf);
+		}
+
+		/*
+		 * smallest index j such that psum(j)>=x
+		 */
+		uint64_t search(uint64_t const x) const {
+			return std::visit([&](auto const& l) { return l.search(x); }, leaf);
+		}
+
+		/*
+		 * first position i such that the number of zeros before i (included)
+		 * is == x
+		 */
+		uint64_t search_0(uint64_t const x) const {
+			return std::visit([&](auto const& l) { return l.search_0(x); }, leaf);
+		}
+
+		/*
+		 * smallest index j such that psum(j)+j>=x
+		 */
+		uint64_t search_r(uint64_t const x) const {
+			return std::visit([&](auto const& l) { return l.search_r(x); }, leaf);
+		}
+
+		bool contains(uint64_t const x) const {
+			return std::visit([&](auto const& l) { return l.contains(x); }, leaf);
+		}
+
+		bool contains_r(uint64_t const x) const {
+			return std::visit([&](auto const& l) { return l.contains_r(x); }, leaf);
+		}
+
+		/*
+		 * set the i-th bit to val (to 0 if subtract)
+		 */
+		void increment(uint64_t const i, bool const val, bool const subtract = false) {
+			std::visit([&](auto& l) { l.increment(i, val, subtract); }, leaf);
+		}
+
+		void append(uint64_t const x) {
+			push_back(x);
+		}
+
+		void remove(uint64_t const i) {
+			std::visit([&](auto& l) { l.remove(i); }, leaf);
+		}
+
+		void insert(uint64_t const i, uint64_t const x) {
+			std::visit([&](auto& l) { l.insert(i, x); }, leaf);
+		}
+
+		void push_back(bool const x) {
+			std::visit([&](auto& l) { l.push_back(x); }, leaf);
+		}
+
+		uint64_t size() const {
+			return std::visit([](auto const& l) { return l.size(); }, leaf);
+		}
+
+		/*
+		 * split content of this vector into 2 blocks:
+		 * Left part remains in this block, right part in the
+		 * new returned block
+		 */
+		adaptive_bit_vector* split() {
+			return split([](std::vector<uint64_t>&& w, uint64_t n) { return new adaptive_bit_vector(std::move(w), n); });
+		}
+
+		/*
+		 * as split(), with the right block built by make_leaf(words, size)
+		 * (e.g. in the leaf pool of a tree), which picks its form. The left
+		 * half picks its form again
+		 */
+		template <class make_leaf> adaptive_bit_vector* split(make_leaf&& make) {
+			std::vector<uint64_t> right_words;
+			uint64_t right_size = 0;
+
+			std::visit([&](auto& l) {
+				l.split([&](std::vector<uint64_t>&& w, uint64_t const n) {
+					right_words = std::move(w);
+					right_size = n;
+
+					return static_cast<std::remove_reference_t<decltype(l)>*>(nullptr);
+				});
+			}, leaf);
+
+			std::vector<uint64_t> words(words_for(size()));
+			for (uint64_t j = 0; j < words.size(); ++j) words[j] = word(j);
+
+			if (compresses(words.data(), size()) != is_compressed()) leaf = make_form(std::move(words), size());
+
+			return make(std::move(right_words), right_size);
+		}
+
+		/*
+		 * return total number of bits occupied in memory by this object instance
+		 */
+		uint64_t bit_size() const {
+			// the variant takes the room of the largest form
+			return std::visit([](auto const& l) { return 8 * (sizeof(adaptive_bit_vector) - sizeof(l)) + l.bit_size(); }, leaf);
+		}
+
+		uint64_t width() const {
+			return 1;
+		}
+
+		/*
+		 * j-th word of the content, i.e. elements 64j ... 64j+63. Bits past
+		 * the end of the vector are 0.
+		 */
+		uint64_t word(uint64_t const j) const {
+			return std::visit([&](auto const& l) { return l.word(j); }, leaf);
+		}
+
+		/*
+		 * insert the n integers of the given width packed in word at position i
+		 */
+		void insert_word(uint64_t const i, uint64_t const word, uint8_t const width, uint8_t const n) {
+			std::visit([&](auto& l) { l.insert_word(i, word, width, n); }, leaf);
+		}
+
+	private:
+		/*
+		 * the first n bits of words are better run-length coded
+		 */
+		static bool compresses(const uint64_t* words, uint64_t const n) {
+			return n > 0 and count_runs(words, n) * min_run <= n;
+		}
+
+		static std::variant<plain, compressed> make_form(std::vector<uint64_t>&& words, uint64_t const n) {
+			if (compresses(words.data(), n)) return std::variant<plain, compressed>(std::in_place_type<compressed>, std::move(words), n);
+
+			return std::variant<plain, compressed>(std::in_place_type<plain>, std::move(words), n);
+		}
+
+		std::variant<plain, compressed> leaf;
+	};
+
+	/*
+	 * plain leaves with 4 buffered insertions, compressed ones with blocks of
+	 * 32 runs
+	 */
+	using adaptive_packed_vector = adaptive_bit_vector<buffer_4_packed_vector<>, rle_bit_vector<>>;
+
+	/*
+	 * succinct_bitvector in adaptive mode: every leaf plain or run-length
+	 * coded, by its density at the last split
+	 */
+	template <uint32_t B_LEAF = 4096, uint32_t B = 16>
+	using adaptive_succinct_bitvector = succinct_bitvector<adaptive_packed_vector, B_LEAF, B, 0, b_spsi>;
+}
@@ -17,15 +17,36 @@
  *  The structure is a B+-tree. This improves data locality and space
  * efficiency.
  *
+ *  With buffer_size > 0 it is a Bε-tree for insertions: every node keeps up
+ * to buffer_size pending insertions (message-buffer.hpp) and pushes them down
+ * to its children together when it has no room left, so that an insertion
+ * reaches its leaf in batches with others instead of alone. Queries look at
+ * the pending insertions on their way down; removals and increments of a
+ * pending integer are applied to it in the buffer. This mode is experimental
+ * and off by default: in RAM, where a descent is cheap, it makes insertions
+ * slower, not faster.
+ *
  */
 #pragma once
 
-#include <immintrin.h>
+#include <algorithm>
 #include <array>
 #include <fstream>
+#include "bit-utils.hpp"
+#include "child-array.hpp"
+#include "counter-kernels.hpp"
+#include "counter-layout.hpp"
+#include "fill-policy.hpp"
+#include "flat-format.hpp"
+#include "message-buffer.hpp"
+#include "node-pool.hpp"
 #include "spsi-reference.hpp"
 #include "msvc.hpp"
 #include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
 
 namespace dyn {
 	using namespace std;
@@ -37,60 +58,83 @@ namespace dyn {
 					// internal node
 		// is always B <= n <= 2B+1  (except at the beginning)
 		// Alan: Actually, B + 1 <= n <= 2B+2  (except at the beginning)
-		uint64_t buffer_size = 0
+		uint64_t buffer_size = 0,  // pending insertions per node, Bε-tree style (0: none; experimental)
+		class child_search = simd_child_search<>,  // finds the child of a node to descend into
+		class allocation = heap_allocation,  // where nodes and leaves are allocated (node-pool.hpp)
+		class counter_type = uint64_t,  // integer type of the counters of the internal nodes
+		class counter_layout = ones_counters<>,  // what the second counter array of a node holds (counter-layout.hpp)
+		class fill = fill_policy<>  // how full leaves and nodes are kept (fill-policy.hpp)
 	>
-		class b_spsi {
+		class basic_b_spsi {
 		public:
 			/*
 			 * copy constructor
 			 */
-			explicit b_spsi(const b_spsi& sp) { root = new node(*sp.root); }
+			explicit basic_b_spsi(const basic_b_spsi& sp) : mem(new pools()) { root = mem->new_node(*sp.root); }
 
 			/*
 			 * move constructor
 			 */
-			b_spsi(b_spsi&& sp) { root = sp.root; sp.root = NULL; }
+			basic_b_spsi(basic_b_spsi&& sp) : mem(sp.mem), root(sp.root) {
+				sp.mem = NULL;
+				sp.root = NULL;
+			}
 
 			/*
 			 * copy assignment
 			 */
-			void operator=(const b_spsi& sp) {
+			void operator=(const basic_b_spsi& sp) {
 				root->free_mem();
-				delete root;
+				mem->free(root);
 
-				root = new node(*sp.root);
+				root = mem->new_node(*sp.root);
 			}
 
 			/*
 			 * move assignment
 			 */
-			void operator=(b_spsi&& sp) noexcept {
+			void operator=(basic_b_spsi&& sp) noexcept {
 				root->free_mem();
-				delete root;
+				mem->free(root);
+				delete mem;
 
+				mem = sp.mem;
 				root = sp.root;
+				sp.mem = NULL;
 				sp.root = NULL;
 			}
 
-			using spsi_ref = spsi_reference<b_spsi>;
+			using spsi_ref = spsi_reference<basic_b_spsi>;
 
 			/*
 			 * create empty spsi.
 			 */
-			b_spsi() : root(new node()) {}
+			basic_b_spsi() : mem(new pools()), root(mem->new_node()) {}
 
 			/*
 			 * create empty spsi. Input parameters are not used (legacy option). This
 			 * structure does not need a max size, and width is automatically detected.
 			 */
-			b_spsi(uint64_t) : b_spsi() {}
-			b_spsi(uint64_t, uint64_t) : b_spsi() {}
+			basic_b_spsi(uint64_t) : basic_b_spsi() {}
+			basic_b_spsi(uint64_t, uint64_t) : basic_b_spsi() {}
+
+			/*
+			 * bulk-build a spsi over the nbits bits packed into words (bit i is
+			 * bit i % 64 of words[i / 64]). The tree is built bottom-up: leaves are
+			 * cut directly from the input and packed to bulk_leaf_fill bits, then
+			 * internal nodes are built level by level. No insert nor split is
+			 * performed.
+			 */
+			basic_b_spsi(const uint64_t* words, uint64_t nbits)
+				: mem(new pools()), root(nbits == 0 ? mem->new_node() : build(words, nbits)) {}
 
-			~b_spsi() {
+			~basic_b_spsi() {
 				if (root) {
 					root->free_mem();
-					delete root;
+					mem->free(root);
 				}
+
+				delete mem;
 			}
 
 			/*
@@ -159,6 +203,29 @@ namespace dyn {
 				return root->depth();
 			}
 
+			/*
+			 * batched queries: out[k] = at(i[k]) (resp. psum, search, search_0)
+			 * for k < n. The queries are sorted (if they are not already) and
+			 * answered in a single traversal of the tree: every node is visited
+			 * at most once per batch, and the queries falling in its subtree
+			 * share the visit.
+			 */
+			void at_batch(const uint64_t* i, uint64_t n, uint64_t* out) const {
+				batch<batch_op::at>(i, n, out);
+			}
+
+			void psum_batch(const uint64_t* i, uint64_t n, uint64_t* out) const {
+				batch<batch_op::psum>(i, n, out);
+			}
+
+			void search_batch(const uint64_t* x, uint64_t n, uint64_t* out) const {
+				batch<batch_op::search>(x, n, out);
+			}
+
+			void search_0_batch(const uint64_t* x, uint64_t n, uint64_t* out) const {
+				batch<batch_op::search_0>(x, n, out);
+			}
+
 			/*
 			 * true iif x is one of  0, I_0+1, I_0+I_1+2, ...
 			 */
@@ -186,6 +253,8 @@ namespace dyn {
 			void insert(uint64_t i, uint64_t x) {
 				assert(i <= root->size());
 
+				check_counters(1, x);
+
 				node* new_root = root->insert(i, x);
 
 				if (new_root != NULL) {
@@ -203,6 +272,17 @@ namespace dyn {
 
 				assert(i <= root->size());
 
+				// the pending insertions of a node are single integers
+				if constexpr (buffered) {
+					uint64_t const mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+
+					for (uint8_t k = 0; k < n; ++k) insert(i + k, (x >> (k * width)) & mask);
+					return;
+				}
+
+				// the n integers sum to at most x
+				check_counters(n, x);
+
 				node* new_root = root->insert(i, x, width, n);
 
 				if (new_root != NULL) {
@@ -210,15 +290,106 @@ namespace dyn {
 				}
 			}
 
+			/*
+			 * insert x at position i and return I_0 + ... + I_(i-1) (rank(i) on a
+			 * bitvector), summed on the way down: one descent instead of a psum
+			 * and an insert. With pending insertions (Bε-tree mode), the two.
+			 */
+			uint64_t insert_psum(uint64_t i, uint64_t x) {
+				assert(i <= root->size());
+
+				uint64_t before = 0;
+
+				if constexpr (buffered) {
+					before = i == 0 ? 0 : psum(i - 1);
+					insert(i, x);
+				}
+				else {
+					check_counters(1, x);
+
+					node* new_root = root->insert_through(i, x, &before);
+
+					if (new_root != NULL) root = new_root;
+				}
+
+				return before;
+			}
+
 			/*
 			 * remove the integer x at position i
 			 */
 			void remove(uint64_t i) {
-				node* new_root = root->remove(i);
-				if (new_root != NULL) {
-					delete root;
-					root = new_root;
+				root->remove(i);
+
+				collapse_root();
+			}
+
+			/*
+			 * remove the integer at position i and return it, with
+			 * I_0 + ... + I_(i-1) in before, in one descent as insert_psum
+			 */
+			uint64_t remove_psum(uint64_t i, uint64_t& before) {
+				assert(i < size());
+
+				before = 0;
+
+				uint64_t z;
+
+				if constexpr (buffered) {
+					before = i == 0 ? 0 : psum(i - 1);
+					z = root->remove(i);
+				}
+				else {
+					z = root->remove(i, &before);
 				}
+
+				collapse_root();
+
+				return z;
+			}
+
+			/*
+			 * Works only on bitvectors!
+			 *
+			 * insert the nbits bits packed into words (bit k is bit k % 64 of
+			 * words[k / 64]) at position i. The tree is split along the path to
+			 * position i, the new bits are built into a subtree of their own, and
+			 * the three are joined again: only the leaf containing position i is
+			 * cut, and only the nodes of that path are split, merged or
+			 * recounted, in O(depth * B + B_LEAF) plus the build of the new bits.
+			 */
+			void insert_range(uint64_t i, const uint64_t* words, uint64_t nbits) {
+				assert(i <= size());
+
+				if (nbits == 0) return;
+
+				check_counters(nbits, nbits);
+
+				auto [left, right] = split_piece(take_root(), i);
+				piece const middle = build_piece(words, nbits);
+
+				set_root(join(join(left, middle), right));
+			}
+
+			/*
+			 * Works only on bitvectors!
+			 *
+			 * remove the integers in positions [i, j). The tree is split along
+			 * the paths to positions i and j: the two boundary leaves are cut,
+			 * the subtrees in between are unlinked and freed whole, and the two
+			 * outer parts are joined again, rebalancing only the nodes of the two
+			 * paths.
+			 */
+			void erase_range(uint64_t i, uint64_t j) {
+				assert(i <= j and j <= size());
+
+				if (i == j) return;
+
+				auto [left, rest] = split_piece(take_root(), i);
+				auto [middle, right] = split_piece(rest, j - i);
+
+				free_piece(middle);
+				set_root(join(left, right));
 			}
 
 			/*
@@ -240,7 +411,7 @@ namespace dyn {
 			uint64_t bit_size() const {
 				assert(root != NULL);
 
-				uint64_t bs = 8 * sizeof(b_spsi<leaf_type, B_LEAF, B>);
+				uint64_t bs = 8 * sizeof(basic_b_spsi) + mem->bit_size();
 
 				if (root != NULL) bs += root->bit_size();
 				return bs;
@@ -268,6 +439,8 @@ namespace dyn {
 
 				assert(not subtract or delta <= at(i));
 
+				check_counters(0, subtract ? 0 - delta : delta);
+
 				root->increment(i, delta, subtract);
 			}
 
@@ -277,302 +450,915 @@ namespace dyn {
 			void set(uint64_t i, uint64_t x) {
 				auto val = at(i);
 
+				// a bitvector leaf reads an increment by 0 as setting the bit to 0
+				if (val == x) return;
+
 				increment(i, (val > x ? val - x : x - val), x < val);
 			}
 
 			uint64_t serialize(ostream& out) const {
 				assert(root);
+
+				// the format has no pending insertions: a copy applies them
+				if (pending_insertions() > 0) {
+					basic_b_spsi flushed(*this);
+					flushed.flush();
+
+					return flushed.serialize(out);
+				}
+
 				return root->serialize(out);
 			}
 
 			void load(istream& in) {
-				root = new node();
+				root->free_mem();
+				mem->free(root);
+
+				root = mem->new_node();
 				root->load(in);
 			}
 
-		private:
-			class node;
-			node* root = NULL;  // tree root
-	};
-
-
-	template <class leaf_type,  // underlying representation of the integers
-		uint32_t B_LEAF,  // number of integers m allowed for a
-		// leaf is B_LEAF <= m <= 2*B_LEAF (except at the beginning)
-		uint32_t B,  // Order of the tree: number of elements n in each
-					// internal node
-		// is always B <= n <= 2B+1  (except at the beginning)
-		// Alan: Actually, B + 1 <= n <= 2B+2  (except at the beginning)
-		uint64_t buffer_size
-	>
-		class b_spsi<leaf_type, B_LEAF, B, buffer_size>::node {
-		public:
 			/*
-			 * copy constructor
+			 * Works only on bitvectors!
+			 *
+			 * write the tree in the flat format described in flat-format.hpp: nodes
+			 * breadth-first, then the leaves as contiguous word runs. The result can
+			 * be memory-mapped and queried in place by a mapped_bitvector.
+			 * Returns the number of bytes written.
 			 */
-			node(const node& n) {
-				subtree_sizes = n.subtree_sizes;
-				subtree_psums = n.subtree_psums;
+			uint64_t serialize_flat(ostream& out) const {
+				assert(root);
 
-				if (n.has_leaves_) {
-					leaves = vector<leaf_type*>(n.nr_children, NULL);
+				if (pending_insertions() > 0) {
+					basic_b_spsi flushed(*this);
+					flushed.flush();
 
-					for (uint64_t i = 0; i < n.nr_children; ++i) {
-						leaves[i] = new leaf_type(*n.leaves[i]);
+					return flushed.serialize_flat(out);
+				}
+
+				// breadth-first visit: children of a node end up consecutive
+				vector<const node*> nodes{ root };
+				vector<uint64_t> first_child;
+				vector<const leaf_type*> leaves;
+
+				for (uint64_t k = 0; k < nodes.size(); ++k) {
+					const node* n = nodes[k];
+
+					if (n->has_leaves()) {
+						first_child.push_back(leaves.size());
+						for (uint32_t j = 0; j < n->number_of_children(); ++j) leaves.push_back(n->leaf(j));
+					}
+					else {
+						first_child.push_back(nodes.size());
+						for (uint32_t j = 0; j < n->number_of_children(); ++j) nodes.push_back(n->child(j));
 					}
+				}
 
+				flat_header h{};
+				h.magic = flat_magic;
+				h.version = flat_version;
+				h.B = B;
+				h.B_LEAF = B_LEAF;
+				h.size = size();
+				h.psum = psum();
+				h.nr_nodes = nodes.size();
+				h.nr_leaves = leaves.size();
+				h.depth = depth();
+				h.nodes_offset = sizeof(flat_header);
+
+				vector<uint64_t> node_offsets(nodes.size());
+				uint64_t offset = h.nodes_offset + sizeof(uint64_t) * nodes.size();
+
+				for (uint64_t k = 0; k < nodes.size(); ++k) {
+					node_offsets[k] = offset;
+					offset += nodes[k]->flat_record_size();
 				}
-				else {
-					children = vector<node*>(n.nr_children, NULL);
 
-					for (uint64_t i = 0; i < n.nr_children; ++i) {
-						children[i] = new node(*n.children[i]);
-						children[i]->overwrite_parent(this);
-					}
+				h.leaves_offset = offset;
+				h.words_offset = offset + 2 * sizeof(uint64_t) * leaves.size();
+
+				vector<uint64_t> leaf_dir(2 * leaves.size());
+				uint64_t nr_words = 0;
+
+				for (uint64_t k = 0; k < leaves.size(); ++k) {
+					leaf_dir[2 * k] = nr_words;
+					leaf_dir[2 * k + 1] = leaves[k]->size();
+					nr_words += words_for(leaves[k]->size());
 				}
 
-				rank_ = n.rank_;  // rank of this node among its siblings
+				h.file_size = h.words_offset + sizeof(uint64_t) * nr_words;
 
-				nr_children = n.nr_children;  // number of subtrees
+				out.write((char*)& h, sizeof(h));
+				out.write((char*)node_offsets.data(), sizeof(uint64_t) * node_offsets.size());
 
-				has_leaves_ = n.has_leaves_;  // if true, leaves array is nonempty and
-											  // children is empty
-			}
+				for (uint64_t k = 0; k < nodes.size(); ++k) nodes[k]->serialize_flat(out, first_child[k]);
 
-			/*
-			 * create new root node. This node has only 1 (empty) child, which is a
-			 * leaf.
-			 */
-			node() : subtree_sizes{}, subtree_psums{} {
-				nr_children = 1;
-				has_leaves_ = true;
+				out.write((char*)leaf_dir.data(), sizeof(uint64_t) * leaf_dir.size());
 
-				leaves = vector<leaf_type*>(1);
-				leaves[0] = new leaf_type();
+				vector<uint64_t> w;
+				for (auto l : leaves) {
+					w.resize(words_for(l->size()));
+					for (uint64_t j = 0; j < w.size(); ++j) w[j] = l->word(j);
+
+					out.write((char*)w.data(), sizeof(uint64_t) * w.size());
+				}
+
+				return h.file_size;
 			}
 
 			/*
-			 * create new node given some children (other internal nodes),the parent,
-			 * and the rank of this node among its siblings
+			 * number of insertions waiting in the buffers of the nodes (Bε-tree
+			 * mode)
 			 */
-			node(vector<node*>&& c, node* P = NULL, uint32_t rank = 0) {
-				this->rank_ = rank;
-				this->parent = P;
-
-				uint64_t si = 0;
-				uint64_t ps = 0;
+			uint64_t pending_insertions() const { return root->pending_insertions(); }
 
-				assert(c.size() <= 2 * B + 2);
+			/*
+			 * apply the insertions waiting in the buffers of the nodes down to
+			 * the leaves (Bε-tree mode): e.g. at the end of an ingest phase. They
+			 * are taken out of the tree and inserted again, straight down.
+			 */
+			void flush() {
+				if constexpr (buffered) {
+					message_buffer<buffer_size> pending;
+					root->drain(pending);
 
-				for (uint32_t i = 0; i < c.size(); ++i) {
-					si += c[i]->size();
-					ps += c[i]->psum();
+					for (uint32_t k = 0; k < pending.size(); ++k) {
+						node* new_root = root->insert_through(pending.pos(k), pending.val(k));
 
-					subtree_sizes[i] = si;
-					subtree_psums[i] = ps;
+						if (new_root != NULL) root = new_root;
+					}
 				}
+			}
 
-				nr_children = c.size();
-				has_leaves_ = false;
+		private:
+			class node;
 
-				children = std::move(c);
+			static constexpr bool buffered = buffer_size > 0;
 
-				uint32_t r = 0;
-				for (auto cc : children) {
-					cc->overwrite_rank(r++);
-					cc->overwrite_parent(this);
+			/*
+			 * if the root has only one internal child, make that child the root
+			 */
+			void collapse_root() {
+				if (not root->has_leaves() and root->number_of_children() == 1) {
+					node* new_root = root->only_child();
+					mem->free(root);
+					root = new_root;
 				}
 			}
 
+			// integer type of the second counter array of the nodes
+			using second_type = typename counter_layout::template type<counter_type>;
+
 			/*
-			 * create new node given some children (leaves),the parent, and the rank of
-			 * this node among its siblings
+			 * the node and leaf pools of a tree. Every node points to them, so they
+			 * stay at the same address for the lifetime of the tree.
 			 */
-			node(vector<leaf_type*>&& c, node* P = NULL, uint32_t rank = 0) {
-				this->rank_ = rank;
-				this->parent = P;
+			struct pools {
+				typename allocation::template pool<node> nodes;
+				typename allocation::template pool<leaf_type> leaves;
 
-				assert(c.size() <= 2 * B + 2);
+				template <class... Args> node* new_node(Args&&... args) {
+					return nodes.make(this, std::forward<Args>(args)...);
+				}
 
-				uint64_t si = 0;
-				uint64_t ps = 0;
+				template <class... Args> leaf_type* new_leaf(Args&&... args) {
+					return leaves.make(std::forward<Args>(args)...);
+				}
 
-				for (uint32_t i = 0; i < c.size(); ++i) {
-					si += c[i]->size();
-					ps += c[i]->psum();
+				void free(node* n) { nodes.destroy(n); }
+				void free(leaf_type* l) { leaves.destroy(l); }
 
-					subtree_sizes[i] = si;
-					subtree_psums[i] = ps;
-				}
+				uint64_t bit_size() const { return 8 * sizeof(pools) + nodes.bit_size() + leaves.bit_size(); }
+			};
 
-				nr_children = c.size();
-				has_leaves_ = true;
+			enum class batch_op { at, psum, search, search_0 };
+
+			// search, search_0 and search_r
+			enum class search_op { ones, zeros, ones_and_size };
+
+			// [key, index of the query in the batch]
+			using query = std::pair<uint64_t, uint64_t>;
+
+			template <batch_op op>
+			void batch(const uint64_t* keys, uint64_t n, uint64_t* out) const {
+				if (n == 0) return;
 
-				leaves = std::move(c);
+				vector<query> q(n);
+				for (uint64_t k = 0; k < n; ++k) q[k] = { keys[k], k };
+
+				if (not std::is_sorted(keys, keys + n)) std::sort(q.begin(), q.end());
+
+				root->template batch<op>(q.data(), q.data() + n, 0, out);
 			}
 
 			/*
-			 * return bit size of all structures rooted in this node
+			 * fill targets of the bulk build, and fewest integers of a leaf and
+			 * children of a node (see fill-policy.hpp)
 			 */
-			uint64_t bit_size() const {
-				uint64_t bs = 8 * sizeof(node);
+			static constexpr uint64_t bulk_leaf_fill = fill::bulk(2 * B_LEAF);
+			static constexpr uint64_t bulk_node_fill = fill::bulk(2 * B + 2);
+			static constexpr uint64_t leaf_minimum = fill::minimum(2 * B_LEAF);
+			static constexpr uint64_t node_minimum = fill::minimum(2 * B + 2);
 
-				bs += subtree_sizes.size() * sizeof(uint64_t) * 8;
+			/*
+			 * number of groups in which n items have to be cut so that each group
+			 * holds between lo and hi items, and as close as possible to target
+			 * items. The lower bound is relaxed if n is too small.
+			 */
+			static uint64_t nr_groups(uint64_t n, uint64_t lo, uint64_t hi, uint64_t target) {
+				assert(n > 0);
 
-				bs += subtree_psums.size() * sizeof(uint64_t) * 8;
+				target = std::max<uint64_t>(target, 1);
 
-				bs += children.capacity() * sizeof(node*) * 8;
+				uint64_t g = (n + target - 1) / target;
+				g = std::min(g, std::max<uint64_t>(n / lo, 1));
 
-				bs += leaves.capacity() * sizeof(leaf_type*) * 8;
+				return std::max(g, (n + hi - 1) / hi);
+			}
 
-				if (has_leaves()) {
-					for (uint64_t i = 0; i < nr_children; ++i) {
-						assert(leaves[i] != NULL);
-						bs += leaves[i]->bit_size();
-					}
+			/*
+			 * group the children c (leaves or nodes) into as few nodes as needed
+			 * to respect the fanout bounds
+			 */
+			template <class child_type>
+			vector<node*> build_level(vector<child_type*>& c) {
+				uint64_t const n = c.size();
+				uint64_t const g = nr_groups(n, node_minimum, 2 * B + 2, bulk_node_fill);
 
-				}
-				else {
-					for (uint64_t i = 0; i < nr_children; ++i) {
-						assert(children[i] != NULL);
-						bs += children[i]->bit_size();
-					}
-				}
+				vector<node*> level(g);
+				auto it = c.begin();
 
-				return bs;
-			}
+				for (uint64_t k = 0; k < g; ++k) {
+					uint64_t len = n / g + (k < n % g);
 
-			uint64_t depth() const
-			{
-				if (has_leaves())
-				{
-					return 1;
+					level[k] = mem->new_node(&*it, &*it + len);
+					it += len;
 				}
 
-				return 1 + children[0]->depth();
+				assert(it == c.end());
+
+				return level;
 			}
 
-			bool has_leaves() const { return has_leaves_; }
+			/*
+			 * bottom-up construction of the tree storing the nbits bits of words.
+			 * Returns the root.
+			 */
+			node* build(const uint64_t* words, uint64_t nbits) {
+				assert(nbits > 0);
 
-			void free_mem() {
-				if (has_leaves()) {
-					for (uint32_t i = 0; i < nr_children; ++i) delete leaves[i];
+				if (nbits > std::numeric_limits<counter_type>::max()) throw std::length_error(counters_too_narrow);
 
+				if constexpr (sizeof(second_type) < sizeof(uint64_t)) {
+					uint64_t const second = counter_layout::second(nbits, rank_words(words, nbits));
+
+					if (second > std::numeric_limits<second_type>::max()) throw std::length_error(counters_too_narrow);
 				}
-				else {
-					for (uint32_t i = 0; i < nr_children; ++i) children[i]->free_mem();
-					for (uint32_t i = 0; i < nr_children; ++i) delete children[i];
-				}
+
+				vector<leaf_type*> leaves = make_leaves(words, nbits);
+
+				return build_levels(leaves);
 			}
 
 			/*
-			 * return i-th integer in the subtree rooted in this node
+			 * cut the nbits bits of words into leaves packed to bulk_leaf_fill bits
 			 */
-			uint64_t at(uint64_t i) const {
-				assert(i < size());
-
-				uint32_t j = find_child(i);
+			vector<leaf_type*> make_leaves(const uint64_t* words, uint64_t nbits) {
+				if (nbits == 0) return {};
 
-				// size stored in previous counter
-				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
+				// leaves are cut at word boundaries, so that their content is copied
+				// word by word
+				uint64_t const unit = B_LEAF >= 64 ? 64 : 1;
+				uint64_t const units = (nbits + unit - 1) / unit;
+				uint64_t const nr_leaves = nr_groups(units, (leaf_minimum + unit - 1) / unit,
+					(2 * B_LEAF) / unit, bulk_leaf_fill / unit);
 
-				assert(i >= previous_size);
+				vector<leaf_type*> leaves(nr_leaves);
+				uint64_t begin = 0;
 
-				// i-th element is in the j-th children
+				for (uint64_t k = 0; k < nr_leaves; ++k) {
+					// only the last leaf can be truncated (partial last word)
+					uint64_t len = (units / nr_leaves + (k < units % nr_leaves)) * unit;
+					len = std::min(len, nbits - begin);
 
-				// if children are leaves, extract element form j-th leaf
-				if (has_leaves()) {
-					assert(j < leaves.size());
-					assert(j < nr_children);
-					assert(leaves[j] != NULL);
-					assert(i - previous_size < leaves[j]->size());
+					vector<uint64_t> w(words_for(len));
+					copy_bits(w.data(), words, begin, len, nbits);
 
-					return leaves[j]->at(i - previous_size);
+					leaves[k] = mem->new_leaf(std::move(w), len);
+					begin += len;
 				}
 
-				// else: recurse on children
-				return children[j]->at(i - previous_size);
+				assert(begin == nbits);
+
+				return leaves;
 			}
 
 			/*
-			 * returns sum up to i-th integer included
+			 * build the internal levels over a non-empty sequence of leaves.
+			 * Returns the root.
 			 */
-			uint64_t psum(uint64_t i) const {
-				assert(i < size());
+			node* build_levels(vector<leaf_type*>& leaves) {
+				assert(not leaves.empty());
 
-				uint32_t j = find_child(i);
+				vector<node*> level = build_level(leaves);
 
-				// size/psum stored in previous counter
-				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
-				uint64_t previous_psum = (j == 0 ? 0 : subtree_psums[j - 1]);
+				while (level.size() > 1) level = build_level(level);
 
-				assert(i >= previous_size);
+				return level[0];
+			}
 
-				// i-th element is in the j-th children
+			static constexpr const char* counters_too_narrow = "b_spsi: size or sum too large for the counter type";
 
-				// if children are leaves, extract psum from j-th leaf
-				if (has_leaves()) {
-					return previous_psum + leaves[j]->psum(i - previous_size);
+			/*
+			 * with compact counters, throw std::length_error unless n more integers
+			 * summing to sum (modulo 2^64: removals are negative) still fit in the
+			 * counters
+			 */
+			void check_counters(uint64_t n, uint64_t sum) const {
+				if constexpr (sizeof(counter_type) < sizeof(uint64_t)) {
+					if (size() + n > std::numeric_limits<counter_type>::max()) throw std::length_error(counters_too_narrow);
 				}
 
-				// else: recurse on children
-				return previous_psum + children[j]->psum(i - previous_size);
+				if constexpr (sizeof(second_type) < sizeof(uint64_t)) {
+					uint64_t const second = counter_layout::second(size() + n, psum() + sum);
+
+					if (second > std::numeric_limits<second_type>::max()) throw std::length_error(counters_too_narrow);
+				}
 			}
 
 			/*
-			 * returns smallest i such that I_0 + ... + I_i >= x
+			 * a subtree taken out of the tree, or built to go into it, by the
+			 * range operations: a node of the given height (1 if its children
+			 * are leaves), a single leaf (height 0), or nothing
 			 */
-			uint64_t search(uint64_t x) const {
-				assert(x <= psum());
-
-				uint32_t j = find_1(x);
+			struct piece {
+				node* n = NULL;
+				leaf_type* l = NULL;
+				uint32_t height = 0;
 
-				// size/psum stored in previous counter
-				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
-				uint64_t previous_psum = (j == 0 ? 0 : subtree_psums[j - 1]);
-
-				assert(x > previous_psum or (previous_psum == 0 and x == 0));
+				bool empty() const { return n == NULL and l == NULL; }
 
-				// i-th element is in the j-th children
+				uint64_t size() const { return n ? n->size() : l ? l->size() : 0; }
+			};
 
-				// if children are leaves, extract psum from j-th leaf
-				if (has_leaves()) {
-					return previous_size + leaves[j]->search(x - previous_psum);
-				}
+			/*
+			 * the whole tree as a piece. The tree is left without root
+			 */
+			piece take_root() {
+				piece const t{ root, NULL, uint32_t(root->depth()) };
+				root = NULL;
 
-				// else: recurse on children
-				return previous_size + children[j]->search(x - previous_psum);
+				return t;
 			}
 
 			/*
-			 * This function corresponds to select_0 on bitvectors,
-			 * and works only if all integers are 0 or 1 (causes a failed
-			 * assertion otherwise!)
-			 *
-			 * returns smallest i such that the number of zeros before position
-			 * i (included) is == x. x must be > 0
+			 * make the piece t the tree, under a node if it is a leaf, and without
+			 * roots of a single internal child
 			 */
-			uint64_t search_0(uint64_t x) const {
-				assert(x <= size() - psum());
-				assert(x > 0);
+			void set_root(piece t) {
+				if (t.empty()) root = mem->new_node();
+				else if (t.l) root = mem->new_node(&t.l, &t.l + 1);
+				else root = t.n;
 
-				uint32_t j = find_0(x);
+				while (not root->has_leaves() and root->number_of_children() == 1) collapse_root();
+			}
 
-				// size/psum stored in previous counter
+			void free_piece(piece const t) {
+				if (t.n) {
+					t.n->free_mem();
+					mem->free(t.n);
+				}
+				else if (t.l) {
+					mem->free(t.l);
+				}
+			}
+
+			/*
+			 * the nbits bits of words as a piece, built bottom-up
+			 */
+			piece build_piece(const uint64_t* words, uint64_t nbits) {
+				vector<leaf_type*> leaves = make_leaves(words, nbits);
+
+				if (leaves.empty()) return {};
+				if (leaves.size() == 1) return { NULL, leaves[0], 0 };
+
+				node* const n = build_levels(leaves);
+
+				return { n, NULL, uint32_t(n->depth()) };
+			}
+
+			/*
+			 * cut the piece t before its integer c, 0 <= c <= t.size(), into the
+			 * pieces holding [0, c) and [c, t.size()). t is taken apart: only the
+			 * nodes on the path to c are visited, the subtrees on either side of
+			 * it are moved to the halves whole
+			 */
+			std::pair<piece, piece> split_piece(piece t, uint64_t c) {
+				if (t.size() == 0) {
+					free_piece(t);
+					return {};
+				}
+
+				if (c == 0) return { {}, t };
+				if (c == t.size()) return { t, {} };
+
+				if (t.l) {
+					auto const [l, r] = cut_leaf(t.l, c);
+					return { { NULL, l, 0 }, { NULL, r, 0 } };
+				}
+
+				node* const v = t.n;
+
+				// the pending insertions of v go to the halves they fall in
+				message_buffer<buffer_size> left_messages;
+				message_buffer<buffer_size> right_messages;
+
+				if constexpr (buffered) {
+					// a single empty leaf under pending insertions: only those hold integers
+					if (v->children_size() == 0) {
+						auto m = v->take_messages();
+						free_piece(t);
+
+						return split_piece(add_messages({}, std::move(m)), c);
+					}
+
+					left_messages = v->take_messages();
+
+					uint32_t const k = left_messages.up_to(c - 1);
+
+					right_messages = left_messages.split_off(k, c);
+					c -= k;
+				}
+
+				// child j starts at or contains integer c of the children
+				auto const [j, offset] = v->locate(c);
+				bool const cut = offset > 0;
+
+				piece inner_left;
+				piece inner_right;
+
+				if (cut) std::tie(inner_left, inner_right) = split_piece(v->child_piece(j, t.height), offset);
+
+				node* const right_node = v->cut_children(j, cut);
+
+				piece left{ v, NULL, t.height };
+
+				if (j == 0) {
+					mem->free(v);
+					left = {};
+				}
+
+				piece right = right_node ? piece{ right_node, NULL, t.height } : piece{};
+
+				left = join(left, inner_left);
+				right = join(inner_right, right);
+
+				if constexpr (buffered) {
+					left = add_messages(left, std::move(left_messages));
+					right = add_messages(right, std::move(right_messages));
+				}
+
+				return { left, right };
+			}
+
+			/*
+			 * the piece holding the integers of a, then those of b. The lower
+			 * one goes under the spine of the higher one, at its height, and
+			 * only the nodes of that spine are split, recounted or mended (see
+			 * node::append_tree)
+			 */
+			piece join(piece a, piece b) {
+				if (a.empty()) return b;
+				if (b.empty()) return a;
+
+				if (a.height > b.height) {
+					node* const r = a.n->append_tree(b, a.height);
+					return { r, NULL, a.height + (r != a.n) };
+				}
+
+				if (a.height < b.height) {
+					node* const r = b.n->prepend_tree(a, b.height);
+					return { r, NULL, b.height + (r != b.n) };
+				}
+
+				node* r;
+
+				if (a.height == 0) {
+					if (a.l->size() + b.l->size() <= 2 * B_LEAF) return { NULL, concat_leaves(a.l, b.l), 0 };
+
+					leaf_type* const halves[] = { a.l, b.l };
+					r = mem->new_node(halves, halves + 2);
+				}
+				else {
+					if (a.n->number_of_children() + b.n->number_of_children() <= 2 * B + 2) {
+						a.n->merge_node(b.n);
+						return a;
+					}
+
+					node* const halves[] = { a.n, b.n };
+					r = mem->new_node(halves, halves + 2);
+				}
+
+				// both too many for one, one may be too few on its own
+				r->mend(0);
+				r->mend(1);
+
+				return { r, NULL, a.height + 1 };
+			}
+
+			/*
+			 * pending insertions m, by position in the content of piece t, join t.
+			 * A leaf (or nothing) cannot hold them, and is built again with them
+			 */
+			piece add_messages(piece t, message_buffer<buffer_size>&& m) {
+				if (m.size() == 0) return t;
+
+				if (t.n) {
+					t.n->add_messages(std::move(m));
+					return t;
+				}
+
+				vector<uint64_t> w;
+				uint64_t nbits = 0;
+				uint64_t from = 0;
+
+				for (uint32_t k = 0; k < m.size(); ++k) {
+					uint64_t const to = m.children_pos(k);
+					uint64_t const bit = m.val(k);
+
+					if (t.l) append_leaf(w, nbits, t.l, from, to);
+					append_bits(w, nbits, &bit, 0, 1, 1);
+					from = to;
+				}
+
+				if (t.l) {
+					append_leaf(w, nbits, t.l, from, t.l->size());
+					mem->free(t.l);
+				}
+
+				return build_piece(w.data(), nbits);
+			}
+
+			/*
+			 * cut leaf l before its integer p, 0 < p < l->size(), into two new
+			 * leaves. l is freed
+			 */
+			std::pair<leaf_type*, leaf_type*> cut_leaf(leaf_type* l, uint64_t p) {
+				vector<uint64_t> left;
+				vector<uint64_t> right;
+				uint64_t left_bits = 0;
+				uint64_t right_bits = 0;
+
+				append_leaf(left, left_bits, l, 0, p);
+				append_leaf(right, right_bits, l, p, l->size());
+
+				mem->free(l);
+
+				return { mem->new_leaf(std::move(left), left_bits), mem->new_leaf(std::move(right), right_bits) };
+			}
+
+			/*
+			 * the leaf holding the integers of a, then those of b. a and b are
+			 * freed
+			 */
+			leaf_type* concat_leaves(leaf_type* a, leaf_type* b) {
+				vector<uint64_t> w;
+				uint64_t nbits = 0;
+
+				append_leaf(w, nbits, a, 0, a->size());
+				append_leaf(w, nbits, b, 0, b->size());
+
+				mem->free(a);
+				mem->free(b);
+
+				return mem->new_leaf(std::move(w), nbits);
+			}
+
+			/*
+			 * append the bits [from, to) of leaf l after the nbits bits of w
+			 */
+			static void append_leaf(vector<uint64_t>& w, uint64_t& nbits, const leaf_type* l,
+				uint64_t from, uint64_t to) {
+				vector<uint64_t> lw(words_for(l->size()));
+				for (uint64_t k = 0; k < lw.size(); ++k) lw[k] = l->word(k);
+
+				append_bits(w, nbits, lw.data(), from, to, l->size());
+			}
+
+			pools* mem = NULL;  // allocates the nodes and leaves of this tree
+			node* root = NULL;  // tree root
+	};
+
+	/*
+	 * b_spsi with the default child search and allocation
+	 */
+	template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size = 0>
+	using b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size>;
+
+	/*
+	 * b_spsi with its nodes and leaves in slabs (node-pool.hpp)
+	 */
+	template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size = 0>
+	using pooled_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, simd_child_search<>, pooled_allocation<>>;
+
+	/*
+	 * b_spsi whose child search goes through an S-tree index of the node
+	 * counters (blocked_child_search), for wide nodes
+	 */
+	template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size = 0>
+	using blocked_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, blocked_child_search<>>;
+
+	/*
+	 * b_spsi with 32-bit node counters: half the counter bytes per node, for
+	 * trees of less than 2^32 bits
+	 */
+	template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size = 0>
+	using compact_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, simd_child_search<>, heap_allocation, uint32_t>;
+
+	/*
+	 * b_spsi whose nodes store the zeros of their subtrees instead of the
+	 * ones: select0 searches a stored counter array, rank and select derive
+	 * the ones from the sizes (counter-layout.hpp)
+	 */
+	template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size = 0>
+	using zeros_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, simd_child_search<>, heap_allocation, uint64_t,
+		zeros_counters<>>;
+
+	/*
+	 * b_spsi with 64-bit sizes and 32-bit ones in its nodes: a quarter fewer
+	 * counter bytes per node, for trees of less than 2^32 bits set
+	 */
+	template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size = 0>
+	using compact_ones_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, simd_child_search<>, heap_allocation,
+		uint64_t, ones_counters<uint32_t>>;
+
+	/*
+	 * b_spsi kept fuller (fill-policy.hpp): bulk builds pack leaves and nodes
+	 * to 90%, a full leaf is evened out with a sibling before it splits, and
+	 * remove lets leaves and nodes drop to a quarter before merging them
+	 */
+	template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size = 0>
+	using dense_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, simd_child_search<>, heap_allocation,
+		uint64_t, ones_counters<>, fill_policy<90, 25, true>>;
+
+
+	template <class leaf_type,  // underlying representation of the integers
+		uint32_t B_LEAF,  // number of integers m allowed for a
+		// leaf is B_LEAF <= m <= 2*B_LEAF (except at the beginning)
+		uint32_t B,  // Order of the tree: number of elements n in each
+					// internal node
+		// is always B <= n <= 2B+1  (except at the beginning)
+		// Alan: Actually, B + 1 <= n <= 2B+2  (except at the beginning)
+		uint64_t buffer_size,
+		class child_search,
+		class allocation,
+		class counter_type,
+		class counter_layout,
+		class fill
+	>
+		class basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, child_search, allocation, counter_type,
+			counter_layout, fill>::node {
+		public:
+			/*
+			 * copy constructor
+			 */
+			node(pools* m, const node& n) : mem(m) {
+				subtree_sizes = n.subtree_sizes;
+				subtree_second = n.subtree_second;
+				messages = n.messages;
+
+				if (n.has_leaves_) {
+					leaves = leaf_array(n.nr_children, NULL);
+
+					for (uint64_t i = 0; i < n.nr_children; ++i) {
+						leaves[i] = mem->new_leaf(*n.leaves[i]);
+					}
+
+				}
+				else {
+					children = node_array(n.nr_children, NULL);
+
+					for (uint64_t i = 0; i < n.nr_children; ++i) {
+						children[i] = mem->new_node(*n.children[i]);
+					}
+				}
+
+				nr_children = n.nr_children;  // number of subtrees
+
+				has_leaves_ = n.has_leaves_;  // if true, leaves array is nonempty and
+											  // children is empty
+
+				sync_index();
+			}
+
+			/*
+			 * create new root node. This node has only 1 (empty) child, which is a
+			 * leaf.
+			 */
+			explicit node(pools* m) : subtree_sizes{}, subtree_second{}, mem(m) {
+				nr_children = 1;
+				has_leaves_ = true;
+
+				leaves = leaf_array(1);
+				leaves[0] = mem->new_leaf();
+
+				sync_index();
+			}
+
+			/*
+			 * create new node given some children [first, last) (other internal
+			 * nodes)
+			 */
+			node(pools* m, node* const* first, node* const* last) : mem(m) {
+				uint64_t si = 0;
+				uint64_t ps = 0;
+
+				uint32_t const n = last - first;
+
+				assert(n <= 2 * B + 2);
+
+				for (uint32_t i = 0; i < n; ++i) {
+					si += first[i]->size();
+					ps += first[i]->psum();
+
+					subtree_sizes[i] = si;
+					subtree_second[i] = second_counter(si, ps);
+				}
+
+				nr_children = n;
+				has_leaves_ = false;
+
+				children = node_array(first, last);
+
+				sync_index();
+			}
+
+			/*
+			 * create new node given some children [first, last) (leaves)
+			 */
+			node(pools* m, leaf_type* const* first, leaf_type* const* last) : mem(m) {
+				uint32_t const n = last - first;
+
+				assert(n <= 2 * B + 2);
+
+				uint64_t si = 0;
+				uint64_t ps = 0;
+
+				for (uint32_t i = 0; i < n; ++i) {
+					si += first[i]->size();
+					ps += first[i]->psum();
+
+					subtree_sizes[i] = si;
+					subtree_second[i] = second_counter(si, ps);
+				}
+
+				nr_children = n;
+				has_leaves_ = true;
+
+				leaves = leaf_array(first, last);
+
+				sync_index();
+			}
+
+			/*
+			 * return bit size of all structures rooted in this node
+			 */
+			uint64_t bit_size() const {
+				uint64_t bs = 8 * sizeof(node);
+
+				bs += subtree_sizes.size() * sizeof(counter_type) * 8;
+
+				bs += subtree_second.size() * sizeof(second_type) * 8;
+
+				bs += messages.bit_size();
+
+				if (has_leaves()) {
+					for (uint64_t i = 0; i < nr_children; ++i) {
+						assert(leaves[i] != NULL);
+						bs += leaves[i]->bit_size();
+					}
+
+				}
+				else {
+					for (uint64_t i = 0; i < nr_children; ++i) {
+						assert(children[i] != NULL);
+						bs += children[i]->bit_size();
+					}
+				}
+
+				return bs;
+			}
+
+			uint64_t depth() const
+			{
+				if (has_leaves())
+				{
+					return 1;
+				}
+
+				return 1 + children[0]->depth();
+			}
+
+			bool has_leaves() const { return has_leaves_; }
+
+			void free_mem() {
+				if (has_leaves()) {
+					for (uint32_t i = 0; i < nr_children; ++i) mem->free(leaves[i]);
+
+				}
+				else {
+					for (uint32_t i = 0; i < nr_children; ++i) children[i]->free_mem();
+					for (uint32_t i = 0; i < nr_children; ++i) mem->free(children[i]);
+				}
+			}
+
+			/*
+			 * return i-th integer in the subtree rooted in this node
+			 */
+			uint64_t at(uint64_t i) const {
+				assert(i < size());
+
+				if constexpr (buffered) {
+					uint32_t const k = messages.up_to(i);
+
+					if (k > 0 and messages.pos(k - 1) == i) return messages.val(k - 1);
+
+					i -= k;
+				}
+
+				uint32_t j = find_child(i);
+
+				// size stored in previous counter
 				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
-				uint64_t previous_psum = (j == 0 ? 0 : subtree_psums[j - 1]);
-				uint64_t previous_zeros = previous_size - previous_psum;
 
-				assert(x > previous_zeros);
+				assert(i >= previous_size);
 
 				// i-th element is in the j-th children
 
+				// if children are leaves, extract element form j-th leaf
 				if (has_leaves()) {
-					return previous_size + leaves[j]->search_0(x - previous_zeros);
+					assert(j < leaves.size());
+					assert(j < nr_children);
+					assert(leaves[j] != NULL);
+					assert(i - previous_size < leaves[j]->size());
+
+					return leaves[j]->at(i - previous_size);
 				}
 
 				// else: recurse on children
-				return previous_size + children[j]->search_0(x - previous_zeros);
+				return children[j]->at(i - previous_size);
+			}
+
+			/*
+			 * returns sum up to i-th integer included
+			 */
+			uint64_t psum(uint64_t i) const {
+				assert(i < size());
+
+				if constexpr (buffered) {
+					if (messages.size() > 0) {
+						uint32_t const k = messages.up_to(i);
+
+						// integers of the children up to i included
+						uint64_t const n = i + 1 - k;
+
+						return messages.sum(k) + (n == 0 ? 0 : children_psum(n - 1));
+					}
+				}
+
+				return children_psum(i);
+			}
+
+			/*
+			 * returns smallest i such that I_0 + ... + I_i >= x
+			 */
+			uint64_t search(uint64_t x) const {
+				assert(x <= psum());
+
+				if constexpr (buffered) {
+					if (messages.size() > 0) return search_messages<search_op::ones>(x);
+				}
+
+				return children_search(x);
+			}
+
+			/*
+			 * This function corresponds to select_0 on bitvectors,
+			 * and works only if all integers are 0 or 1 (causes a failed
+			 * assertion otherwise!)
+			 *
+			 * returns smallest i such that the number of zeros before position
+			 * i (included) is == x. x must be > 0
+			 */
+			uint64_t search_0(uint64_t x) const {
+				assert(x <= size() - psum());
+				assert(x > 0);
+
+				if constexpr (buffered) {
+					if (messages.size() > 0) return search_messages<search_op::zeros>(x);
+				}
+
+				return children_search_0(x);
 			}
 
 			/*
@@ -581,11 +1367,114 @@ namespace dyn {
 			uint64_t search_r(uint64_t x) const {
 				assert(x <= psum() + size());
 
+				if constexpr (buffered) {
+					if (messages.size() > 0) return search_messages<search_op::ones_and_size>(x);
+				}
+
+				return children_search_r(x);
+			}
+
+			bool contains(uint64_t x) const {
+				if constexpr (buffered) {
+					if (messages.size() > 0) return x == 0 or psum(search(x)) == x;
+				}
+
+				return children_contains(x);
+			}
+
+			bool contains_r(uint64_t x) const {
+				if constexpr (buffered) {
+					if (messages.size() > 0) {
+						if (x == 0) return true;
+
+						uint64_t const i = search_r(x);
+
+						return psum(i) + i + 1 == x;
+					}
+				}
+
+				return children_contains_r(x);
+			}
+
+			/*
+			 * the queries below are on the content of the children: the
+			 * pending insertions of this node are not in it
+			 */
+			uint64_t children_psum(uint64_t i) const {
+				assert(i < children_size());
+
+				uint32_t j = find_child(i);
+
+				// size/psum stored in previous counter
+				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
+				uint64_t previous_psum = (j == 0 ? 0 : subtree_psum(j - 1));
+
+				assert(i >= previous_size);
+
+				// i-th element is in the j-th children
+
+				// if children are leaves, extract psum from j-th leaf
+				if (has_leaves()) {
+					return previous_psum + leaves[j]->psum(i - previous_size);
+				}
+
+				// else: recurse on children
+				return previous_psum + children[j]->psum(i - previous_size);
+			}
+
+			uint64_t children_search(uint64_t x) const {
+				assert(x <= children_psum());
+
+				uint32_t j = find_1(x);
+
+				// size/psum stored in previous counter
+				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
+				uint64_t previous_psum = (j == 0 ? 0 : subtree_psum(j - 1));
+
+				assert(x > previous_psum or (previous_psum == 0 and x == 0));
+
+				// i-th element is in the j-th children
+
+				// if children are leaves, extract psum from j-th leaf
+				if (has_leaves()) {
+					return previous_size + leaves[j]->search(x - previous_psum);
+				}
+
+				// else: recurse on children
+				return previous_size + children[j]->search(x - previous_psum);
+			}
+
+			uint64_t children_search_0(uint64_t x) const {
+				assert(x <= children_size() - children_psum());
+				assert(x > 0);
+
+				uint32_t j = find_0(x);
+
+				// size/psum stored in previous counter
+				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
+				uint64_t previous_psum = (j == 0 ? 0 : subtree_psum(j - 1));
+				uint64_t previous_zeros = previous_size - previous_psum;
+
+				assert(x > previous_zeros);
+
+				// i-th element is in the j-th children
+
+				if (has_leaves()) {
+					return previous_size + leaves[j]->search_0(x - previous_zeros);
+				}
+
+				// else: recurse on children
+				return previous_size + children[j]->search_0(x - previous_zeros);
+			}
+
+			uint64_t children_search_r(uint64_t x) const {
+				assert(x <= children_psum() + children_size());
+
 				uint32_t j = find_r(x);
 
 				// size/psum stored in previous counter
 				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
-				uint64_t previous_psum = (j == 0 ? 0 : subtree_psums[j - 1]);
+				uint64_t previous_psum = (j == 0 ? 0 : subtree_psum(j - 1));
 
 				assert(x > previous_psum + previous_size or
 					(x == 0 and (previous_psum + previous_size == 0)));
@@ -603,17 +1492,17 @@ namespace dyn {
 					children[j]->search_r(x - (previous_psum + previous_size));
 			}
 
-			bool contains(uint64_t x) const {
+			bool children_contains(uint64_t x) const {
 				if (x == 0) return true;
 
-				assert(x <= psum());
+				assert(x <= children_psum());
 
 				uint32_t j = find_1(x);
 
-				if (subtree_psums[j] == x) return true;
+				if (subtree_psum(j) == x) return true;
 
 				// psum stored in previous counter
-				uint64_t previous_psum = (j == 0 ? 0 : subtree_psums[j - 1]);
+				uint64_t previous_psum = (j == 0 ? 0 : subtree_psum(j - 1));
 
 				assert(x > previous_psum or (x == 0 and previous_psum == 0));
 
@@ -628,18 +1517,18 @@ namespace dyn {
 				return children[j]->contains(x - previous_psum);
 			}
 
-			bool contains_r(uint64_t x) const {
+			bool children_contains_r(uint64_t x) const {
 				if (x == 0) return true;
 
-				assert(x <= psum() + size());
+				assert(x <= children_psum() + children_size());
 
 				uint32_t j = find_r(x);
 
-				if (subtree_psums[j] + subtree_sizes[j] == x) return true;
+				if (subtree_psum(j) + subtree_sizes[j] == x) return true;
 
 				// size/psum stored in previous counter
 				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
-				uint64_t previous_psum = (j == 0 ? 0 : subtree_psums[j - 1]);
+				uint64_t previous_psum = (j == 0 ? 0 : subtree_psum(j - 1));
 
 				assert(x > previous_psum + previous_size or
 					(x + previous_psum + previous_size == 0));
@@ -655,12 +1544,79 @@ namespace dyn {
 				return children[j]->contains_r(x - (previous_psum + previous_size));
 			}
 
+			/*
+			 * answer the queries [begin, end), sorted by key, in a single visit
+			 * of this subtree. Keys are relative to this subtree and are consumed;
+			 * the answer to query [key, k] plus base is written in out[k].
+			 */
+			template <batch_op op>
+			void batch(query* begin, query* const end, uint64_t base, uint64_t* out) const {
+				// the queries are answered one by one past pending insertions
+				if constexpr (buffered) {
+					if (messages.size() > 0) {
+						for (query* q = begin; q != end; ++q) out[q->second] = base + query_of<op>(q->first);
+						return;
+					}
+				}
+
+				uint64_t previous_size = 0;
+				uint64_t previous_psum = 0;
+
+				for (uint32_t j = 0; j < nr_children and begin != end; ++j) {
+					// queries falling in the j-th child. Keys are sorted, so they are
+					// a prefix of the remaining ones
+					query* last = end;
+
+					if (j < nr_children - 1) {
+						last = begin;
+						while (last != end and in_child<op>(j, last->first)) ++last;
+					}
+
+					if (last != begin) {
+						uint64_t shift = previous_size;
+						uint64_t child_base = base + previous_size;
+
+						if (op == batch_op::at) child_base = base;
+						if (op == batch_op::psum) child_base = base + previous_psum;
+						if (op == batch_op::search) shift = previous_psum;
+						if (op == batch_op::search_0) shift = previous_size - previous_psum;
+
+						for (query* q = begin; q != last; ++q) q->first -= shift;
+
+						if (has_leaves()) {
+							for (query* q = begin; q != last; ++q)
+								out[q->second] = child_base + leaf_query<op>(leaves[j], q->first);
+						}
+						else {
+							children[j]->template batch<op>(begin, last, child_base, out);
+						}
+					}
+
+					previous_size = subtree_sizes[j];
+					previous_psum = subtree_psum(j);
+					begin = last;
+				}
+
+				assert(begin == end);
+			}
+
 			/*
 			 * increment or decrement i-th integer by delta
 			 */
 			void increment(uint64_t i, uint64_t delta, bool subtract = false) {
 				assert(i < size());
 
+				if constexpr (buffered) {
+					uint32_t const k = messages.up_to(i);
+
+					if (k > 0 and messages.pos(k - 1) == i) {
+						messages.add(k - 1, delta, subtract);
+						return;
+					}
+
+					i -= k;
+				}
+
 				uint32_t j = find_child(i);
 
 				// size stored in previous counter
@@ -687,426 +1643,127 @@ namespace dyn {
 				}
 
 				// after the increment, modify psum counters
+				uint64_t const d = second_counter(0, delta);
+
 				for (uint32_t k = j; k < nr_children; ++k) {
 					// check for under/overflows
-					assert(subtract or (subtree_psums[k] <= (~uint64_t(0)) - delta));
-					assert((not subtract) or (delta <= subtree_psums[k]));
+					assert(subtract or (subtree_psum(k) <= (~uint64_t(0)) - delta));
+					assert((not subtract) or (delta <= subtree_psum(k)));
 
-					subtree_psums[k] =
-						(subtract ? subtree_psums[k] - delta : subtree_psums[k] + delta);
+					subtree_second[k] =
+						(subtract ? subtree_second[k] - d : subtree_second[k] + d);
 				}
-			}
 
-			bool is_root() const { return parent == NULL; }
+				sync_index();
+			}
 
 			bool is_full() const {
 				assert(nr_children <= 2 * B + 2);
 				return nr_children == (2 * B + 2);
-			}
-
-			/*
-			 * true iff this node can lose
-			 * a child and remain above the min.
-			 * number of children, B + 1
-			 * OR this node is the root
-			 */
-			bool can_lose() const { return (nr_children >= (B + 2) || (is_root())); }
-
-			bool leaf_can_lose(leaf_type* leaf) const {
-				return (leaf->size() >= (B_LEAF + 1));
-			}
-
-			void increment_rank() { rank_++; }
-
-			node* get_parent() { return parent; }
-			const node* get_parent() const { return parent; }
-
-			/*
-			 * insert at position i.
-			 * If this node is the root, return the new root.
-			 *
-			 * new root could be different than current root if current root
-			 * is full and is splitted
-			 *
-			 */
-			node* insert(uint64_t i, uint64_t val) {
-				assert(i <= size());
-				assert(is_root() || not parent->is_full());
-
-				node* new_root = NULL;
-				node* right = NULL;
-
-				if (is_full()) {
-					right = split();
-
-					assert(not is_full());
-					assert(not right->is_full());
-
-					// insert recursively
-					if (i < size()) {
-						insert_without_split(i, val);
-
-					}
-					else {
-						assert(right != NULL);
-						right->insert_without_split(i - size(), val);
-					}
-
-					// if this is the root, create new root
-					if (is_root()) {
-						new_root = new node(vector<node*>{this, right});
-						assert(not new_root->is_full());
-
-						this->overwrite_parent(new_root);
-						right->overwrite_parent(new_root);
-
-					}
-					else {
-						// else: pass the info to parent
-						assert(rank() < parent->number_of_children());
-						parent->new_children(rank(), this, right);
-					}
-
-				}
-				else {
-					insert_without_split(i, val);
-				}
-
-				// if not root, do not return anything.
-				return new_root;
-			}
-
-			node* insert(uint64_t i, uint64_t val, uint8_t width, uint8_t n) {
-				assert(i <= size());
-				assert(is_root() || not parent->is_full());
-
-				node* new_root = NULL;
-				node* right = NULL;
-
-				if (is_full()) {
-					right = split();
-
-					assert(not is_full());
-					assert(not right->is_full());
-
-					// insert recursively
-					if (i < size()) {
-						insert_without_split(i, val);
-
-					}
-					else {
-						assert(right != NULL);
-						right->insert_without_split(i - size(), val, width, n);
-					}
-
-					// if this is the root, create new root
-					if (is_root()) {
-						new_root = new node(vector<node*>{this, right});
-						assert(not new_root->is_full());
-
-						this->overwrite_parent(new_root);
-						right->overwrite_parent(new_root);
-
-					}
-					else {
-						// else: pass the info to parent
-						assert(rank() < parent->number_of_children());
-						parent->new_children(rank(), this, right);
-					}
-
-				}
-				else {
-					insert_without_split(i, val, width, n);
-				}
-
-				// if not root, do not return anything.
-				return new_root;
-			}
-
-			/*
-			 * remove the integer at position i.
-			 * If the root changes, return the new root.
-			 *
-			 * new root could be different than current root if current root
-			 * has only one non-leaf child.
-			 *
-			 */
-			node* remove(uint64_t i) {
-				assert(i < size());
-				assert(is_root() || parent->can_lose());
-
-				node* x = this;
-
-				if (not x->can_lose()) {
-					// Need to ensure that *x
-					// can lose a child and still have
-					// the min # of children
-
-					if (x != x->parent->children[x->rank()]) {
-						uint32_t real_r = 0;
-						while (real_r < x->parent->nr_children) {
-							if (x->parent->children[real_r] == x) {
-								cerr << real_r << ' ' << x->rank() << endl;
-								cerr << x->has_leaves() << endl;
-								break;
-							}
-							++real_r;
-						}
-					}
-					assert(x == x->parent->children[x->rank()]);
-					node* y;         // an adjacent sibling of x
-					bool y_is_prev;  // is y the previous sibling?
-					if (rank() > 0) {
-						y = x->parent->children[rank() - 1];
-						y_is_prev = true;
-					}
-					else {
-						y = x->parent->children[rank() + 1];
-						y_is_prev = false;
-					}
-
-					if (y->can_lose()) {
-						if (not x->has_leaves()) {
-							// steal a child of y,
-							// and give it to x
-							node* z;  // the child
-							if (y_is_prev) {
-								// y is the previous sibling of x
-								z = y->children.back();
-
-								assert(z->rank() == (y->nr_children - 1));
-								// update z
-								z->overwrite_parent(x);
-								z->overwrite_rank(0);
-
-								// update y
-								--(y->nr_children);
-								(y->children).pop_back();
-
-								// update x
-								++(x->nr_children);
-								(x->children).insert((x->children).begin(), z);
-
-								i = i + z->size();  // update the removal position to reflect x's
-													// new child z
-
-								uint64_t si = 0;
-								uint64_t ps = 0;
-								for (size_t j = 0; j < x->nr_children; ++j) {
-									si += (x->children)[j]->size();
-									ps += (x->children)[j]->psum();
-
-									(x->subtree_sizes)[j] = si;
-									(x->subtree_psums)[j] = ps;
-								}
-
-								// update ranks of x's children
-								uint32_t r = 0;
-								for (auto cc : x->children) {
-									cc->overwrite_rank(r);
-									++r;
-								}
-
-								// update x->parent subtree info
-
-								x->parent->subtree_sizes[x->rank() - 1] -= z->size();
-								x->parent->subtree_psums[x->rank() - 1] -= z->psum();
-
-							}
-							else {
-								// y is the next sibling of x
-								z = y->children.front();
+			}
 
-								assert(z->rank() == 0);
-								// update z
-								z->overwrite_parent(x);
-								z->overwrite_rank(x->nr_children);
+			/*
+			 * true iff this node can lose
+			 * a child and remain above the min.
+			 * number of children, B + 1
+			 * (the root is never asked)
+			 */
+			bool can_lose() const { return nr_children > node_minimum; }
 
-								// update y
-								--(y->nr_children);
-								(y->children).erase(y->children.begin());
-								uint64_t si = 0;
-								uint64_t ps = 0;
-								for (size_t j = 0; j < y->nr_children; ++j) {
-									si += (y->children)[j]->size();
-									ps += (y->children)[j]->psum();
-
-									(y->subtree_sizes)[j] = si;
-									(y->subtree_psums)[j] = ps;
-								}
-								// update ranks of y's children
-								uint32_t r = 0;
-								for (auto cc : y->children) {
-									cc->overwrite_rank(r);
-									++r;
-								}
+			bool leaf_can_lose(leaf_type* leaf) const {
+				return leaf->size() > leaf_minimum;
+			}
 
-								// update x
-								++(x->nr_children);
-								(x->children).insert((x->children).end(), z);
-								x->subtree_sizes[x->nr_children - 1] =
-									x->subtree_sizes[x->nr_children - 2] + z->size();
-								x->subtree_psums[x->nr_children - 1] =
-									x->subtree_psums[x->nr_children - 2] + z->psum();
 
-								// update x->parent subtree info
-								x->parent->subtree_sizes[x->rank()] += z->size();
-								x->parent->subtree_psums[x->rank()] += z->psum();
-							}
-						}
-						else {  // x has leaves
-					   // steal a child of y,
-					   // and give it to x
-							leaf_type* z;  // the child
-							if (y_is_prev) {
-								// y is the previous sibling of x
-								z = y->leaves.back();
+			/*
+			 * insert at position i in the tree rooted in this node.
+			 * Return the new root, or NULL if the root did not change.
+			 *
+			 * The insertion is top-down: a full root is split here, and every
+			 * node splits a full child before descending into it, so that the
+			 * node receiving a new child is never full.
+			 */
+			node* insert(uint64_t i, uint64_t val) {
+				assert(i <= size());
 
-								// update y
-								--(y->nr_children);
-								(y->leaves).pop_back();
+				if (not is_full()) {
+					insert_without_split(i, val);
+					return NULL;
+				}
 
-								// update x
-								++(x->nr_children);
-								(x->leaves).insert((x->leaves).begin(), z);
+				node* new_root = split_root();
+				new_root->insert_without_split(i, val);
 
-								i = i + z->size();  // update the removal position to reflect x's
-													// new child z
+				return new_root;
+			}
 
-								uint64_t si = 0;
-								uint64_t ps = 0;
-								for (size_t j = 0; j < x->nr_children; ++j) {
-									si += (x->leaves)[j]->size();
-									ps += (x->leaves)[j]->psum();
+			node* insert(uint64_t i, uint64_t val, uint8_t width, uint8_t n) {
+				assert(i <= size());
 
-									(x->subtree_sizes)[j] = si;
-									(x->subtree_psums)[j] = ps;
-								}
+				if (not is_full()) {
+					insert_without_split(i, val, width, n);
+					return NULL;
+				}
 
-								// update x->parent subtree info
-								x->parent->subtree_sizes[x->rank() - 1] -= z->size();
-								x->parent->subtree_psums[x->rank() - 1] -= z->psum();
+				node* new_root = split_root();
+				new_root->insert_without_split(i, val, width, n);
 
-							}
-							else {
-								// y is the next sibling of x
-								z = y->leaves.front();
+				return new_root;
+			}
 
-								// update y
-								--(y->nr_children);
-								(y->leaves).erase(y->leaves.begin());
-								uint64_t si = 0;
-								uint64_t ps = 0;
-								for (size_t j = 0; j < y->nr_children; ++j) {
-									si += (y->leaves)[j]->size();
-									ps += (y->leaves)[j]->psum();
-
-									(y->subtree_sizes)[j] = si;
-									(y->subtree_psums)[j] = ps;
-								}
+			/*
+			 * as insert, straight down to the leaf: no node on the way has
+			 * pending insertions (see basic_b_spsi::flush). The integers before
+			 * position i are added to *before, if given
+			 */
+			node* insert_through(uint64_t i, uint64_t val, uint64_t* before = NULL) {
+				assert(i <= size());
 
-								// update x
-								++(x->nr_children);
-								(x->leaves).insert((x->leaves).end(), z);
-								x->subtree_sizes[x->nr_children - 1] =
-									x->subtree_sizes[x->nr_children - 2] + z->size();
-								x->subtree_psums[x->nr_children - 1] =
-									x->subtree_psums[x->nr_children - 2] + z->psum();
-
-								x->parent->subtree_sizes[x->rank()] += z->size();
-								x->parent->subtree_psums[x->rank()] += z->psum();
-							}
-						}
-					}
-					else {
-						// y cannot lose a child
-						// means: neither x nor y can lose a child
-						// so: merge x,y into single node of size
-						// 2B + 2
-						assert(x->nr_children == B + 1);
-						assert(y->nr_children == B + 1);
-						node* prev;
-						node* next;
-						if (y_is_prev) {
-							prev = y;
-							next = x;
-						}
-						else {
-							prev = x;
-							next = y;
-						}
-						node* xy;
-						if (not x->has_leaves()) {
-							vector<node*> cc(prev->children.begin(), prev->children.end());
-							cc.insert(cc.end(), next->children.begin(), next->children.end());
+				if (not is_full()) {
+					insert_below<true>(i, val, before);
+					return NULL;
+				}
 
-							assert(cc.size() == 2 * B + 2);
-							xy = new node(std::move(cc), prev->parent, prev->rank());
-						}
-						else {
-							assert(prev->nr_children == prev->leaves.size());
-							assert(next->nr_children == next->leaves.size());
-							vector<leaf_type*> cc(prev->leaves.begin(), prev->leaves.end());
-							cc.insert(cc.end(), next->leaves.begin(), next->leaves.end());
-
-							if (cc.size() > 2 * B + 2) {
-								cerr << endl;
-								cerr << prev->nr_children << ' ' << prev->leaves.size() << endl;
-								cerr << next->nr_children << ' ' << next->leaves.size() << endl;
-								cerr << cc.size() << ' ' << 2 * B + 2 << endl;
-							}
+				node* new_root = split_root();
+				new_root->template insert_below<true>(i, val, before);
 
-							assert(cc.size() == 2 * B + 2);
-							xy = new node(std::move(cc), prev->parent, prev->rank());
-						}
+				return new_root;
+			}
 
-						// update xy->parent
-						if (xy->parent != NULL) {
-							--(xy->parent->nr_children);
-							xy->parent->children.erase(xy->parent->children.begin() +
-								xy->rank() + 1);
-							xy->parent->children[xy->rank()] = x;  // x will be overwritten by
-																   // xy
-							for (size_t j = xy->rank(); j < xy->parent->nr_children; ++j) {
-								xy->parent->subtree_sizes[j] = xy->parent->subtree_sizes[j + 1];
-								xy->parent->subtree_psums[j] = xy->parent->subtree_psums[j + 1];
-								xy->parent->children[j]->overwrite_rank(j);
-							}
-						}
+			/*
+			 * split this (full) root into two halves, under a new root
+			 */
+			node* split_root() {
+				node* const halves[] = { this, split() };
+				node* new_root = mem->new_node(halves, halves + 2);
+				assert(not new_root->is_full());
 
-						// update removal position to be wrt yx (if y is prev)
-						if (y == prev) {
-							i = i + y->size();
-						}
+				return new_root;
+			}
 
-						// overwrite x to have xy's data
-						x->subtree_sizes = xy->subtree_sizes;
-						x->subtree_psums = xy->subtree_psums;
-						x->children = xy->children;
-						x->leaves = xy->leaves;
-						x->rank_ = xy->rank_;
-						x->nr_children = xy->nr_children;
-						x->has_leaves_ = xy->has_leaves_;
-
-						uint32_t r = 0;
-						if (not x->has_leaves()) {
-							for (auto cc : x->children) {
-								cc->overwrite_parent(x);
-								cc->overwrite_rank(r++);
-							}
-						}
+			/*
+			 * remove the integer at position i, and return it. Without pending
+			 * insertions, the integers before position i are added to *before, if
+			 * given.
+			 *
+			 * The removal is top-down: this node can lose a child (or is the
+			 * root), and before descending into a child, makes that child able to
+			 * lose one too, by stealing a child from a sibling or merging with it.
+			 * The counters are updated on the way back up. A root left with a
+			 * single internal child is replaced by the tree (see basic_b_spsi::remove).
+			 */
+			uint64_t remove(uint64_t i, uint64_t* before = NULL) {
+				assert(i < size());
+				assert(not buffered or before == NULL);
 
-						delete xy;
-						// y has been merged into x, so needs to be de-allocated.
-						delete y;
-					}
-				}  // end if not x->can_lose()
+				if constexpr (buffered) {
+					uint32_t const k = messages.up_to(i);
 
-				// At this point, x can afford to lose a child.
-				// Find the child from which to remove
-				assert(x->can_lose());
-				assert(this->can_lose());
-				assert(i < this->size());
+					if (k > 0 and messages.pos(k - 1) == i) return messages.erase(k - 1);
+
+					messages.shift_down(k);
+					i -= k;
+				}
 
 				uint32_t j = this->find_child(i);
 
@@ -1114,13 +1771,11 @@ namespace dyn {
 				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
 
 				i = i - previous_size;
-				assert(i >= 0);
 				if (this->has_leaves()) {
 					assert(this->leaves.size() == nr_children);
-					assert(this->can_lose());
 
 					// remove from the leaf directly, ensuring
-					// it remains of size at least B_LEAF
+					// it remains of size at least leaf_minimum
 					leaf_type* x = this->leaves[j];
 					if (not(leaf_can_lose(x) or (this->leaves.size() == 1))) {
 						// Need to ensure that x
@@ -1159,12 +1814,12 @@ namespace dyn {
 
 								// update x->parent subtree info
 								this->subtree_sizes[j - 1] -= 1;
-								this->subtree_psums[j - 1] -= z;
+								this->subtree_second[j - 1] -= second_counter(1, z);
 
 								assert(this->subtree_sizes[j] ==
 									this->subtree_sizes[j - 1] + x->size());
-								assert(this->subtree_psums[j] ==
-									this->subtree_psums[j - 1] + x->psum());
+								assert(this->subtree_psum(j) ==
+									this->subtree_psum(j - 1) + x->psum());
 
 							}
 							else {
@@ -1179,26 +1834,26 @@ namespace dyn {
 
 								// update x->parent subtree info
 								this->subtree_sizes[j] += 1;
-								this->subtree_psums[j] += z;
+								this->subtree_second[j] += second_counter(1, z);
 
 								assert(this->subtree_sizes[j + 1] ==
 									this->subtree_sizes[j] + y->size());
-								assert(this->subtree_psums[j + 1] ==
-									this->subtree_psums[j] + y->psum());
+								assert(this->subtree_psum(j + 1) ==
+									this->subtree_psum(j) + y->psum());
 							}
 						}
 						else {
 							// y cannot lose a child
 							// means: neither x nor y can lose a child
 							// so: merge x,y into single node of size
-							// 2B_LEAF
+							// at most 2 * leaf_minimum
 
 							if (y_is_prev) {
 								for (size_t ii = 0; ii < y->size(); ++ii) {
 									x->insert(0, y->at(y->size() - 1 - ii));
 								}
 
-								assert(x->size() == 2 * B_LEAF);
+								assert(x->size() <= 2 * leaf_minimum);
 
 								--j;  // update the location of x in this's list of children
 								// update removal position to be wrt yx (if y is prev)
@@ -1214,7 +1869,7 @@ namespace dyn {
 
 							for (size_t i = j; i < this->nr_children; ++i) {
 								this->subtree_sizes[i] = this->subtree_sizes[i + 1];
-								this->subtree_psums[i] = this->subtree_psums[i + 1];
+								this->subtree_second[i] = this->subtree_second[i + 1];
 							}
 
 							if (y_is_prev) {
@@ -1227,6 +1882,9 @@ namespace dyn {
 								assert(j + 1 < this->leaves.size());
 								this->leaves.erase(this->leaves.begin() + j + 1);
 							}
+
+							// y has been merged into x
+							mem->free(y);
 						}
 					}  // end if not x->can_lose()
 
@@ -1235,83 +1893,468 @@ namespace dyn {
 
 					assert(i < x->size());
 
+					if (before) *before += (j == 0 ? 0 : subtree_psum(j - 1)) + (i == 0 ? 0 : x->psum(i - 1));
+
 					uint64_t z = x->at(i);
 					x->remove(i);
 
-					// update satellite data
-					// requires traversal back up to root
+					// update satellite data; the ancestors update theirs on the way back
+
+					while (j < this->nr_children) {
+						--subtree_sizes[j];
+						subtree_second[j] -= second_counter(1, z);
+						++j;
+					}
+
+					sync_index();
+
+					return z;
+				}
+
+				// a root with a single child has no sibling to fix it with
+				if (not children[j]->can_lose() and nr_children > 1) {
+					make_child_lose(j);
+
+					i += previous_size;
+					j = find_child(i);
+					previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
+					i -= previous_size;
+				}
+
+				if (before) *before += j == 0 ? 0 : subtree_psum(j - 1);
+
+				uint64_t const z = children[j]->remove(i, before);
+
+				for (uint32_t k = j; k < nr_children; ++k) {
+					--subtree_sizes[k];
+					subtree_second[k] -= second_counter(1, z);
+				}
+
+				sync_index();
+
+				return z;
+			}
+
+			/*
+			 * let the j-th child (an internal node with node_minimum children) lose a
+			 * child: steal one from an adjacent sibling that can lose one, or else
+			 * merge the child with that sibling
+			 */
+			void make_child_lose(uint32_t j) {
+				assert(not has_leaves() and nr_children > 1);
+
+				node* x = children[j];
+				bool const y_is_prev = j > 0;
+				node* y = children[y_is_prev ? j - 1 : j + 1];
+
+				if (not y->can_lose()) {
+					merge_children(y_is_prev ? j - 1 : j);
+					return;
+				}
+
+				// the moved child, at the end of y or at the start of y
+				uint64_t moved_size;
+				uint64_t moved_psum;
+
+				if (x->has_leaves()) {
+					leaf_type* z = y_is_prev ? y->leaves.back() : y->leaves.front();
+
+					if (y_is_prev) {
+						y->leaves.pop_back();
+						x->leaves.insert(x->leaves.begin(), z);
+					}
+					else {
+						y->leaves.erase(y->leaves.begin());
+						x->leaves.push_back(z);
+					}
+
+					moved_size = z->size();
+					moved_psum = z->psum();
+				}
+				else {
+					node* z = y_is_prev ? y->children.back() : y->children.front();
+
+					if (y_is_prev) {
+						y->children.pop_back();
+						x->children.insert(x->children.begin(), z);
+					}
+					else {
+						y->children.erase(y->children.begin());
+						x->children.push_back(z);
+					}
+
+					moved_size = z->size();
+					moved_psum = z->psum();
+				}
+
+				--(y->nr_children);
+				++(x->nr_children);
+
+				x->recount();
+				y->recount();
+
+				// the pending insertions of y among the integers of the moved child go with it
+				if constexpr (buffered) {
+					message_buffer<buffer_size> moved;
+
+					if (y_is_prev) {
+						// the moved child started where y now ends
+						uint64_t const start = y->children_size();
+						uint32_t const k = y->messages.below(start + 1);
+
+						moved = y->messages.split_off(k, start + k);
+					}
+					else {
+						uint32_t const k = y->messages.below(moved_size);
+
+						moved = std::move(y->messages);
+						y->messages = moved.split_off(k, moved_size + k);
+					}
+
+					uint64_t const moved_messages = moved.size();
+					uint64_t const moved_sum = moved.sum();
+
+					if (y_is_prev) {
+						moved.append(x->messages, moved_size + moved_messages);
+						x->messages = std::move(moved);
+					}
+					else {
+						// x ended where the moved child now starts
+						x->messages.append(moved, x->size() - moved_size);
+					}
+
+					moved_size += moved_messages;
+					moved_psum += moved_sum;
+				}
+
+				// the boundary between x and y moves by the moved child
+				uint32_t const boundary = y_is_prev ? j - 1 : j;
+				uint64_t const moved_second = second_counter(moved_size, moved_psum);
+
+				if (y_is_prev) {
+					subtree_sizes[boundary] -= moved_size;
+					subtree_second[boundary] -= moved_second;
+				}
+				else {
+					subtree_sizes[boundary] += moved_size;
+					subtree_second[boundary] += moved_second;
+				}
+
+				sync_index();
+			}
+
+			/*
+			 * merge the children l and l + 1 (internal nodes with node_minimum
+			 * children each) into child l
+			 */
+			void merge_children(uint32_t l) {
+				assert(l + 1 < nr_children);
+
+				children[l]->merge_node(children[l + 1]);
+				children.erase(children.begin() + l + 1);
+
+				// child l now ends where child l + 1 ended
+				for (uint32_t k = l; k + 1 < nr_children; ++k) {
+					subtree_sizes[k] = subtree_sizes[k + 1];
+					subtree_second[k] = subtree_second[k + 1];
+				}
+
+				--nr_children;
+
+				sync_index();
+			}
+
+			/*
+			 * append the children of node y (of the same height) to those of this
+			 * node, and free y
+			 */
+			void merge_node(node* y) {
+				assert(has_leaves() == y->has_leaves());
+				assert(nr_children + y->nr_children <= 2 * B + 2);
+
+				// the pending insertions of y follow those of this node
+				if constexpr (buffered) messages.append(y->messages, size());
+
+				if (has_leaves()) leaves.insert(leaves.end(), y->leaves.begin(), y->leaves.end());
+				else children.insert(children.end(), y->children.begin(), y->children.end());
+
+				nr_children += y->nr_children;
+				recount();
+
+				// y's subtrees now belong to this node: free y alone
+				mem->free(y);
+			}
+
+			/*
+			 * give child t (just attached by a range operation, see
+			 * basic_b_spsi::join) enough integers or children: merge it with an
+			 * adjacent sibling if both fit in one, or else share evenly with it
+			 */
+			void mend(uint32_t t) {
+				assert(t < nr_children);
+
+				if (nr_children < 2) return;
+
+				uint32_t const l = t > 0 ? t - 1 : t;
+
+				if (has_leaves()) {
+					if (leaves[t]->size() >= leaf_minimum) return;
+
+					if (leaves[l]->size() + leaves[l + 1]->size() <= 2 * B_LEAF) merge_leaves(l);
+					else even_leaves(l);
+				}
+				else {
+					if (children[t]->nr_children >= node_minimum) return;
+
+					if (children[l]->nr_children + children[l + 1]->nr_children <= 2 * B + 2) merge_children(l);
+					else even_children(l);
+				}
+			}
+
+			/*
+			 * the tree b, lower than this node (of height h), after the integers
+			 * of this subtree: it becomes the last child of the node of height
+			 * b.height + 1 on the right spine, splitting full nodes on the way
+			 * down as insert does. Returns the new root (this node, or a new one
+			 * above it if it was full)
+			 */
+			node* append_tree(piece const& b, uint32_t h) {
+				assert(h > b.height);
+
+				node* const r = is_full() ? split_root() : this;
+
+				r->template attach_below<false>(b, r == this ? h : h + 1);
+
+				return r;
+			}
+
+			/*
+			 * as append_tree, with b before the integers of this subtree, on the
+			 * left spine
+			 */
+			node* prepend_tree(piece const& b, uint32_t h) {
+				assert(h > b.height);
+
+				node* const r = is_full() ? split_root() : this;
+
+				r->template attach_below<true>(b, r == this ? h : h + 1);
+
+				return r;
+			}
+
+			/*
+			 * where child j starts: the child holding the c-th integer of the
+			 * children and the offset of that integer in it, or nr_children if c
+			 * is past the end
+			 */
+			std::pair<uint32_t, uint64_t> locate(uint64_t c) const {
+				if (c >= children_size()) return { nr_children, 0 };
+
+				uint32_t const j = find_child(c);
+
+				return { j, c - (j == 0 ? 0 : subtree_sizes[j - 1]) };
+			}
+
+			/*
+			 * child j of this node, of height h, as a piece
+			 */
+			piece child_piece(uint32_t j, uint32_t h) const {
+				if (has_leaves()) return { NULL, leaves[j], 0 };
+
+				return { children[j], NULL, h - 1 };
+			}
+
+			/*
+			 * cut this node before child j: the children after it (from child j
+			 * on, unless drop) move to a new node, returned (NULL if there are
+			 * none), and child j leaves this node in any case if drop. This node
+			 * keeps the children before j, and is not recounted if it has none.
+			 * Its pending insertions must have been taken out
+			 */
+			node* cut_children(uint32_t j, bool drop) {
+				assert(j <= nr_children and (j < nr_children or not drop));
+				assert(messages.size() == 0);
+
+				uint32_t const from = j + drop;
+				node* right = NULL;
+
+				if (has_leaves()) {
+					if (from < nr_children) right = mem->new_node(leaves.begin() + from, leaves.end());
+					leaves.resize(j);
+				}
+				else {
+					if (from < nr_children) right = mem->new_node(children.begin() + from, children.end());
+					children.resize(j);
+				}
+
+				nr_children = j;
+
+				if (j > 0) recount();
+
+				return right;
+			}
+
+			/*
+			 * the pending insertions of this node, taken out of it
+			 */
+			message_buffer<buffer_size> take_messages() {
+				message_buffer<buffer_size> m = std::move(messages);
+				messages = {};
+
+				return m;
+			}
+
+			/*
+			 * pending insertions top, by position in the content of this node
+			 * (its integers and its own pending insertions), join those of this
+			 * node
+			 */
+			void add_messages(message_buffer<buffer_size>&& top) {
+				top.absorb(messages);
+				messages = std::move(top);
+			}
+
+			/*
+			 * recompute the counters of this node from its children
+			 */
+			void recount() {
+				uint64_t si = 0;
+				uint64_t ps = 0;
+
+				for (uint32_t k = 0; k < nr_children; ++k) {
+					if (has_leaves()) {
+						si += leaves[k]->size();
+						ps += leaves[k]->psum();
+					}
+					else {
+						si += children[k]->size();
+						ps += children[k]->psum();
+					}
+
+					subtree_sizes[k] = si;
+					subtree_second[k] = second_counter(si, ps);
+				}
+
+				sync_index();
+			}
+
+			uint64_t size() const { return children_size() + messages.size(); }
+
+			uint64_t psum() const {
+				if constexpr (buffered) return children_psum() + messages.sum();
+				else return children_psum();
+			}
+
+			uint64_t children_size() const {
+				assert(nr_children > 0);
+				assert(nr_children - 1 < subtree_sizes.size());
+				return subtree_sizes[nr_children - 1];
+			}
+
+			uint64_t children_psum() const { return subtree_psum(nr_children - 1); }
+
+			/*
+			 * pending insertions in this subtree
+			 */
+			uint64_t pending_insertions() const {
+				uint64_t n = messages.size();
+
+				if (buffered and not has_leaves()) {
+					for (uint32_t k = 0; k < nr_children; ++k) n += children[k]->pending_insertions();
+				}
 
-					while (j < this->nr_children) {
-						--subtree_sizes[j];
-						subtree_psums[j] -= z;
-						++j;
-					}
+				return n;
+			}
 
-					node* tmp_parent = this->parent;
-					node* tmp_child = this;
-					while (tmp_parent != NULL) {
-						uint32_t r = tmp_child->rank_;
-						uint32_t nc = tmp_parent->nr_children;
-						while (r < nc) {
-							--(tmp_parent->subtree_sizes[r]);
+			/*
+			 * take the pending insertions out of this subtree, into out, by
+			 * position in the content of this node
+			 */
+			void drain(message_buffer<buffer_size>& out) {
+				if constexpr (buffered) {
+					if (not has_leaves()) {
+						message_buffer<buffer_size> below;
 
-							tmp_parent->subtree_psums[r] -= z;
-							++r;
+						for (uint32_t k = 0; k < nr_children; ++k) {
+							message_buffer<buffer_size> m;
+							children[k]->drain(m);
+							below.append(m, k == 0 ? 0 : subtree_sizes[k - 1]);
 						}
 
-						tmp_child = tmp_parent;
-						tmp_parent = tmp_child->parent;
+						recount();
+						messages.absorb(below);
 					}
 
+					out = std::move(messages);
+					messages = {};
 				}
-				else {
-					children[j]->remove(i);
-				}
+			}
 
-				node* new_root = NULL;
+			uint32_t number_of_children() const { return nr_children; }
 
-				// After removal, check if root needs to be updated
-				if (is_root()) {
-					if (not has_leaves()) {
-						// if root has only one child, make that child the root
-						if (nr_children == 1) {
-							new_root = this->children[0];
-							new_root->parent = NULL;
-						}
-					}
+			const node* child(uint32_t j) const { return children[j]; }
+
+			/*
+			 * the only child of this root, which takes over its pending
+			 * insertions
+			 */
+			node* only_child() {
+				assert(not has_leaves() and nr_children == 1);
+
+				if constexpr (buffered) {
+					messages.absorb(children[0]->messages);
+					children[0]->messages = std::move(messages);
+					messages = {};
 				}
 
-				return new_root;
+				return children[0];
 			}
 
-			uint32_t rank() const { return rank_; }
+			const leaf_type* leaf(uint32_t j) const { return leaves[j]; }
 
-			void overwrite_rank(uint32_t r) { rank_ = r; }
-
-			uint64_t size() const {
-				assert(nr_children > 0);
-				assert(nr_children - 1 < subtree_sizes.size());
-				return subtree_sizes[nr_children - 1];
+			/*
+			 * number of bytes of the record of this node in the flat format
+			 */
+			uint64_t flat_record_size() const {
+				return sizeof(uint64_t) * (2 + 2 * uint64_t(nr_children));
 			}
 
-			uint64_t psum() const { return subtree_psums[nr_children - 1]; }
+			/*
+			 * write the record of this node in the flat format (see
+			 * flat-format.hpp). first_child is the index of the first child among
+			 * the flat node records (or leaves, if this node has leaves).
+			 */
+			uint64_t serialize_flat(ostream& out, uint64_t first_child) const {
+				uint64_t head = uint64_t(nr_children) | (uint64_t(has_leaves_) << 32);
+
+				out.write((char*)& head, sizeof(head));
+				out.write((char*)& first_child, sizeof(first_child));
+				// the flat format has 64-bit counters
+				for (uint32_t k = 0; k < nr_children; ++k) {
+					uint64_t const c = subtree_sizes[k];
+					out.write((char*)& c, sizeof(c));
+				}
 
-			void overwrite_parent(node* P) { parent = P; }
+				for (uint32_t k = 0; k < nr_children; ++k) {
+					uint64_t const c = subtree_psum(k);
+					out.write((char*)& c, sizeof(c));
+				}
 
-			uint32_t number_of_children() { return nr_children; }
+				return flat_record_size();
+			}
 
 			uint64_t serialize(ostream& out) const {
 				uint64_t w_bytes = 0;
 				uint64_t subtree_sizes_len = subtree_sizes.size();
-				uint64_t subtree_psums_len = subtree_psums.size();
-				uint64_t children_len = children.size();
-				uint64_t leaves_len = leaves.size();
+				uint64_t subtree_second_len = subtree_second.size();
+				uint64_t children_len = has_leaves_ ? 0 : children.size();
+				uint64_t leaves_len = has_leaves_ ? leaves.size() : 0;
 
 				out.write((char*)& subtree_sizes_len, sizeof(subtree_sizes_len));
 				w_bytes += sizeof(subtree_sizes_len);
 
-				out.write((char*)& subtree_psums_len, sizeof(subtree_psums_len));
-				w_bytes += sizeof(subtree_psums_len);
+				out.write((char*)& subtree_second_len, sizeof(subtree_second_len));
+				w_bytes += sizeof(subtree_second_len);
 
 				out.write((char*)& children_len, sizeof(children_len));
 				w_bytes += sizeof(children_len);
@@ -1320,12 +2363,12 @@ namespace dyn {
 				w_bytes += sizeof(leaves_len);
 
 				out.write((char*)subtree_sizes.data(),
-					sizeof(uint64_t) * subtree_sizes_len);
-				w_bytes += sizeof(uint64_t) * subtree_sizes_len;
+					sizeof(counter_type) * subtree_sizes_len);
+				w_bytes += sizeof(counter_type) * subtree_sizes_len;
 
-				out.write((char*)subtree_psums.data(),
-					sizeof(uint64_t) * subtree_psums_len);
-				w_bytes += sizeof(uint64_t) * subtree_psums_len;
+				out.write((char*)subtree_second.data(),
+					sizeof(second_type) * subtree_second_len);
+				w_bytes += sizeof(second_type) * subtree_second_len;
 
 				out.write((char*)& has_leaves_, sizeof(has_leaves_));
 				w_bytes += sizeof(has_leaves_);
@@ -1338,8 +2381,10 @@ namespace dyn {
 					for (auto c : children) w_bytes += c->serialize(out);
 				}
 
-				out.write((char*)& rank_, sizeof(rank_));
-				w_bytes += sizeof(rank_);
+				// formerly the rank of the node among its siblings, kept for the format
+				uint32_t const rank = 0;
+				out.write((char*)& rank, sizeof(rank));
+				w_bytes += sizeof(rank);
 
 				out.write((char*)& nr_children, sizeof(nr_children));
 				w_bytes += sizeof(nr_children);
@@ -1348,54 +2393,150 @@ namespace dyn {
 			}
 
 			void load(istream& in) {
+				// the loaded subtrees replace the current ones (the empty leaf of a
+				// new node)
+				free_mem();
+
 				uint64_t subtree_sizes_len;
-				uint64_t subtree_psums_len;
+				uint64_t subtree_second_len;
 				uint64_t children_len;
 				uint64_t leaves_len;
 
 				in.read((char*)& subtree_sizes_len, sizeof(subtree_sizes_len));
 
-				in.read((char*)& subtree_psums_len, sizeof(subtree_psums_len));
+				in.read((char*)& subtree_second_len, sizeof(subtree_second_len));
 
 				in.read((char*)& children_len, sizeof(children_len));
 
 				in.read((char*)& leaves_len, sizeof(leaves_len));
 
 				assert(subtree_sizes_len > 0);
-				assert(subtree_psums_len > 0);
+				assert(subtree_second_len > 0);
 
 				if (subtree_sizes_len != subtree_sizes.size()
-					|| subtree_psums_len != subtree_psums.size())
+					|| subtree_second_len != subtree_second.size())
 					throw std::ifstream::failure("incompatible parameter B");
 
-				in.read((char*)subtree_sizes.data(), sizeof(uint64_t) * subtree_sizes.size());
-				in.read((char*)subtree_psums.data(), sizeof(uint64_t) * subtree_psums.size());
+				in.read((char*)subtree_sizes.data(), sizeof(counter_type) * subtree_sizes.size());
+				in.read((char*)subtree_second.data(), sizeof(second_type) * subtree_second.size());
 
 				in.read((char*)& has_leaves_, sizeof(has_leaves_));
 
 				if (has_leaves_) {
 					assert(leaves_len > 0);
-					leaves = vector<leaf_type*>(leaves_len);
+					leaves = leaf_array(leaves_len);
 
-					for (auto& l : leaves) l = new leaf_type();
+					for (auto& l : leaves) l = mem->new_leaf();
 					for (auto& l : leaves) l->load(in);
 
 				}
 				else {
 					assert(children_len > 0);
-					children = vector<node*>(children_len);
+					children = node_array(children_len);
 
-					for (auto& c : children) c = new node();
-					for (auto& c : children) c->overwrite_parent(this);
+					for (auto& c : children) c = mem->new_node();
 					for (auto& c : children) c->load(in);
 				}
 
-				in.read((char*)& rank_, sizeof(rank_));
+				uint32_t rank;
+				in.read((char*)& rank, sizeof(rank));
 
 				in.read((char*)& nr_children, sizeof(nr_children));
+
+				sync_index();
 			}
 
 		private:
+			/*
+			 * true iff the query key (relative to this node) falls in a child
+			 * among 0, ..., j
+			 */
+			template <batch_op op>
+			bool in_child(uint32_t j, uint64_t key) const {
+				if (op == batch_op::search) return key <= subtree_psum(j);
+				if (op == batch_op::search_0) return key <= subtree_sizes[j] - subtree_psum(j);
+
+				return key < subtree_sizes[j];
+			}
+
+			template <batch_op op>
+			uint64_t query_of(uint64_t key) const {
+				if (op == batch_op::at) return at(key);
+				if (op == batch_op::psum) return psum(key);
+				if (op == batch_op::search) return search(key);
+
+				return search_0(key);
+			}
+
+			/*
+			 * search, search_0 and search_r past the pending insertions: smallest
+			 * position whose prefix weighs x, an integer v weighing v, 1 - v or
+			 * v + 1. The prefixes up to the pending insertions grow with them, so
+			 * that the first one reaching x is found by binary search; the answer
+			 * is that insertion or in the children before it.
+			 */
+			template <search_op op>
+			uint64_t search_messages(uint64_t x) const {
+				auto const weight = [](uint64_t v) -> uint64_t {
+					if constexpr (op == search_op::ones) return v;
+					else if constexpr (op == search_op::zeros) return v == 0;
+					else return v + 1;
+				};
+
+				// weight of the first k pending insertions, from their running sum
+				auto const pending = [&](uint32_t k) -> uint64_t {
+					if constexpr (op == search_op::ones) return messages.sum(k);
+					else if constexpr (op == search_op::zeros) return k - messages.sum(k);
+					else return messages.sum(k) + k;
+				};
+
+				// weight of the first n integers of the children
+				auto const children_prefix = [&](uint64_t n) -> uint64_t {
+					uint64_t const ps = n == 0 ? 0 : children_psum(n - 1);
+
+					if constexpr (op == search_op::ones) return ps;
+					else if constexpr (op == search_op::zeros) return n - ps;
+					else return ps + n;
+				};
+
+				uint32_t const n = messages.size();
+
+				// weight before the k-th pending insertion
+				auto const before = [&](uint32_t k) { return pending(k) + children_prefix(messages.children_pos(k)); };
+
+				uint32_t low = 0;
+				uint32_t size = n;
+
+				while (size > 0) {
+					uint32_t const half = size / 2;
+
+					if (before(low + half) + weight(messages.val(low + half)) >= x) {
+						size = half;
+					}
+					else {
+						low += half + 1;
+						size -= half + 1;
+					}
+				}
+
+				if (low < n and before(low) < x) return messages.pos(low);
+
+				uint64_t const rest = x - pending(low);
+
+				if constexpr (op == search_op::ones) return children_search(rest) + low;
+				else if constexpr (op == search_op::zeros) return children_search_0(rest) + low;
+				else return children_search_r(rest) + low;
+			}
+
+			template <batch_op op>
+			static uint64_t leaf_query(const leaf_type* leaf, uint64_t key) {
+				if (op == batch_op::at) return leaf->at(key);
+				if (op == batch_op::psum) return leaf->psum(key);
+				if (op == batch_op::search) return leaf->search(key);
+
+				return leaf->search_0(key);
+			}
+
 			/*
 			 * new element between elements i and i+1
 			 */
@@ -1407,55 +2548,39 @@ namespace dyn {
 
 				// size/psum stored in previous counter
 				uint64_t previous_size = (i == 0 ? 0 : subtree_sizes[i - 1]);
-				uint64_t previous_psum = (i == 0 ? 0 : subtree_psums[i - 1]);
+				uint64_t previous_psum = (i == 0 ? 0 : subtree_psum(i - 1));
 
 				// first of all, move forward counters i+1, i+2, ...
 				for (uint32_t j = subtree_sizes.size() - 1; j > i; j--) {
 					// node is not full so overwriting subtree_sizes[subtree_sizes.size()-1]
 					// is safe
 					subtree_sizes[j] = subtree_sizes[j - 1];
-					subtree_psums[j] = subtree_psums[j - 1];
+					subtree_second[j] = subtree_second[j - 1];
 				}
 
 				subtree_sizes[i] = previous_size + left->size();
-				subtree_psums[i] = previous_psum + left->psum();
+				subtree_second[i] = second_counter(subtree_sizes[i], previous_psum + left->psum());
 
 				// number of children increases by 1
 				nr_children++;
 
-				// temporary copy children
-				vector<node*> temp(children);
-
-				// reset children
-				children = vector<node*>(nr_children);
-				uint32_t k = 0;  // index in children
+				// left replaces child i, right is shifted in after it
+				children[i] = left;
+				children.insert(children.begin() + i + 1, right);
 
-				for (uint32_t j = 0; j < nr_children - 1; ++j) {
-					if (i == j) {
-						// insert left and right, ignore child i
-						assert(k < nr_children);
-						children[k++] = left;
-						assert(k < nr_children);
-						children[k++] = right;
-
-					}
-					else {
-						// insert child i
-						assert(k < nr_children);
-						assert(temp[j] != NULL);
-						children[k++] = temp[j];
-					}
-				}
+				assert(children.size() == nr_children);
 
-				assert(k == nr_children);
+				sync_index();
+			}
 
-				// children i and i+1 are new; we have now to increase the rank
-				// of children i+2,...
+			/*
+			 * split the (full) j-th child in two
+			 */
+			void split_child(uint32_t j) {
+				assert(not has_leaves() and children[j]->is_full());
 
-				for (uint32_t j = i + 2; j < nr_children; j++) {
-					children[j]->increment_rank();
-					assert(children[j]->rank() < nr_children);
-				}
+				node* right = children[j]->split();
+				new_children(j, children[j], right);
 			}
 
 			void new_children(uint32_t i, leaf_type* left, leaf_type* right) {
@@ -1468,10 +2593,10 @@ namespace dyn {
 					subtree_sizes[0] = left->size();
 					subtree_sizes[1] = left->size() + right->size();
 
-					subtree_psums[0] = left->psum();
-					subtree_psums[1] = left->psum() + right->psum();
+					subtree_second[0] = second_counter(subtree_sizes[0], left->psum());
+					subtree_second[1] = second_counter(subtree_sizes[1], left->psum() + right->psum());
 
-					leaves = vector<leaf_type*>{ left, right };
+					leaves = leaf_array{ left, right };
 
 					nr_children++;
 
@@ -1480,48 +2605,31 @@ namespace dyn {
 
 				// size/psum stored in previous counter
 				uint64_t previous_size = (i == 0 ? 0 : subtree_sizes[i - 1]);
-				uint64_t previous_psum = (i == 0 ? 0 : subtree_psums[i - 1]);
+				uint64_t previous_psum = (i == 0 ? 0 : subtree_psum(i - 1));
 
 				// first of all, move forward counters i+1, i+2, ...
 				for (uint32_t j = nr_children; j > i; j--) {
 					// node is not full so overwriting subtree_sizes[subtree_sizes.size()-1]
 					// is safe
 					subtree_sizes[j] = subtree_sizes[j - 1];
-					subtree_psums[j] = subtree_psums[j - 1];
+					subtree_second[j] = subtree_second[j - 1];
 				}
 
 				subtree_sizes[i] = previous_size + left->size();
-				subtree_psums[i] = previous_psum + left->psum();
+				subtree_second[i] = second_counter(subtree_sizes[i], previous_psum + left->psum());
 
 				// number of children increases by 1
 				nr_children++;
 
-				// temporary copy leaves
-				vector<leaf_type*> temp(leaves);
-
-				// reset leaves
-				leaves = vector<leaf_type*>(nr_children);
-				uint32_t k = 0;  // index in leaves
+				// left replaces leaf i, right is shifted in after it
+				leaves[i] = left;
+				leaves.insert(leaves.begin() + i + 1, right);
 
-				for (uint32_t j = 0; j < nr_children - 1; ++j) {
-					if (i == j) {
-						// insert left and right, ignore child i
-						assert(k < nr_children);
-						leaves[k++] = left;
-						assert(k < nr_children);
-						leaves[k++] = right;
-
-					}
-					else {
-						// insert child i
-						assert(k < nr_children);
-						leaves[k++] = temp[j];
-					}
-				}
+				assert(leaves.size() == nr_children);
 			}
 
 			// insert a single integer x into leaf
-			inline static leaf_type* insert_into_leaf(leaf_type* leaf,
+			inline leaf_type* insert_into_leaf(leaf_type* leaf,
 				uint64_t insert_pos,
 				uint64_t x) {
 				if (free_capacity(*leaf)) {
@@ -1530,7 +2638,7 @@ namespace dyn {
 				}
 
 				// the leaf does not have enough vacant slots
-				leaf_type* next = leaf->split();
+				leaf_type* next = split_leaf(leaf);
 
 				assert(free_capacity(*leaf));
 
@@ -1546,7 +2654,7 @@ namespace dyn {
 			}
 
 			// insert n integers from the packed word x into leaf
-			inline static leaf_type* insert_into_leaf(leaf_type* leaf,
+			inline leaf_type* insert_into_leaf(leaf_type* leaf,
 				uint64_t insert_pos,
 				uint64_t x, uint8_t width, uint8_t n) {
 				assert(n);
@@ -1559,7 +2667,7 @@ namespace dyn {
 				}
 
 				// the leaf does not have enough vacant slots
-				leaf_type* next = leaf->split();
+				leaf_type* next = split_leaf(leaf);
 
 				assert(free_capacity(*leaf) >= n);
 
@@ -1575,18 +2683,72 @@ namespace dyn {
 			}
 
 			/*
-			 * insert in a node, where we know that this node is not full
+			 * insert in a node, where we know that this node is not full. In
+			 * Bε-tree mode, the integer joins the pending insertions of the node,
+			 * after pushing some down if there are too many
 			 */
 			void insert_without_split(uint64_t i, uint64_t val) {
 				assert(not is_full());
 				assert(i <= size());
 
+				if constexpr (buffered) {
+					if (messages.full()) push_messages();
+
+					messages.insert(i, val);
+				}
+				else {
+					insert_below<true>(i, val);
+				}
+			}
+
+			/*
+			 * push the pending insertions down to the children, by increasing
+			 * position, while this node has room for the children they may add:
+			 * at least one, as this node is not full
+			 */
+			void push_messages() {
+				assert(not is_full());
+
+				uint32_t k = 0;
+
+				// the k-th pending insertion is at its position in the children once the previous ones are there
+				for (; k < messages.size() and not is_full(); ++k) insert_below<false>(messages.pos(k), messages.val(k));
+
+				messages.pop_front(k);
+			}
+
+			/*
+			 * insert at position i of the children of this node (not full). With
+			 * through, the integer goes down to its leaf, adding the integers
+			 * before it to *before if given; else it joins the pending insertions
+			 * of the child
+			 */
+			template <bool through> void insert_below(uint64_t i, uint64_t val, uint64_t* before = NULL) {
+				assert(not is_full());
+				assert(i <= children_size());
+
 				uint32_t j = nr_children - 1;
 
 				// if i==size, then insert in last children
-				if (i < size())
+				if (i < children_size())
 					j = find_child(i);
 
+				// split a full child before descending into it
+				if (not has_leaves() and children[j]->is_full()) {
+					split_child(j);
+
+					if (i < children_size()) j = find_child(i);
+					else j = nr_children - 1;
+				}
+
+				// even out a full leaf with a sibling rather than split it
+				if constexpr (fill::redistributes) {
+					if (has_leaves() and free_capacity(*leaves[j]) == 0 and share_leaf(j)) {
+						if (i < children_size()) j = find_child(i);
+						else j = nr_children - 1;
+					}
+				}
+
 				// size stored in previous counter
 				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
 
@@ -1595,45 +2757,27 @@ namespace dyn {
 				// i-th element is in the j-th children
 				uint64_t insert_pos = i - previous_size;
 
-				uint32_t index = j;
-
-				auto const nr_children_c = nr_children;
-
-				while (nr_children - index > 1) {
-					auto one_mask = _mm_set_epi64x(uint64_t(1), uint64_t(1));
-					auto val_mask = _mm_set_epi64x(val, val);
+				if (before) *before += j == 0 ? 0 : subtree_psum(j - 1);
 
-					auto sum_vec = _mm_loadu_si128((__m128i*) & subtree_psums[index]);
-					auto size_vec = _mm_loadu_si128((__m128i*) & subtree_sizes[index]);
-
-					auto sum_val_vec = _mm_add_epi64(sum_vec, val_mask);
-					auto size_val_vec = _mm_add_epi64(size_vec, one_mask);
-
-					_mm_storeu_si128((__m128i*) & subtree_psums[index], sum_val_vec);
-					_mm_storeu_si128((__m128i*) & subtree_sizes[index], size_val_vec);
-
-					index += 2;
-				}
-
-				while (index < nr_children_c) {
-					++subtree_sizes[index];
-					subtree_psums[index] += val;
-					++index;
-				}
+				add_to_counters(subtree_sizes.data(), j, nr_children, 1);
+				add_to_counters(subtree_second.data(), j, nr_children, second_counter(1, val));
 
 				if (not has_leaves()) {
-					assert(not is_full());
+					assert(not children[j]->is_full());
 					assert(insert_pos <= children[j]->size());
-					assert(children[j]->get_parent() == this);
-					children[j]->insert(insert_pos, val);
+
+					if constexpr (through) children[j]->template insert_below<true>(insert_pos, val, before);
+					else children[j]->insert_without_split(insert_pos, val);
 				}
 				else {
+					if (before and insert_pos > 0) *before += leaves[j]->psum(insert_pos - 1);
+
 					auto* new_leaf = insert_into_leaf(leaves[j], insert_pos, val);
 					if (new_leaf)
 						new_children(j, leaves[j], new_leaf);
 				}
 
-				//uint64_t ps = (j == 0 ? 0 : subtree_psums[j - 1]);
+				//uint64_t ps = (j == 0 ? 0 : subtree_psum(j - 1));
 				//uint64_t si = (j == 0 ? 0 : subtree_sizes[j - 1]);
 
 				/*
@@ -1643,7 +2787,7 @@ namespace dyn {
 
 				 //assert(not has_leaves() or nr_children <= leaves.size());
 				 //assert(has_leaves() or nr_children <= children.size());
-				 //assert(nr_children <= subtree_psums.size());
+				 //assert(nr_children <= subtree_second.size());
 				 //assert(nr_children <= subtree_sizes.size());
 
 				 //for (uint32_t k = j; k < nr_children; ++k) {
@@ -1659,9 +2803,11 @@ namespace dyn {
 				 //		si += children[k]->size();
 				 //	}
 
-				 //	subtree_psums[k] = ps;
+				 //	subtree_second[k] = second_counter(si, ps);
 				 //	subtree_sizes[k] = si;
 				 //}
+
+				sync_index();
 			}
 
 			void insert_without_split(uint64_t i, uint64_t val, uint8_t width, uint8_t n) {
@@ -1674,6 +2820,22 @@ namespace dyn {
 				if (i < size())
 					j = find_child(i);
 
+				// split a full child before descending into it
+				if (not has_leaves() and children[j]->is_full()) {
+					split_child(j);
+
+					if (i < size()) j = find_child(i);
+					else j = nr_children - 1;
+				}
+
+				// even out a full leaf with a sibling rather than split it
+				if constexpr (fill::redistributes) {
+					if (has_leaves() and free_capacity(*leaves[j]) < n and share_leaf(j)) {
+						if (i < size()) j = find_child(i);
+						else j = nr_children - 1;
+					}
+				}
+
 				// size stored in previous counter
 				uint64_t previous_size = (j == 0 ? 0 : subtree_sizes[j - 1]);
 
@@ -1683,10 +2845,9 @@ namespace dyn {
 				uint64_t insert_pos = i - previous_size;
 
 				if (not has_leaves()) {
-					assert(not is_full());
+					assert(not children[j]->is_full());
 					assert(insert_pos <= children[j]->size());
-					assert(children[j]->get_parent() == this);
-					children[j]->insert(insert_pos, val, width, n);
+					children[j]->insert_without_split(insert_pos, val, width, n);
 				}
 				else {
 					auto* new_leaf = insert_into_leaf(leaves[j], insert_pos, val, width, n);
@@ -1694,7 +2855,7 @@ namespace dyn {
 						new_children(j, leaves[j], new_leaf);
 				}
 
-				uint64_t ps = (j == 0 ? 0 : subtree_psums[j - 1]);
+				uint64_t ps = (j == 0 ? 0 : subtree_psum(j - 1));
 				uint64_t si = (j == 0 ? 0 : subtree_sizes[j - 1]);
 
 				/*
@@ -1704,7 +2865,7 @@ namespace dyn {
 
 				assert(not has_leaves() or nr_children <= leaves.size());
 				assert(has_leaves() or nr_children <= children.size());
-				assert(nr_children <= subtree_psums.size());
+				assert(nr_children <= subtree_second.size());
 				assert(nr_children <= subtree_sizes.size());
 
 				for (uint32_t k = j; k < nr_children; ++k) {
@@ -1720,9 +2881,11 @@ namespace dyn {
 						si += children[k]->size();
 					}
 
-					subtree_psums[k] = ps;
+					subtree_second[k] = second_counter(si, ps);
 					subtree_sizes[k] = si;
 				}
+
+				sync_index();
 			}
 
 			/*
@@ -1734,39 +2897,208 @@ namespace dyn {
 
 				node* right = NULL;
 
+				// the right half of the children moves to the new node
 				if (has_leaves()) {
-					vector<leaf_type*> right_children_l(nr_children - nr_children / 2);
+					right = mem->new_node(leaves.begin() + nr_children / 2, leaves.end());
+					leaves.erase(leaves.begin() + nr_children / 2, leaves.end());
+				}
+				else {
+					right = mem->new_node(children.begin() + nr_children / 2, children.end());
+					children.erase(children.begin() + nr_children / 2, children.end());
+				}
+
+				// update new number of children of this node
+				nr_children = nr_children / 2;
 
-					uint64_t k = 0;
+				// the pending insertions past the children left here go to the right half
+				if constexpr (buffered) {
+					uint64_t const left_size = children_size();
+					uint32_t const k = messages.below(left_size + 1);
 
-					for (uint32_t i = nr_children / 2; i < nr_children; ++i)
-						right_children_l[k++] = leaves[i];
+					right->messages = messages.split_off(k, left_size + k);
+				}
 
-					assert(k == right_children_l.size());
+				sync_index();
 
-					right = new node(std::move(right_children_l), parent, rank() + 1);
-					leaves.erase(leaves.begin() + nr_children / 2, leaves.end());
+				return right;
+			}
+
+			/*
+			 * see append_tree and prepend_tree: this node, of height h, is not
+			 * full. The nodes on the way down have their counters recomputed
+			 */
+			template <bool front> void attach_below(piece const& b, uint32_t h) {
+				assert(not is_full());
+
+				// the integers of b come before all of this subtree
+				if constexpr (buffered) {
+					if (front) messages.raise(b.size());
+				}
+
+				if (h == b.height + 1) {
+					assert(has_leaves() == (b.l != NULL));
+
+					if (has_leaves()) leaves.insert(front ? leaves.begin() : leaves.end(), b.l);
+					else children.insert(front ? children.begin() : children.end(), b.n);
+
+					++nr_children;
+					recount();
+					mend(front ? 0 : nr_children - 1);
+
+					return;
+				}
+
+				uint32_t j = front ? 0 : nr_children - 1;
+
+				if (children[j]->is_full()) {
+					split_child(j);
+					j += not front;
+				}
+
+				children[j]->template attach_below<front>(b, h - 1);
+				recount();
+			}
+
+			/*
+			 * merge the leaves l and l + 1 into one. Works only on bitvectors!
+			 */
+			void merge_leaves(uint32_t l) {
+				assert(has_leaves() and l + 1 < nr_children);
+
+				vector<uint64_t> w;
+				uint64_t nbits = 0;
+
+				append_leaf(w, nbits, leaves[l], 0, leaves[l]->size());
+				append_leaf(w, nbits, leaves[l + 1], 0, leaves[l + 1]->size());
+
+				mem->free(leaves[l]);
+				mem->free(leaves[l + 1]);
+
+				leaves[l] = mem->new_leaf(std::move(w), nbits);
+				leaves.erase(leaves.begin() + l + 1);
+				--nr_children;
+
+				recount();
+			}
+
+			/*
+			 * share the children of the children l and l + 1 (internal nodes)
+			 * evenly between them
+			 */
+			void even_children(uint32_t l) {
+				assert(not has_leaves() and l + 1 < nr_children);
+
+				node* x = children[l];
+				node* y = children[l + 1];
+
+				uint32_t const n = x->nr_children + y->nr_children;
+				uint32_t const half = n / 2;
+
+				// the pending insertions of y follow those of x, until the cut
+				if constexpr (buffered) {
+					x->messages.append(y->messages, x->size());
+					y->messages = {};
+				}
+
+				if (x->has_leaves()) {
+					leaf_type* all[2 * (2 * B + 2)];
 
+					std::copy(y->leaves.begin(), y->leaves.end(), std::copy(x->leaves.begin(), x->leaves.end(), all));
+					x->leaves = leaf_array(all, all + half);
+					y->leaves = leaf_array(all + half, all + n);
 				}
 				else {
-					vector<node*> right_children_n(nr_children - nr_children / 2);
+					node* all[2 * (2 * B + 2)];
 
-					uint64_t k = 0;
+					std::copy(y->children.begin(), y->children.end(), std::copy(x->children.begin(), x->children.end(), all));
+					x->children = node_array(all, all + half);
+					y->children = node_array(all + half, all + n);
+				}
 
-					for (uint32_t i = nr_children / 2; i < nr_children; ++i)
-						right_children_n[k++] = children[i];
+				x->nr_children = half;
+				y->nr_children = n - half;
 
-					assert(k == right_children_n.size());
+				x->recount();
+				y->recount();
 
-					right = new node(std::move(right_children_n), parent, rank() + 1);
+				if constexpr (buffered) {
+					uint64_t const left_size = x->children_size();
+					uint32_t const k = x->messages.below(left_size + 1);
 
-					children.erase(children.begin() + nr_children / 2, children.end());
+					y->messages = x->messages.split_off(k, left_size + k);
 				}
 
-				// update new number of children of this node
-				nr_children = nr_children / 2;
+				recount();
+			}
 
-				return right;
+			/*
+			 * split a full leaf, the right half going to the leaf pool. The leaf
+			 * builds it from its words and size, and from whatever else it
+			 * needs (e.g. the width of an integer leaf)
+			 */
+			leaf_type* split_leaf(leaf_type* leaf) {
+				return leaf->split([this](auto&&... args) { return mem->new_leaf(std::forward<decltype(args)>(args)...); });
+			}
+
+			/*
+			 * B*-style: even out the full leaf j with the adjacent leaf that has
+			 * more room, if that one has a quarter of its capacity free. Returns
+			 * false (and changes nothing) otherwise.
+			 */
+			bool share_leaf(uint32_t j) {
+				assert(has_leaves());
+
+				uint64_t const prev_room = j > 0 ? free_capacity(*leaves[j - 1]) : 0;
+				uint64_t const next_room = j + 1 < nr_children ? free_capacity(*leaves[j + 1]) : 0;
+
+				uint64_t const room = std::max(prev_room, next_room);
+
+				if (room == 0 or room < B_LEAF / 2) return false;
+
+				even_leaves(prev_room >= next_room ? j - 1 : j);
+
+				return true;
+			}
+
+			/*
+			 * share the integers of the leaves l and l + 1 evenly between them,
+			 * cutting at a word boundary as the bulk build does. Works only on
+			 * bitvectors!
+			 */
+			void even_leaves(uint32_t l) {
+				assert(l + 1 < nr_children);
+
+				vector<uint64_t> w;
+				uint64_t nbits = 0;
+
+				append_leaf(w, nbits, leaves[l], 0, leaves[l]->size());
+				append_leaf(w, nbits, leaves[l + 1], 0, leaves[l + 1]->size());
+
+				// neither half may exceed the capacity of a leaf
+				uint64_t const unit = B_LEAF >= 64 ? 64 : 1;
+				uint64_t const cut = std::clamp<uint64_t>((nbits / 2) / unit * unit,
+					nbits - std::min<uint64_t>(nbits, 2 * B_LEAF), 2 * B_LEAF);
+
+				vector<uint64_t> left(words_for(cut));
+				vector<uint64_t> right(words_for(nbits - cut));
+
+				copy_bits(left.data(), w.data(), 0, cut, nbits);
+				copy_bits(right.data(), w.data(), cut, nbits - cut, nbits);
+
+				mem->free(leaves[l]);
+				mem->free(leaves[l + 1]);
+
+				leaves[l] = mem->new_leaf(std::move(left), cut);
+				leaves[l + 1] = mem->new_leaf(std::move(right), nbits - cut);
+
+				// only the boundary between the two leaves moves
+				uint64_t const si = (l == 0 ? 0 : subtree_sizes[l - 1]) + cut;
+				uint64_t const ps = (l == 0 ? 0 : subtree_psum(l - 1)) + leaves[l]->psum();
+
+				subtree_sizes[l] = si;
+				subtree_second[l] = second_counter(si, ps);
+
+				sync_index();
 			}
 
 			static uint64_t free_capacity(const leaf_type& l) {
@@ -1811,172 +3143,112 @@ namespace dyn {
 			/*
 			 * helper functions for child search
 			 */
-			inline uint64_t find_child(uint64_t i) const {
-				//return linear_skip(16, i, nr_children);
-
-				//uint64_t index = 0;
-
-				//while (nr_children - index > 1) {
-				//	uint64_t result[2];
-				//	auto size_vec = _mm_loadu_si128((__m128i*) & subtree_sizes[index]);
-				//	auto val_mask = _mm_set_epi64x(i, i);
-				//	auto result_vec = _mm_cmpgt_epi64(size_vec, val_mask);
-				//	_mm_storeu_si128((__m128i*) & result, result_vec);
-
-				//	if (result[0] == 0xFFFFFFFFFFFFFFFF) return index;
-				//	if (result[1] == 0xFFFFFFFFFFFFFFFF) return index + 1;
-
-				//	index += 2;
-				//}
-
-				//while (subtree_sizes[index] <= i) {
-				//	index++;
-				//	assert(index < subtree_sizes.size());
-				//}
-
-				//return index;
-
-				//uint64_t index = 0;
-				//auto counter = _mm_setzero_si128();
-				//auto val_mask = _mm_set1_epi64x(i);
-
-				//while (nr_children - index > 1) {
-				//	auto size_vec = _mm_loadu_si128((__m128i*) & subtree_sizes[index]);
-				//	auto result_vec = _mm_cmpgt_epi64(size_vec, val_mask);
-				//	counter = _mm_sub_epi64(counter, result_vec);
-				//	index += 2;
-				//}
-
-				//auto shuffle = _mm_shuffle_epi32(counter, _MM_SHUFFLE(1, 0, 3, 2));
-
-				//counter = _mm_add_epi64(counter, shuffle);
-
-				//auto val = _mm_cvtsi128_si64(counter);
-
-				//if (!index || index < nr_children) {
-				//	if (i < subtree_sizes[index]) {
-				//		++val;
-				//		assert(index < subtree_sizes.size());
-				//	}
-				//}
-
-				//return nr_children - val;
-
-				//uint64_t index = 0;
-				//auto counter = _mm256_setzero_si256();
-				//auto val_mask = _mm256_set1_epi64x(i);
-
-				//while (nr_children - index > 3) {
-				//	auto size_vec = _mm256_loadu_si256((__m256i*) & subtree_sizes[index]);
-				//	auto result_vec = _mm256_cmpgt_epi64(size_vec, val_mask);
-				//	counter = _mm256_sub_epi64(counter, result_vec);
-				//	index += 4;
-				//}
-
-				//auto high = _mm256_extractf128_si256(counter, 1);
-				//auto low = _mm256_extractf128_si256(counter, 0);
-				//auto result = _mm_add_epi64(high, low);
-				//auto shuffle = _mm_shuffle_epi32(result, _MM_SHUFFLE(1, 0, 3, 2));
-				//result = _mm_add_epi64(result, shuffle);
-				//auto val = _mm_cvtsi128_si64(result);
-
-				//if (index < nr_children) {
-				//	while (i > subtree_sizes[index]) {
-				//		++val;
-				//		++index;
-				//		assert(index < subtree_sizes.size());
-				//	}
-				//}
-
-				//while (!index || (index < nr_children && i < subtree_sizes[index])) {
-				//	++index;
-				//	++val;
-				//}
-
-				//return nr_children - val;
-
-				uint32_t size = nr_children;
-				uint32_t low = 0;
-
-				while (size > 0) {
-					uint32_t half = size / 2;
-					uint32_t other_half = size - half;
-					uint32_t probe = low + half;
-					uint32_t other_low = low + other_half;
-					uint64_t v = subtree_sizes[probe];
-					size = half;
-					low = v > i ? low : other_low;
-				}
-
-				return low;
+			inline uint64_t find_child(uint64_t i) const { return search_children<counter_of::a, false, false>(i); }
 
+			/*
+			 * first child whose subtrees hold x bits set
+			 */
+			inline uint64_t find_1(uint64_t x) const {
+				uint64_t const i = x ? x - 1 : 0;
 
-				//auto begin = subtree_sizes.begin();
-				//return upper_bound(begin, begin + nr_children - 1, i) - begin;
+				if constexpr (counter_layout::stores_zeros) return search_children<counter_of::a_minus_b, false, true>(i);
+				else return search_children<counter_of::a, true, true>(i);
+			}
 
-				//uint64_t j = 0;
-				//while (subtree_sizes[j] <= i) {
-				//	j++;
-				//	assert(j < subtree_sizes.size());
-				//}
-				//return j;
+			/*
+			 * first child whose subtrees hold x bits not set
+			 */
+			inline uint64_t find_0(uint64_t x) const {
+				if (x == 0) return 0;
 
-				//int j = 0;
+				if constexpr (counter_layout::stores_zeros) return search_children<counter_of::a, true, true>(x - 1);
+				else return search_children<counter_of::a_minus_b, false, true>(x - 1);
+			}
 
-				//if (i < subtree_sizes[j]) return j;
+			/*
+			 * first child whose subtrees reach x in psum + size
+			 */
+			inline size_t find_r(uint64_t x) const {
+				if (x == 0) return 0;
 
-				//while (true) {
-				//	if (i < subtree_sizes[++j]) return j;
-				//	if (i < subtree_sizes[++j]) return j;
-				//	if (i < subtree_sizes[++j]) return j;
-				//	if (i < subtree_sizes[++j]) return j;
-				//	if (i < subtree_sizes[++j]) return j;
-				//}
+				if constexpr (counter_layout::stores_zeros) return search_children<counter_of::twice_a_minus_b, false, true>(x - 1);
+				else return search_children<counter_of::a_plus_b, true, false>(x - 1);
 			}
 
-			inline uint64_t find_1(uint64_t x) const {
-				uint64_t j = 0;
-				while (!subtree_psums[j] || subtree_psums[j] < x) {
-					j++;
-					assert(j < subtree_psums.size());
-				}
-				return j;
+			/*
+			 * first child whose counter of op is greater than i, op reading the
+			 * sizes (false) or the second counters (true) as its arrays a and b.
+			 * With an indexed child search, through the index of the counters.
+			 */
+			template <counter_of op, bool second_a, bool second_b> inline uint32_t search_children(uint64_t i) const {
+				auto const a = counters<second_a>();
+				auto const b = counters<second_b>();
+
+				if constexpr (counter_index::indexed)
+					return index.template search<op>(a, b, samples<second_a>(), samples<second_b>(), nr_children, i);
+				else
+					return child_search::template search<op>(a, b, nr_children, i);
 			}
 
-			inline uint64_t find_0(uint64_t x) const {
-				uint64_t j = 0;
-				while (subtree_sizes[j] - subtree_psums[j] < x) {
-					j++;
-					assert(j < subtree_psums.size());
-				}
-				return j;
+			template <bool second> auto counters() const {
+				if constexpr (second) return subtree_second.data();
+				else return subtree_sizes.data();
 			}
 
-			inline size_t find_r(uint64_t x) const {
-				size_t j = 0;
-				while (subtree_psums[j] + subtree_sizes[j] < x) {
-					j++;
-					assert(j < subtree_psums.size());
-				}
-				return j;
+			template <bool second> auto samples() const {
+				if constexpr (second) return index.b();
+				else return index.a();
 			}
 
+			/*
+			 * rebuild the index of the counters, after they changed
+			 */
+			void sync_index() { index.sync(subtree_sizes.data(), subtree_second.data(), nr_children); }
+
+			/*
+			 * partial sum of the subtrees 0, ..., k
+			 */
+			uint64_t subtree_psum(uint32_t k) const { return counter_layout::psum(subtree_sizes[k], subtree_second[k]); }
+
+			/*
+			 * second counter of subtrees of total size si and partial sum ps. Also
+			 * maps differences: a subtree that gains n integers summing to v
+			 * changes its second counter by second_counter(n, v).
+			 */
+			static uint64_t second_counter(uint64_t si, uint64_t ps) { return counter_layout::second(si, ps); }
+
 			/*
 			 * in the following 2 vectors, the first nr_subtrees+1 elements refer to the
-			 * nr_subtrees subtrees
+			 * nr_subtrees subtrees. subtree_second holds the psums, or the zeros
+			 * (sizes - psums) with zeros_counters: see counter-layout.hpp.
 			 */
-			array<uint64_t, 2 * B + 2> subtree_sizes;
-			array<uint64_t, 2 * B + 2> subtree_psums;
+			array<counter_type, 2 * B + 2> subtree_sizes;
+			array<second_type, 2 * B + 2> subtree_second;
+
+			// copy of the counters searched by indexed child searches (counter-kernels.hpp)
+			using counter_index = typename counter_index_of<child_search, counter_type, second_type, 2 * B + 2>::type;
+			counter_index index;
 
-			vector<node*> children;
-			vector<leaf_type*> leaves;
+			using node_array = child_array<node*, 2 * B + 2>;
+			using leaf_array = child_array<leaf_type*, 2 * B + 2>;
 
-			node* parent = NULL;  // NULL for root
-			uint32_t rank_ = 0;   // rank of this node among its siblings
+			/*
+			 * child pointers, inline next to the counters. A node has either
+			 * internal nodes or leaves as children (has_leaves_ tells which)
+			 */
+			union {
+				node_array children{};
+				leaf_array leaves;
+			};
+
+			pools* mem = NULL;  // pools of the tree
 
 			uint32_t nr_children = 0;  // number of subtrees
 
 			bool has_leaves_ = false;  // if true, leaves array is nonempty and children is empty
+
+			// pending insertions (Bε-tree mode), empty without buffer_size
+			message_buffer<buffer_size> messages;
 	};
 
 }  // namespace dyn
\ No newline at end of file
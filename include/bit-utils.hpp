@@ -0,0 +1,209 @@
+#pragma once
+
+#include "cpu-features.hpp"
+#include "msvc.hpp"
+#include "popcount.hpp"
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#if DYN_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*
+ * bit-level helpers shared by the leaves and by the tree.
+ *
+ * Bit i of a packed array is bit (i mod 64) of word i / 64.
+ */
+
+namespace dyn {
+	/*
+	 * number of 64-bit words needed to store n bits
+	 */
+	inline uint64_t words_for(uint64_t const n) {
+		return (n >> 6) + ((n & 63) != 0);
+	}
+
+	/*
+	 * read 64 bits starting at bit position pos of src. Bits past the end of
+	 * the array must not be requested unless the array is padded.
+	 */
+	inline uint64_t read_word(const uint64_t* src, uint64_t const pos, uint64_t const nbits) {
+		auto const word = pos >> 6;
+		auto const offset = pos & 63;
+
+		if (!offset) return src[word];
+
+		uint64_t w = src[word] >> offset;
+
+		// the second word is touched only if it contains some of the requested bits
+		if (pos + 64 - offset < nbits) w |= src[word + 1] << (64 - offset);
+
+		return w;
+	}
+
+	/*
+	 * copy n bits starting at bit src_off of src (an array of src_bits bits)
+	 * into dst, starting at bit 0. dst must hold words_for(n) words; the bits
+	 * of the last word past n are cleared.
+	 */
+	inline void copy_bits(uint64_t* dst, const uint64_t* src, uint64_t const src_off,
+		uint64_t const n, uint64_t const src_bits) {
+		assert(src_off + n <= src_bits);
+
+		auto const full = n >> 6;
+
+		if ((src_off & 63) == 0) {
+			auto const first = src_off >> 6;
+			for (uint64_t j = 0; j < full; ++j) dst[j] = src[first + j];
+		}
+		else {
+			for (uint64_t j = 0; j < full; ++j) dst[j] = read_word(src, src_off + (j << 6), src_bits);
+		}
+
+		auto const rest = n & 63;
+		if (rest) {
+			dst[full] = read_word(src, src_off + (full << 6), src_bits) & ((uint64_t(1) << rest) - 1);
+		}
+	}
+
+	/*
+	 * append bits [from, to) of src (an array of src_bits bits) after the
+	 * dst_bits bits of dst. dst grows as needed; its bits past dst_bits must
+	 * be 0, and stay so.
+	 */
+	inline void append_bits(std::vector<uint64_t>& dst, uint64_t& dst_bits, const uint64_t* src,
+		uint64_t const from, uint64_t const to, uint64_t const src_bits) {
+		assert(from <= to and to <= src_bits);
+
+		dst.resize(words_for(dst_bits + to - from), 0);
+
+		for (uint64_t p = from; p < to; p += 64) {
+			uint64_t const n = to - p < 64 ? to - p : 64;
+
+			uint64_t w = read_word(src, p, src_bits);
+			if (n < 64) w &= (uint64_t(1) << n) - 1;
+
+			auto const word = dst_bits >> 6;
+			auto const offset = dst_bits & 63;
+
+			dst[word] |= w << offset;
+			if (offset and offset + n > 64) dst[word + 1] |= w >> (64 - offset);
+
+			dst_bits += n;
+		}
+	}
+
+	/*
+	 * select_in_byte.pos[b][k] = position of the k-th (0-based) bit set in byte b
+	 * (8 if b has at most k bits set)
+	 */
+	struct byte_select_table {
+		uint8_t pos[256][8] = {};
+
+		constexpr byte_select_table() {
+			for (unsigned b = 0; b < 256; ++b) {
+				unsigned k = 0;
+
+				for (unsigned i = 0; i < 8; ++i) {
+					if ((b >> i) & 1) pos[b][k++] = i;
+				}
+
+				for (; k < 8; ++k) pos[b][k] = 8;
+			}
+		}
+	};
+
+	inline constexpr byte_select_table select_in_byte{};
+
+	/*
+	 * broadword select: the byte holding the k-th bit set is found with
+	 * parallel prefix counts on the 8 bytes of w, the bit inside the byte
+	 * with a table lookup. Branch-free, and fast on every CPU.
+	 */
+	inline uint64_t select_in_word_broadword(uint64_t const w, uint64_t const k) {
+		assert(uint64_t(__builtin_popcountll(w)) > k);
+
+		constexpr uint64_t L8 = 0x0101010101010101;
+		constexpr uint64_t H8 = 0x8080808080808080;
+
+		// byte i of s = number of bits set in bytes 0, ..., i of w
+		uint64_t s = w - ((w >> 1) & 0x5555555555555555);
+		s = (s & 0x3333333333333333) + ((s >> 2) & 0x3333333333333333);
+		s = ((s + (s >> 4)) & 0x0F0F0F0F0F0F0F0F) * L8;
+
+		// high bit of byte i set iff byte i of s is > k. Counts are at most 64,
+		// so adding 127 - k to each byte never carries into the next one
+		uint64_t const byte = 8 - __builtin_popcountll((s + L8 * (127 - k)) & H8);
+		uint64_t const shift = byte << 3;
+
+		// bits set before the byte: byte (byte - 1) of s
+		uint64_t const before = ((s << 8) >> shift) & 0xFF;
+
+		return shift + select_in_byte.pos[(w >> shift) & 0xFF][k - before];
+	}
+
+#if DYN_X86_DISPATCH
+	/*
+	 * BMI2 select: PDEP deposits bit k on the k-th bit set of w
+	 */
+	DYN_TARGET("bmi,bmi2") inline uint64_t select_in_word_bmi2(uint64_t const w, uint64_t const k) {
+		assert(uint64_t(__builtin_popcountll(w)) > k);
+
+		return _tzcnt_u64(_pdep_u64(uint64_t(1) << k, w));
+	}
+#endif
+
+	/*
+	 * position of the k-th (0-based) bit set in w. w must have more than k
+	 * bits set.
+	 */
+	inline uint64_t select_in_word(uint64_t const w, uint64_t const k) {
+#if DYN_X86_DISPATCH
+		if (simd_enabled(simd_tier::avx2) and cpu.bmi2) return select_in_word_bmi2(w, k);
+#endif
+
+		return select_in_word_broadword(w, k);
+	}
+
+	/*
+	 * number of bits set among the first i bits of words
+	 */
+	inline uint64_t rank_words(const uint64_t* words, uint64_t const i) {
+		auto const max = i >> 6;
+		uint64_t s = popcount_words(words, max);
+
+		auto const mod = i & 63;
+		if (mod) s += __builtin_popcountll(words[max] & ((uint64_t(1) << mod) - 1));
+
+		return s;
+	}
+
+	/*
+	 * position of the x-th (1-based) bit set among the first nbits bits of
+	 * words. There must be at least x such bits.
+	 */
+	inline uint64_t select1_words(const uint64_t* words, uint64_t const nbits, uint64_t const x) {
+		assert(x > 0);
+
+		auto const prefix = words_below<word_weight::ones>(words, words_for(nbits), x);
+		assert(prefix.words < words_for(nbits));
+
+		return (prefix.words << 6) + select_in_word(words[prefix.words], x - prefix.weight - 1);
+	}
+
+	/*
+	 * position of the x-th (1-based) bit not set among the first nbits bits
+	 * of words. There must be at least x such bits.
+	 */
+	inline uint64_t select0_words(const uint64_t* words, uint64_t const nbits, uint64_t const x) {
+		assert(x > 0);
+
+		// bits past nbits are 0 but are never reached, since x is in range
+		auto const prefix = words_below<word_weight::zeros>(words, words_for(nbits), x);
+		assert(prefix.words < words_for(nbits));
+
+		return (prefix.words << 6) + select_in_word(~words[prefix.words], x - prefix.weight - 1);
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <initializer_list>
+
+/*
+ * fixed-capacity array of child pointers, stored inline in the internal
+ * nodes of b_spsi next to their counters. It has the subset of the
+ * std::vector interface the nodes use; insert and erase shift the following
+ * pointers in place.
+ *
+ * It is trivially copyable, so that a node can keep its node and leaf
+ * children in a union and switch between them by assignment.
+ */
+
+namespace dyn {
+	template <class T, uint32_t N> class child_array {
+	public:
+		using value_type = T;
+		using iterator = T*;
+		using const_iterator = const T*;
+
+		child_array() = default;
+
+		explicit child_array(uint32_t const n, T const value = T()) : n_(n) {
+			assert(n <= N);
+			std::fill(items, items + n, value);
+		}
+
+		child_array(const T* first, const T* last) : n_(last - first) {
+			assert(n_ <= N);
+			std::copy(first, last, items);
+		}
+
+		child_array(std::initializer_list<T> l) : child_array(l.begin(), l.end()) {}
+
+		uint32_t size() const { return n_; }
+		static constexpr uint32_t capacity() { return N; }
+		bool empty() const { return n_ == 0; }
+
+		T& operator[](uint32_t const i) {
+			assert(i < n_);
+			return items[i];
+		}
+
+		const T& operator[](uint32_t const i) const {
+			assert(i < n_);
+			return items[i];
+		}
+
+		T* data() { return items; }
+		const T* data() const { return items; }
+
+		iterator begin() { return items; }
+		iterator end() { return items + n_; }
+		const_iterator begin() const { return items; }
+		const_iterator end() const { return items + n_; }
+
+		T& front() { return (*this)[0]; }
+		T& back() { return (*this)[n_ - 1]; }
+		const T& front() const { return (*this)[0]; }
+		const T& back() const { return (*this)[n_ - 1]; }
+
+		void push_back(T const x) {
+			assert(n_ < N);
+			items[n_++] = x;
+		}
+
+		void pop_back() {
+			assert(n_ > 0);
+			--n_;
+		}
+
+		/*
+		 * insert x before pos
+		 */
+		iterator insert(iterator const pos, T const x) {
+			assert(n_ < N and pos >= begin() and pos <= end());
+
+			std::copy_backward(pos, end(), end() + 1);
+			*pos = x;
+			++n_;
+
+			return pos;
+		}
+
+		/*
+		 * insert [first, last) before pos. The range must not be in this array.
+		 */
+		iterator insert(iterator const pos, const T* first, const T* last) {
+			uint32_t const k = last - first;
+
+			assert(n_ + k <= N and pos >= begin() and pos <= end());
+
+			std::copy_backward(pos, end(), end() + k);
+			std::copy(first, last, pos);
+			n_ += k;
+
+			return pos;
+		}
+
+		iterator erase(iterator const pos) { return erase(pos, pos + 1); }
+
+		iterator erase(iterator const first, iterator const last) {
+			assert(first >= begin() and first <= last and last <= end());
+
+			std::copy(last, end(), first);
+			n_ -= last - first;
+
+			return first;
+		}
+
+		void resize(uint32_t const n, T const value = T()) {
+			assert(n <= N);
+
+			if (n > n_) std::fill(items + n_, items + n, value);
+			n_ = n;
+		}
+
+		void clear() { n_ = 0; }
+
+	private:
+		uint32_t n_ = 0;
+		T items[N];
+	};
+}
@@ -0,0 +1,516 @@
+#pragma once
+
+#include "cpu-features.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+
+#if DYN_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*
+ * kernels over the cumulative counters of the internal nodes: child search
+ * and counter updates. As the popcount kernels, they have one version per
+ * tier of cpu-features.hpp, picked at run time.
+ *
+ * Counters are uint64_t, or uint32_t in the nodes with compact counters
+ * (see basic_b_spsi). The search kernels widen uint32_t counters to 64 bits
+ * on load, so that the derived counters cannot overflow. Counters are below
+ * 2^63, so that the signed 64-bit compares of SSE4.2 and AVX2 order them
+ * correctly.
+ */
+
+namespace dyn {
+	/*
+	 * counter searched by a child search, from the two counter arrays a and
+	 * b of a node: a[k] (sizes for find_child, psums for find_1),
+	 * a[k] - b[k] (zeros: sizes - psums, for find_0), a[k] + b[k]
+	 * (psums + sizes, for find_r) or 2 a[k] - b[k] (sizes + psums, from
+	 * sizes and zeros, for find_r). All are non-decreasing in k.
+	 * For counter_of::a, b is not read: pass a again. a and b may have
+	 * different counter types (see counter-layout.hpp).
+	 */
+	enum class counter_of { a, a_minus_b, a_plus_b, twice_a_minus_b };
+
+	template <counter_of op, class T, class U> inline uint64_t combine(const T* a, const U* b, uint32_t const k) {
+		if constexpr (op == counter_of::a) return a[k];
+		else if constexpr (op == counter_of::a_minus_b) return uint64_t(a[k]) - b[k];
+		else if constexpr (op == counter_of::a_plus_b) return uint64_t(a[k]) + b[k];
+		else return 2 * uint64_t(a[k]) - b[k];
+	}
+
+	/*
+	 * below this many counters, child search counts the counters not
+	 * greater than the key instead of halving the range further
+	 */
+	constexpr uint32_t counter_scan_window = 16;
+
+	/*
+	 * branchless binary search on the counters [0, n): on exit the first
+	 * counter greater than i is in [low, low + size], and size <= window
+	 */
+	template <counter_of op, class T, class U>
+	inline void narrow_counters(const T* a, const U* b, uint64_t const i, uint32_t& low,
+		uint32_t& size, uint32_t const window) {
+		while (size > window) {
+			uint32_t half = size / 2;
+			uint32_t other_half = size - half;
+			uint32_t probe = low + half;
+			uint32_t other_low = low + other_half;
+			uint64_t v = combine<op>(a, b, probe);
+			size = half;
+			low = v > i ? low : other_low;
+		}
+	}
+
+	/*
+	 * early-exit scan from the first counter
+	 */
+	template <counter_of op, class T, class U>
+	inline uint32_t first_greater_linear(const T* a, const U* b, uint32_t const n, uint64_t const i) {
+		uint32_t k = 0;
+		while (k < n and combine<op>(a, b, k) <= i) ++k;
+
+		return k;
+	}
+
+	template <counter_of op, class T, class U>
+	inline uint32_t first_greater_scalar(const T* a, const U* b, uint32_t const n, uint64_t const i,
+		uint32_t = 0) {
+		uint32_t low = 0;
+		uint32_t size = n;
+
+		narrow_counters<op>(a, b, i, low, size, 0);
+
+		return low;
+	}
+
+	template <class T> inline void add_to_counters_scalar(T* c, uint32_t from, uint32_t const to, uint64_t const delta) {
+		for (; from < to; ++from) c[from] += delta;
+	}
+
+#if DYN_X86_DISPATCH
+	/*
+	 * 2 counters, as 64-bit lanes
+	 */
+	DYN_TARGET("sse4.2") inline __m128i widen2(const uint64_t* c) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(c));
+	}
+
+	DYN_TARGET("sse4.2") inline __m128i widen2(const uint32_t* c) {
+		return _mm_cvtepu32_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(c)));
+	}
+
+	template <counter_of op, class T, class U> DYN_TARGET("sse4.2") inline __m128i load2(const T* a, const U* b) {
+		__m128i const va = widen2(a);
+		if constexpr (op == counter_of::a) return va;
+
+		__m128i const vb = widen2(b);
+		if constexpr (op == counter_of::a_minus_b) return _mm_sub_epi64(va, vb);
+		else if constexpr (op == counter_of::a_plus_b) return _mm_add_epi64(va, vb);
+		else return _mm_sub_epi64(_mm_add_epi64(va, va), vb);
+	}
+
+	/*
+	 * the binary search stops at window counters, which are then compared
+	 * to i 2 at a time: the answer is low + the number not greater than i
+	 */
+	template <counter_of op, class T, class U>
+	DYN_TARGET("sse4.2") inline uint32_t first_greater_sse42(const T* a, const U* b, uint32_t const n,
+		uint64_t const i, uint32_t const window = counter_scan_window) {
+		uint32_t low = 0;
+		uint32_t size = n;
+
+		narrow_counters<op>(a, b, i, low, size, window);
+
+		__m128i const key = _mm_set1_epi64x(i);
+		__m128i greater = _mm_setzero_si128();
+		uint32_t k = low;
+		uint32_t const end = low + size;
+
+		for (; k + 2 <= end; k += 2) {
+			greater = _mm_sub_epi64(greater, _mm_cmpgt_epi64(load2<op>(a + k, b + k), key));
+		}
+
+		uint64_t nr_greater = uint64_t(_mm_cvtsi128_si64(greater)) + uint64_t(_mm_extract_epi64(greater, 1));
+		if (k < end) nr_greater += combine<op>(a, b, k) > i;
+
+		return end - nr_greater;
+	}
+
+	DYN_TARGET("sse4.2") inline void add_to_counters_sse42(uint64_t* c, uint32_t from, uint32_t const to,
+		uint64_t const delta) {
+		__m128i const d = _mm_set1_epi64x(delta);
+
+		for (; from + 2 <= to; from += 2) {
+			__m128i* p = reinterpret_cast<__m128i*>(c + from);
+			_mm_storeu_si128(p, _mm_add_epi64(_mm_loadu_si128(p), d));
+		}
+
+		if (from < to) c[from] += delta;
+	}
+
+	DYN_TARGET("sse4.2") inline void add_to_counters_sse42(uint32_t* c, uint32_t from, uint32_t const to,
+		uint64_t const delta) {
+		__m128i const d = _mm_set1_epi32(uint32_t(delta));
+
+		for (; from + 4 <= to; from += 4) {
+			__m128i* p = reinterpret_cast<__m128i*>(c + from);
+			_mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), d));
+		}
+
+		for (; from < to; ++from) c[from] += delta;
+	}
+
+	DYN_TARGET("avx2") inline __m256i widen4(const uint64_t* c) {
+		return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c));
+	}
+
+	DYN_TARGET("avx2") inline __m256i widen4(const uint32_t* c) {
+		return _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c)));
+	}
+
+	template <counter_of op, class T, class U> DYN_TARGET("avx2") inline __m256i load4(const T* a, const U* b) {
+		__m256i const va = widen4(a);
+		if constexpr (op == counter_of::a) return va;
+
+		__m256i const vb = widen4(b);
+		if constexpr (op == counter_of::a_minus_b) return _mm256_sub_epi64(va, vb);
+		else if constexpr (op == counter_of::a_plus_b) return _mm256_add_epi64(va, vb);
+		else return _mm256_sub_epi64(_mm256_add_epi64(va, va), vb);
+	}
+
+	template <counter_of op, class T, class U>
+	DYN_TARGET("avx2") inline uint32_t first_greater_avx2(const T* a, const U* b, uint32_t const n,
+		uint64_t const i, uint32_t const window = counter_scan_window) {
+		uint32_t low = 0;
+		uint32_t size = n;
+
+		narrow_counters<op>(a, b, i, low, size, window);
+
+		__m256i const key = _mm256_set1_epi64x(i);
+		__m256i greater = _mm256_setzero_si256();
+		uint32_t k = low;
+		uint32_t const end = low + size;
+
+		for (; k + 4 <= end; k += 4) {
+			greater = _mm256_sub_epi64(greater, _mm256_cmpgt_epi64(load4<op>(a + k, b + k), key));
+		}
+
+		__m128i const g = _mm_add_epi64(_mm256_castsi256_si128(greater), _mm256_extracti128_si256(greater, 1));
+		uint64_t nr_greater = uint64_t(_mm_cvtsi128_si64(g)) + uint64_t(_mm_extract_epi64(g, 1));
+
+		for (; k < end; ++k) nr_greater += combine<op>(a, b, k) > i;
+
+		return end - nr_greater;
+	}
+
+	DYN_TARGET("avx2") inline void add_to_counters_avx2(uint64_t* c, uint32_t from, uint32_t const to,
+		uint64_t const delta) {
+		__m256i const d = _mm256_set1_epi64x(delta);
+
+		for (; from + 4 <= to; from += 4) {
+			__m256i* p = reinterpret_cast<__m256i*>(c + from);
+			_mm256_storeu_si256(p, _mm256_add_epi64(_mm256_loadu_si256(p), d));
+		}
+
+		for (; from < to; ++from) c[from] += delta;
+	}
+
+	DYN_TARGET("avx2") inline void add_to_counters_avx2(uint32_t* c, uint32_t from, uint32_t const to,
+		uint64_t const delta) {
+		__m256i const d = _mm256_set1_epi32(uint32_t(delta));
+
+		for (; from + 8 <= to; from += 8) {
+			__m256i* p = reinterpret_cast<__m256i*>(c + from);
+			_mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), d));
+		}
+
+		for (; from < to; ++from) c[from] += delta;
+	}
+
+	/*
+	 * the counters of mask (up to 8), as 64-bit lanes
+	 */
+	DYN_TARGET("avx512f") inline __m512i widen8(__mmask8 const mask, const uint64_t* c) {
+		return _mm512_maskz_loadu_epi64(mask, c);
+	}
+
+	DYN_TARGET("avx512f") inline __m512i widen8(__mmask8 const mask, const uint32_t* c) {
+		__m512i const v = _mm512_maskz_loadu_epi32(mask, c);
+
+		// maskz conversion: the plain one trips -Wmaybe-uninitialized in GCC 12
+		return _mm512_maskz_cvtepu32_epi64(mask, _mm512_maskz_extracti64x4_epi64(0xF, v, 0));
+	}
+
+	template <counter_of op, class T, class U>
+	DYN_TARGET("avx512f") inline __m512i load8(__mmask8 const mask, const T* a, const U* b) {
+		__m512i const va = widen8(mask, a);
+		if constexpr (op == counter_of::a) return va;
+
+		__m512i const vb = widen8(mask, b);
+		if constexpr (op == counter_of::a_minus_b) return _mm512_sub_epi64(va, vb);
+		else if constexpr (op == counter_of::a_plus_b) return _mm512_add_epi64(va, vb);
+		else return _mm512_sub_epi64(_mm512_add_epi64(va, va), vb);
+	}
+
+	template <counter_of op, class T, class U>
+	DYN_TARGET("avx512f,popcnt") inline uint32_t first_greater_avx512(const T* a, const U* b,
+		uint32_t const n, uint64_t const i, uint32_t const window = counter_scan_window) {
+		uint32_t low = 0;
+		uint32_t size = n;
+
+		narrow_counters<op>(a, b, i, low, size, window);
+
+		__m512i const key = _mm512_set1_epi64(i);
+		uint32_t nr_greater = 0;
+
+		// masked loads: no scalar tail
+		for (uint32_t k = 0; k < size; k += 8) {
+			__mmask8 const mask = size - k >= 8 ? 0xFF : (1u << (size - k)) - 1;
+			__m512i const v = load8<op>(mask, a + low + k, b + low + k);
+			nr_greater += _mm_popcnt_u32(_mm512_mask_cmpgt_epu64_mask(mask, v, key));
+		}
+
+		return low + size - nr_greater;
+	}
+
+	DYN_TARGET("avx512f") inline void add_to_counters_avx512(uint64_t* c, uint32_t from, uint32_t const to,
+		uint64_t const delta) {
+		__m512i const d = _mm512_set1_epi64(delta);
+
+		for (; from < to; from += 8) {
+			__mmask8 const mask = to - from >= 8 ? 0xFF : (1u << (to - from)) - 1;
+			__m512i const v = _mm512_maskz_loadu_epi64(mask, c + from);
+			_mm512_mask_storeu_epi64(c + from, mask, _mm512_add_epi64(v, d));
+		}
+	}
+
+	DYN_TARGET("avx512f") inline void add_to_counters_avx512(uint32_t* c, uint32_t from, uint32_t const to,
+		uint64_t const delta) {
+		__m512i const d = _mm512_set1_epi32(uint32_t(delta));
+
+		for (; from < to; from += 16) {
+			__mmask16 const mask = to - from >= 16 ? 0xFFFF : (1u << (to - from)) - 1;
+			__m512i const v = _mm512_maskz_loadu_epi32(mask, c + from);
+			_mm512_mask_storeu_epi32(c + from, mask, _mm512_add_epi32(v, d));
+		}
+	}
+#endif
+
+	/*
+	 * index of the first of the non-decreasing counters [0, n) that is
+	 * greater than i, n if there is none. The binary search stops at window
+	 * counters, which are compared to i with the SIMD instructions of the
+	 * active tier.
+	 */
+	template <counter_of op, class T, class U>
+	inline uint32_t first_greater(const T* a, const U* b, uint32_t const n, uint64_t const i,
+		uint32_t const window = counter_scan_window) {
+#if DYN_X86_DISPATCH
+		if (simd_enabled(simd_tier::avx512)) return first_greater_avx512<op>(a, b, n, i, window);
+		if (simd_enabled(simd_tier::avx2)) return first_greater_avx2<op>(a, b, n, i, window);
+		if (simd_enabled(simd_tier::sse42)) return first_greater_sse42<op>(a, b, n, i, window);
+#endif
+
+		return first_greater_scalar<op>(a, b, n, i);
+	}
+
+	/*
+	 * c[k] += delta for k in [from, to)
+	 */
+	template <class T> inline void add_to_counters(T* c, uint32_t const from, uint32_t const to, uint64_t const delta) {
+		assert(from <= to);
+
+#if DYN_X86_DISPATCH
+		if (simd_enabled(simd_tier::avx512)) return add_to_counters_avx512(c, from, to, delta);
+		if (simd_enabled(simd_tier::avx2)) return add_to_counters_avx2(c, from, to, delta);
+		if (simd_enabled(simd_tier::sse42)) return add_to_counters_sse42(c, from, to, delta);
+#endif
+
+		add_to_counters_scalar(c, from, to, delta);
+	}
+
+	/*
+	 * child search policies of b_spsi. search<op>(a, b, n, i) is the index of
+	 * the first counter greater than i among the n counters of a node
+	 * (uint64_t or uint32_t).
+	 */
+
+	/*
+	 * early-exit linear scan
+	 */
+	struct linear_child_search {
+		template <counter_of op, class T, class U>
+		static uint32_t search(const T* a, const U* b, uint32_t n, uint64_t i) {
+			return first_greater_linear<op>(a, b, n, i);
+		}
+	};
+
+	/*
+	 * branchless binary search, without SIMD
+	 */
+	struct binary_child_search {
+		template <counter_of op, class T, class U>
+		static uint32_t search(const T* a, const U* b, uint32_t n, uint64_t i) {
+			return first_greater_scalar<op>(a, b, n, i);
+		}
+	};
+
+	/*
+	 * SIMD count of the counters not greater than the key, over all the
+	 * counters of the node: no branch at all, but linear in the node size
+	 */
+	struct simd_count_child_search {
+		template <counter_of op, class T, class U>
+		static uint32_t search(const T* a, const U* b, uint32_t n, uint64_t i) {
+			return first_greater<op>(a, b, n, i, UINT32_MAX);
+		}
+	};
+
+	/*
+	 * branchless binary search down to window counters, then a SIMD count
+	 * over them (the default)
+	 */
+	template <uint32_t window = counter_scan_window> struct simd_child_search {
+		template <counter_of op, class T, class U>
+		static uint32_t search(const T* a, const U* b, uint32_t n, uint64_t i) {
+			return first_greater<op>(a, b, n, i, window);
+		}
+	};
+
+	/*
+	 * S-tree style index of the two counter arrays of a node, for
+	 * blocked_child_search. Level 0 holds the last counter of each full block
+	 * of block counters, level l + 1 the last entry of each full block of level
+	 * l, up to a level of at most block entries. A search scans one block per
+	 * level from the top, then one block of counters: with block = 8 and
+	 * 64-bit counters, one cache line per level instead of one per probe of a
+	 * binary search over the node.
+	 *
+	 * The index is a copy: sync() rebuilds it after the counters change.
+	 */
+	template <class T, class U, uint32_t N, uint32_t block> class counter_blocks {
+		static_assert(block > 1, "blocks must hold at least two counters");
+
+		static constexpr uint32_t capacity() {
+			uint32_t c = 0;
+			for (uint32_t m = N / block; m > 0; m /= block) c += m;
+
+			return c;
+		}
+
+		static constexpr uint32_t max_levels() {
+			uint32_t l = 0;
+			for (uint32_t m = N; m > block; m /= block) ++l;
+
+			return l;
+		}
+
+	public:
+		static constexpr bool indexed = true;
+
+		/*
+		 * index the counters [0, n) of the arrays a and b
+		 */
+		void sync(const T* a, const U* b, uint32_t const n) {
+			levels = 0;
+
+			uint32_t off = 0;
+			uint32_t len = n;
+
+			while (len > block) {
+				uint32_t const m = len / block;
+
+				for (uint32_t k = 0; k < m; ++k) {
+					a_samples[off + k] = a[k * block + block - 1];
+					b_samples[off + k] = b[k * block + block - 1];
+				}
+
+				offset[levels] = off;
+				length[levels] = m;
+				++levels;
+
+				a = a_samples.data() + off;
+				b = b_samples.data() + off;
+				off += m;
+				len = m;
+			}
+		}
+
+		const T* a() const { return a_samples.data(); }
+		const U* b() const { return b_samples.data(); }
+
+		/*
+		 * first of the counters [0, n) of a and b greater than i, n if there is
+		 * none. sa and sb are the samples of a and b: a() or b() of this index,
+		 * in the role of a and b for op.
+		 */
+		template <counter_of op, class A, class B>
+		uint32_t search(const A* a, const B* b, const A* sa, const B* sb, uint32_t const n, uint64_t const i) const {
+			uint32_t k = 0;  // block of the level below
+
+			for (uint32_t l = levels; l-- > 0;) {
+				uint32_t const from = k * block;
+				uint32_t const to = std::min(from + block, length[l]);
+
+				k = from + count_not_greater<op>(sa + offset[l], sb + offset[l], from, to, i);
+			}
+
+			uint32_t const from = k * block;
+			uint32_t const to = std::min(from + block, n);
+
+			return from + count_not_greater<op>(a, b, from, to, i);
+		}
+
+	private:
+		/*
+		 * number of the counters [from, to) not greater than i: a block, short
+		 * enough for a branch-free scalar count
+		 */
+		template <counter_of op, class A, class B>
+		static uint32_t count_not_greater(const A* a, const B* b, uint32_t from, uint32_t const to, uint64_t const i) {
+			uint32_t c = 0;
+			for (; from < to; ++from) c += combine<op>(a, b, from) <= i;
+
+			return c;
+		}
+
+		std::array<T, capacity()> a_samples;
+		std::array<U, capacity()> b_samples;
+		std::array<uint32_t, max_levels() + 1> offset;
+		std::array<uint32_t, max_levels() + 1> length;
+		uint32_t levels = 0;
+	};
+
+	/*
+	 * searches an S-tree style index of the counters (counter_blocks),
+	 * copied in each node and rebuilt when its counters change: for wide
+	 * nodes, where a binary search touches a cache line per probe
+	 */
+	template <uint32_t block = 8> struct blocked_child_search {
+		template <class T, class U, uint32_t N> using index = counter_blocks<T, U, N, block>;
+	};
+
+	/*
+	 * the index of the counters a node keeps for its child search policy: none,
+	 * unless the policy has an index type
+	 */
+	struct no_counter_index {
+		static constexpr bool indexed = false;
+
+		template <class T, class U> void sync(const T*, const U*, uint32_t) {}
+	};
+
+	template <class child_search, class T, class U, uint32_t N, class = void> struct counter_index_of {
+		using type = no_counter_index;
+	};
+
+	template <class child_search, class T, class U, uint32_t N>
+	struct counter_index_of<child_search, T, U, N, std::void_t<typename child_search::template index<T, U, N>>> {
+		using type = typename child_search::template index<T, U, N>;
+	};
+}
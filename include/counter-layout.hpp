@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+/*
+ * counter layouts of the internal nodes of basic_b_spsi. Next to the
+ * cumulative sizes of its subtrees, a node keeps one more cumulative counter
+ * per subtree, from which the partial sums (the ones, in a bitvector) and
+ * the zeros are derived:
+ *
+ *	ones_counters    the partial sums: rank and select read them directly,
+ *	                 select0 subtracts them from the sizes
+ *	zeros_counters   sizes minus partial sums: select0 searches them
+ *	                 directly, rank and select subtract them from the sizes
+ *
+ * second_type is the integer type of that second array (void: the counter
+ * type of the tree). A bitvector whose ones (or zeros) stay below 2^32 can
+ * keep 64-bit sizes and a 32-bit second array.
+ *
+ * A layout maps a (size, partial sum) pair to its second counter and back.
+ * Both maps are linear, so they also map differences (modulo 2^64): a
+ * subtree that grows by n integers summing to s changes its second counter
+ * by second(n, s).
+ */
+
+namespace dyn {
+	template <class second_type = void> struct ones_counters {
+		static constexpr bool stores_zeros = false;
+
+		template <class counter_type>
+		using type = std::conditional_t<std::is_void_v<second_type>, counter_type, second_type>;
+
+		static uint64_t second(uint64_t, uint64_t psum) { return psum; }
+		static uint64_t psum(uint64_t, uint64_t second) { return second; }
+	};
+
+	template <class second_type = void> struct zeros_counters {
+		static constexpr bool stores_zeros = true;
+
+		template <class counter_type>
+		using type = std::conditional_t<std::is_void_v<second_type>, counter_type, second_type>;
+
+		static uint64_t second(uint64_t size, uint64_t psum) { return size - psum; }
+		static uint64_t psum(uint64_t size, uint64_t second) { return size - second; }
+	};
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "msvc.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+/*
+ * instruction set extensions of the CPU we are running on, detected once at
+ * startup. Kernels using an extension are compiled for it with a target
+ * attribute and are only called when the extension is present, so that the
+ * same binary runs on hosts that lack it. POPCNT is the exception: the build
+ * assumes it (-mpopcnt), for the single-word popcounts all over the leaves.
+ *
+ * Kernels come in tiers (scalar, SSE4.2, AVX2, AVX-512). The highest tier
+ * the host supports is used, unless a lower one is forced, either with
+ * force_simd_tier or with the DYN_SIMD_TIER environment variable (scalar,
+ * sse42, avx2 or avx512), e.g. to compare the tiers in a benchmark.
+ */
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DYN_X86_DISPATCH 1
+#define DYN_TARGET(ext) __attribute__((target(ext)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define DYN_X86_DISPATCH 1
+// MSVC emits any intrinsic without a target flag
+#define DYN_TARGET(ext)
+#else
+#define DYN_X86_DISPATCH 0
+#define DYN_TARGET(ext)
+#endif
+
+namespace dyn {
+	struct cpu_features {
+		bool sse42 = false;  // SSE4.2 and POPCNT
+		bool bmi2 = false;
+		bool avx2 = false;
+		bool avx512 = false;  // AVX-512F
+		bool avx512_popcnt = false;  // AVX-512F and VPOPCNTDQ
+	};
+
+	inline cpu_features detect_cpu_features() {
+		cpu_features f;
+
+#if DYN_X86_DISPATCH && defined(_MSC_VER) && !defined(__clang__)
+		int regs[4];
+		__cpuid(regs, 0);
+
+		int const max_leaf = regs[0];
+
+		// the OS must save the AVX (and AVX-512) registers on context switch
+		__cpuid(regs, 1);
+		f.sse42 = ((regs[2] >> 20) & 1) and ((regs[2] >> 23) & 1);
+
+		bool const osxsave = (regs[2] >> 27) & 1;
+		uint64_t const xcr0 = osxsave ? _xgetbv(0) : 0;
+		bool const ymm = (xcr0 & 0x6) == 0x6;
+		bool const zmm = (xcr0 & 0xE6) == 0xE6;
+
+		if (max_leaf >= 7) {
+			__cpuidex(regs, 7, 0);
+			f.bmi2 = (regs[1] >> 8) & 1;
+			f.avx2 = ymm and ((regs[1] >> 5) & 1);
+			f.avx512 = zmm and ((regs[1] >> 16) & 1);
+			f.avx512_popcnt = f.avx512 and ((regs[2] >> 14) & 1);
+		}
+#elif DYN_X86_DISPATCH
+		__builtin_cpu_init();
+		f.sse42 = __builtin_cpu_supports("sse4.2") and __builtin_cpu_supports("popcnt");
+		f.bmi2 = __builtin_cpu_supports("bmi2");
+		f.avx2 = __builtin_cpu_supports("avx2");
+		f.avx512 = __builtin_cpu_supports("avx512f");
+		f.avx512_popcnt = f.avx512 and __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+
+		return f;
+	}
+
+	/*
+	 * features of the host, shared by all translation units
+	 */
+	inline const cpu_features cpu = detect_cpu_features();
+
+	enum class simd_tier { scalar, sse42, avx2, avx512 };
+
+	/*
+	 * highest tier the host supports
+	 */
+	inline simd_tier supported_simd_tier() {
+		if (cpu.avx512 and cpu.avx2 and cpu.sse42) return simd_tier::avx512;
+		if (cpu.avx2 and cpu.sse42) return simd_tier::avx2;
+		if (cpu.sse42) return simd_tier::sse42;
+		return simd_tier::scalar;
+	}
+
+	/*
+	 * the supported tier, lowered to DYN_SIMD_TIER if that is set
+	 */
+	inline simd_tier initial_simd_tier() {
+		auto const supported = supported_simd_tier();
+		const char* forced = std::getenv("DYN_SIMD_TIER");
+
+		if (forced == NULL) return supported;
+
+		simd_tier t = supported;
+		if (std::strcmp(forced, "scalar") == 0) t = simd_tier::scalar;
+		else if (std::strcmp(forced, "sse42") == 0) t = simd_tier::sse42;
+		else if (std::strcmp(forced, "avx2") == 0) t = simd_tier::avx2;
+
+		return t < supported ? t : supported;
+	}
+
+	/*
+	 * tier in use. Only change it through force_simd_tier.
+	 */
+	inline simd_tier active_simd_tier = initial_simd_tier();
+
+	/*
+	 * use tier t (or the highest supported one, if t is not supported) from
+	 * now on. Not thread-safe: call it before any query runs.
+	 */
+	inline void force_simd_tier(simd_tier const t) {
+		auto const supported = supported_simd_tier();
+		active_simd_tier = t < supported ? t : supported;
+	}
+
+	/*
+	 * true iff kernels of tier t may be used
+	 */
+	inline bool simd_enabled(simd_tier const t) {
+		return active_simd_tier >= t;
+	}
+
+	inline const char* simd_tier_name(simd_tier const t) {
+		switch (t) {
+		case simd_tier::scalar: return "scalar";
+		case simd_tier::sse42: return "sse42";
+		case simd_tier::avx2: return "avx2";
+		default: return "avx512";
+		}
+	}
+}
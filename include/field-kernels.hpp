@@ -0,0 +1,167 @@
+#pragma once
+
+#include "cpu-features.hpp"
+#include "popcount.hpp"
+#include <cassert>
+#include <cstdint>
+
+#if DYN_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*
+ * kernels over arrays of words packing integers in fields of width 1, 2, 4,
+ * ..., 64 bits (no field straddles two words): the sum of the fields, and
+ * the prefix scan that search uses to skip the words before its answer.
+ * The fields of a word are summed in log(64 / width) steps, adding adjacent
+ * fields into fields twice as wide (SWAR); the AVX2 versions do that for 4
+ * words at a time. Width 1 goes to the popcount kernels. As those, the
+ * version of the active tier (see cpu-features.hpp) is picked at run time.
+ */
+
+namespace dyn {
+	/*
+	 * the low f bits of every 2f-bit lane, for f = 1, 2, 4, ..., 32
+	 */
+	inline constexpr uint64_t low_lanes[6] = {
+		0x5555555555555555ull, 0x3333333333333333ull, 0x0F0F0F0F0F0F0F0Full,
+		0x00FF00FF00FF00FFull, 0x0000FFFF0000FFFFull, 0x00000000FFFFFFFFull };
+
+	/*
+	 * log2 of a field width
+	 */
+	inline uint32_t width_log(uint32_t const width) {
+		assert(width > 0 and width <= 64 and (width & (width - 1)) == 0);
+
+		return __builtin_ctz(width);
+	}
+
+	/*
+	 * sum of the fields of word w
+	 */
+	inline uint64_t field_sum(uint64_t w, uint32_t const width) {
+		if (width == 1) return __builtin_popcountll(w);
+
+		for (uint32_t k = width_log(width); k < 6; ++k) w = (w & low_lanes[k]) + ((w >> (1u << k)) & low_lanes[k]);
+
+		return w;
+	}
+
+	/*
+	 * what a word of fields weighs in a prefix scan: the sum of its fields
+	 * (word_weight::ones), or that plus its number of fields
+	 * (word_weight::ones_plus_bits, the psum(j) + j of search_r)
+	 */
+	template <word_weight wt> inline uint64_t weigh_fields(uint64_t const sum, uint64_t const nr_words, uint32_t const width) {
+		static_assert(wt != word_weight::zeros, "fields have no complement");
+
+		if constexpr (wt == word_weight::ones) return sum;
+		else return sum + (nr_words << 6 >> width_log(width));
+	}
+
+	inline uint64_t field_sum_words_scalar(const uint64_t* words, uint64_t const n, uint32_t const width) {
+		uint64_t s = 0;
+
+		for (uint64_t j = 0; j < n; ++j) s += field_sum(words[j], width);
+
+		return s;
+	}
+
+	template <word_weight wt>
+	inline word_prefix field_words_below_scalar(const uint64_t* words, uint64_t const n, uint32_t const width,
+		uint64_t const x) {
+		uint64_t s = 0;
+		uint64_t j = 0;
+
+		for (; j < n; ++j) {
+			auto const w = weigh_fields<wt>(field_sum(words[j], width), 1, width);
+			if (s + w >= x) break;
+			s += w;
+		}
+
+		return { j, s };
+	}
+
+#if DYN_X86_DISPATCH
+	/*
+	 * field sums of the 4 words of v, widths 2 to 64
+	 */
+	DYN_TARGET("avx2") inline __m256i field_sum4_avx2(__m256i v, uint32_t const width) {
+		for (uint32_t k = width_log(width); k < 6; ++k) {
+			__m256i const mask = _mm256_set1_epi64x(low_lanes[k]);
+			__m256i const high = _mm256_srl_epi64(v, _mm_cvtsi32_si128(1u << k));
+
+			v = _mm256_add_epi64(_mm256_and_si256(v, mask), _mm256_and_si256(high, mask));
+		}
+
+		return v;
+	}
+
+	DYN_TARGET("avx2") inline uint64_t field_sum_words_avx2(const uint64_t* words, uint64_t const n,
+		uint32_t const width) {
+		__m256i acc = _mm256_setzero_si256();
+		uint64_t j = 0;
+
+		for (; j + 4 <= n; j += 4) {
+			acc = _mm256_add_epi64(acc, field_sum4_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + j)), width));
+		}
+
+		uint64_t s = sum4_avx2(acc);
+		for (; j < n; ++j) s += field_sum(words[j], width);
+
+		return s;
+	}
+
+	template <word_weight wt>
+	DYN_TARGET("avx2") inline word_prefix field_words_below_avx2(const uint64_t* words, uint64_t const n,
+		uint32_t const width, uint64_t const x) {
+		uint64_t s = 0;
+		uint64_t j = 0;
+
+		// whole blocks of 4 words, then word by word in the block reaching x
+		for (; j + 4 <= n; j += 4) {
+			auto const sum = sum4_avx2(field_sum4_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + j)), width));
+			auto const w = weigh_fields<wt>(sum, 4, width);
+			if (s + w >= x) break;
+			s += w;
+		}
+
+		for (; j < n; ++j) {
+			auto const w = weigh_fields<wt>(field_sum(words[j], width), 1, width);
+			if (s + w >= x) break;
+			s += w;
+		}
+
+		return { j, s };
+	}
+#endif
+
+	/*
+	 * sum of the fields of words[0, n)
+	 */
+	inline uint64_t field_sum_words(const uint64_t* words, uint64_t const n, uint32_t const width) {
+		if (width == 1) return popcount_words(words, n);
+
+#if DYN_X86_DISPATCH
+		if (simd_enabled(simd_tier::avx2)) return field_sum_words_avx2(words, n, width);
+#endif
+
+		return field_sum_words_scalar(words, n, width);
+	}
+
+	/*
+	 * longest prefix of words[0, n) weighing less than x, with its weight.
+	 * If it is shorter than n, the x-th unit of weight is in the next word.
+	 */
+	template <word_weight wt>
+	inline word_prefix field_words_below(const uint64_t* words, uint64_t const n, uint32_t const width,
+		uint64_t const x) {
+		if (width == 1) return words_below<wt>(words, n, x);
+
+#if DYN_X86_DISPATCH
+		if (simd_enabled(simd_tier::avx2)) return field_words_below_avx2<wt>(words, n, width, x);
+#endif
+
+		return field_words_below_scalar<wt>(words, n, width, x);
+	}
+}
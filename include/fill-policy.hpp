@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+/*
+ * fill policies of basic_b_spsi: how full its leaves and nodes are kept.
+ * A leaf holds up to 2 * B_LEAF integers and a node up to 2B + 2 children;
+ * the policy sets, as percents of that capacity:
+ *
+ *	bulk_percent     the fill of the leaves and nodes of a bulk build. The
+ *	                 default 75% leaves room for the first inserts; 100%
+ *	                 packs a read-mostly tree
+ *	merge_percent    the fewest items a leaf or node keeps: remove steals
+ *	                 from a sibling, or merges with it, below. Splits leave
+ *	                 halves at 50%, so a lower minimum keeps remove from
+ *	                 merging what insert just split
+ *	redistribute     before splitting a full leaf, even it out with an
+ *	                 adjacent leaf that has a quarter of its capacity free
+ *	                 (B*-tree style). Leaves stay fuller, at the cost of a
+ *	                 copy of the two leaves. Bitvector leaves only
+ */
+
+namespace dyn {
+	template <uint32_t bulk_percent = 75, uint32_t merge_percent = 50, bool redistribute = false>
+	struct fill_policy {
+		static_assert(bulk_percent <= 100, "leaves and nodes cannot be filled beyond their capacity");
+		static_assert(merge_percent <= 50, "two minimal siblings must fit in one when merged");
+		static_assert(merge_percent <= bulk_percent, "bulk builds cannot fill below the minimum");
+
+		static constexpr bool redistributes = redistribute;
+
+		// items per leaf or node of the given capacity packed by bulk builds
+		static constexpr uint64_t bulk(uint64_t capacity) {
+			return std::max<uint64_t>(capacity * bulk_percent / 100, 1);
+		}
+
+		// fewest items of a leaf or node of the given capacity
+		static constexpr uint64_t minimum(uint64_t capacity) {
+			return std::max<uint64_t>(capacity * merge_percent / 100, 1);
+		}
+	};
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * flat, position-independent file format of a b_spsi bitvector. The file can
+ * be memory-mapped and queried in place (see mapped-bitvector.hpp).
+ *
+ * All fields are little-endian 64-bit words:
+ *
+ *   header        flat_header
+ *   node offsets  nr_nodes byte offsets (from the start of the file) of the
+ *                 node records
+ *   node records  internal nodes in breadth-first order, root first. Record:
+ *                   [nr_children | has_leaves << 32] [first child]
+ *                   [nr_children subtree sizes] [nr_children subtree psums]
+ *                 Children of a node are consecutive: first child is an index
+ *                 in the node records if has_leaves == 0, in the leaf
+ *                 directory otherwise.
+ *   leaf dir      nr_leaves pairs [word offset in the words area] [nr of bits]
+ *   words         leaf contents. Every leaf starts at a word boundary, and
+ *                 the bits of its last word past its size are 0.
+ */
+
+namespace dyn {
+	// "DYNBTBV\0" read as a little-endian word
+	constexpr uint64_t flat_magic = 0x564254424e5944;
+	constexpr uint64_t flat_version = 1;
+
+	struct flat_header {
+		uint64_t magic;
+		uint64_t version;
+		uint64_t B;
+		uint64_t B_LEAF;
+		uint64_t size;           // number of bits
+		uint64_t psum;           // number of bits set
+		uint64_t nr_nodes;
+		uint64_t nr_leaves;
+		uint64_t depth;          // number of levels of internal nodes
+		uint64_t nodes_offset;   // byte offset of the node offsets table
+		uint64_t leaves_offset;  // byte offset of the leaf directory
+		uint64_t words_offset;   // byte offset of the words area
+		uint64_t file_size;      // total number of bytes
+		uint64_t reserved[3];
+	};
+
+	static_assert(sizeof(flat_header) == 16 * sizeof(uint64_t), "flat_header must not be padded");
+}
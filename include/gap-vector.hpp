@@ -0,0 +1,455 @@
+#pragma once
+
+#include "packed-vector.hpp"
+
+/*
+ * a bitvector leaf of b_spsi with a movable gap inside its words: the bits
+ * [0, gap) of the content are bits [0, gap) of the words, the bits
+ * [gap, size) follow a run of gap_bits zero bits. An insertion or a removal
+ * at position i first moves the gap to i, which moves only the bits between
+ * the gap and i, and then fills or widens the gap in place. Edits close to
+ * each other (appends, a cursor moving through the leaf) shift almost
+ * nothing; an edit far from the previous one costs a shift of the bits in
+ * between, as in packed_bit_vector.
+ *
+ *	gap_words   words added to the gap when it fills up (and the gap kept
+ *	            after removals)
+ *	shifting    how the bits between the gap and i are moved (masked_shift
+ *	            or bitwise_shift, packed-vector.hpp)
+ *	directory   rank/select directory of the leaf (leaf-directory.hpp), on
+ *	            the words with the gap
+ *
+ * The gap is kept zero, so that rank and select1 on the words are rank and
+ * select1 on the content once positions after the gap are mapped; select0
+ * skips the zeros of the gap.
+ */
+
+namespace dyn {
+	template <uint32_t gap_words = 4, class shifting = masked_shift, class directory = no_directory>
+	class gap_bit_vector {
+		static_assert(gap_words > 0, "the gap grows by whole words");
+
+	public:
+		explicit gap_bit_vector(uint64_t const size = 0)
+			: words(words_for(size) + gap_words), size_(size), gap_(size),
+			  gap_bits_((words.size() << 6) - size) {
+			dir.update(words, end(), 0);
+		}
+
+		explicit gap_bit_vector(std::vector<uint64_t>&& _words, uint64_t const new_size)
+			: words(std::move(_words)), size_(new_size), gap_(new_size) {
+			assert(words_for(size_) <= words.size());
+
+			gap_bits_ = (words.size() << 6) - size_;
+
+			assert(gap_is_clear() && "uninitialized non-zero values in the end of the vector");
+
+			dir.update(words, end(), 0);
+			psum_ = dir.rank(words.data(), size_);
+		}
+
+		bool at(uint64_t const i) const {
+			assert(i < size());
+
+			return bit(physical(i));
+		}
+
+		uint64_t psum() const {
+			return psum_;
+		}
+
+		/*
+		 * inclusive partial sum (i.e. up to element i included)
+		 */
+		uint64_t psum(uint64_t const i) const {
+			assert(i < size());
+
+			return dir.rank(words.data(), physical(i) + 1);
+		}
+
+		/*
+		 * smallest index j such that psum(j)>=x
+		 */
+		uint64_t search(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum());
+
+			return x == 0 ? 0 : logical(dir.select1(words.data(), end(), x));
+		}
+
+		/*
+		 * this function works only for bitvectors, and
+		 * is designed to support select_0. Returns first
+		 * position i such that the number of zeros before
+		 * i (included) is == x
+		 */
+		uint64_t search_0(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= size() - psum());
+
+			if (x == 0) return 0;
+
+			// before the gap, or x + gap_bits_ zeros of the words counting the gap
+			uint64_t const p = dir.select0(words.data(), end(), x);
+
+			return p < gap_ ? p : dir.select0(words.data(), end(), x + gap_bits_) - gap_bits_;
+		}
+
+		/*
+		 * smallest index j such that psum(j)+j>=x
+		 */
+		uint64_t search_r(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum() + size());
+
+			uint64_t s = 0;
+			uint64_t pos = 0;
+
+			// whole words before the answer, when they are all before the gap
+			auto const prefix = words_below<word_weight::ones_plus_bits>(words.data(), gap_ >> 6, x);
+
+			s = prefix.weight;
+			pos = prefix.words << 6;
+
+			for (; pos < size() && s < x; ++pos) {
+				s += (uint64_t(1) + at(pos));
+			}
+
+			pos -= pos != 0;
+			return pos;
+		}
+
+		/*
+		 * true iif x is one of the partial sums  0, I_0, I_0+I_1, ...
+		 */
+		bool contains(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum());
+
+			uint64_t s = 0;
+
+			for (uint64_t j = 0; j < size() && s < x; ++j) {
+				s += at(j);
+			}
+
+			return s == x;
+		}
+
+		/*
+		 * true iif x is one of  0, I_0+1, I_0+I_1+2, ...
+		 */
+		bool contains_r(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum() + size());
+
+			uint64_t s = 0;
+
+			for (uint64_t j = 0; j < size() && s < x; ++j) {
+				s += (at(j) + uint64_t(1));
+			}
+
+			return s == x;
+		}
+
+		/*
+		 * set the i-th bit to val (to 0 if subtract)
+		 */
+		void increment(uint64_t const i, bool const val, bool const subtract = false) {
+			assert(i < size_);
+
+			bool const x = subtract ? false : val;
+			uint64_t const p = physical(i);
+
+			if (bit(p) == x) return;
+
+			write_bit(p, x);
+			x ? ++psum_ : --psum_;
+
+			dir.update(words, end(), p);
+		}
+
+		void append(uint64_t const x) {
+			push_back(x);
+		}
+
+		/*
+		 * the i-th bit joins the gap
+		 */
+		void remove(uint64_t const i) {
+			assert(i < size_);
+
+			move_gap(i + 1);
+
+			bool const x = bit(i);
+
+			write_bit(i, false);
+
+			--size_;
+			--gap_;
+			++gap_bits_;
+			psum_ -= x;
+
+			// the gap is closed down to gap_words once it is twice as wide
+			if (gap_bits_ >= (uint64_t(2 * gap_words) << 6)) resize_gap(uint64_t(gap_words) << 6);
+
+			dir.update(words, end(), i);
+
+			assert(gap_is_clear());
+		}
+
+		void insert(uint64_t const i, uint64_t const x) {
+			assert(i <= size());
+
+			insert_bits(i, x & 1, 1);
+		}
+
+		/*
+		 * appends fill the gap once it is at the end
+		 */
+		void push_back(bool const x) {
+			insert_bits(size_, x, 1);
+		}
+
+		uint64_t size() const {
+			return size_;
+		}
+
+		/*
+		 * split content of this vector into 2 packed blocks:
+		 * Left part remains in this block, right part in the
+		 * new returned block
+		 */
+		gap_bit_vector* split() {
+			return split([](std::vector<uint64_t>&& w, uint64_t n) { return new gap_bit_vector(std::move(w), n); });
+		}
+
+		/*
+		 * as split(), with the right block built by make_leaf(words, size)
+		 * (e.g. in the leaf pool of a tree). Both halves keep their gap at
+		 * the end
+		 */
+		template <class make_leaf> gap_bit_vector* split(make_leaf&& make) {
+			move_gap(size_);
+
+			uint64_t const tot_words = words_for(size_);
+
+			uint64_t const nr_left_words = tot_words >> 1;
+
+			assert(nr_left_words > 0);
+			assert(tot_words - nr_left_words > 0);
+
+			uint64_t const nr_left_ints = nr_left_words << 6;
+
+			assert(size_ > nr_left_ints);
+			uint64_t const nr_right_ints = size_ - nr_left_ints;
+
+			std::vector<uint64_t> right_words(tot_words - nr_left_words + gap_words, 0);
+			std::copy(words.begin() + nr_left_words, words.begin() + tot_words, right_words.begin());
+			words.resize(nr_left_words + gap_words);
+			std::fill(words.begin() + nr_left_words, words.end(), 0);
+			words.shrink_to_fit();
+
+			size_ = nr_left_ints;
+			gap_ = size_;
+			gap_bits_ = (words.size() << 6) - size_;
+			dir.update(words, end(), 0);
+			psum_ = dir.rank(words.data(), size_);
+
+			gap_bit_vector* right = make(std::move(right_words), nr_right_ints);
+
+			assert(gap_is_clear());
+
+			return right;
+		}
+
+		/*
+		 * return total number of bits occupied in memory by this object instance
+		 */
+		uint64_t bit_size() const {
+			return (sizeof(gap_bit_vector) + words.capacity() * sizeof(uint64_t)) * 8 + dir.bit_size();
+		}
+
+		uint64_t width() const {
+			return 1;
+		}
+
+		/*
+		 * j-th word of the content, i.e. elements 64j ... 64j+63. Bits past
+		 * the end of the vector are 0.
+		 */
+		uint64_t word(uint64_t const j) const {
+			assert((j << 6) < size());
+
+			uint64_t const from = j << 6;
+
+			if (from + 64 <= gap_) return words[j];
+
+			if (from >= gap_) return read_word(words.data(), from + gap_bits_, end());
+
+			// the k bits before the gap, then the ones after it
+			uint64_t const k = gap_ - from;
+
+			uint64_t const front = words[j] & ((uint64_t(1) << k) - 1);
+
+			return gap_ == size_ ? front : front | (read_word(words.data(), gap_ + gap_bits_, end()) << k);
+		}
+
+		/*
+		 * insert the n integers of the given width packed in word at position i
+		 */
+		void insert_word(uint64_t i, uint64_t word, uint8_t const width, uint8_t const n) {
+			assert(i <= size());
+			assert(n);
+			assert(n * width <= sizeof(word) * 8);
+			assert(width * n == 64 || (word >> width * n) == 0);
+
+			if (n == 1) {
+				insert(i, word);
+			}
+			else if (width == 1) {
+				insert_bits(i, word, n);
+			}
+			else {
+				const uint64_t mask = (uint64_t(1) << width) - 1;
+				for (uint8_t k = 0; k < n; ++k) {
+					insert(i++, word & mask);
+					word >>= width;
+				}
+			}
+		}
+
+	private:
+		/*
+		 * bit of the words holding the i-th bit of the content
+		 */
+		uint64_t physical(uint64_t const i) const {
+			return i < gap_ ? i : i + gap_bits_;
+		}
+
+		/*
+		 * position in the content of bit p of the words (not in the gap)
+		 */
+		uint64_t logical(uint64_t const p) const {
+			assert(p < gap_ or p >= gap_ + gap_bits_);
+
+			return p < gap_ ? p : p - gap_bits_;
+		}
+
+		/*
+		 * bits of the words in use: the content and the gap
+		 */
+		uint64_t end() const {
+			return size_ + gap_bits_;
+		}
+
+		bool bit(uint64_t const p) const {
+			return (words[p >> 6] >> (p & 63)) & 1;
+		}
+
+		void write_bit(uint64_t const p, bool const x) {
+			words[p >> 6] = (words[p >> 6] & ~(uint64_t(1) << (p & 63))) | (uint64_t(x) << (p & 63));
+		}
+
+		void clear_bits(uint64_t const from, uint64_t const to) {
+			if (from >= to) return;
+
+			for (uint64_t k = from >> 6; k <= (to - 1) >> 6; ++k) words[k] &= ~bits_in_word(k, from, to);
+		}
+
+		/*
+		 * move the gap to position i of the content: the bits between the gap
+		 * and i cross it
+		 */
+		void move_gap(uint64_t const i) {
+			assert(i <= size_);
+
+			if (i == gap_) return;
+
+			uint64_t const from = std::min(i, gap_);
+
+			if (gap_bits_ > 0) {
+				if (i < gap_) {
+					// [i, gap_) to [i + gap_bits_, gap_ + gap_bits_)
+					shifting::right(words.data(), i, gap_, gap_bits_);
+					clear_bits(i, std::min(gap_, i + gap_bits_));
+				}
+				else {
+					// [gap_ + gap_bits_, i + gap_bits_) to [gap_, i)
+					shifting::left(words.data(), gap_ + gap_bits_, i + gap_bits_, gap_bits_);
+					clear_bits(std::max(gap_ + gap_bits_, i), i + gap_bits_);
+				}
+			}
+
+			gap_ = i;
+
+			dir.update(words, end(), from);
+		}
+
+		/*
+		 * make the gap bits wide: the bits after it move up or down, and the
+		 * words grow or shrink to fit
+		 */
+		void resize_gap(uint64_t const bits) {
+			uint64_t const back = gap_ + gap_bits_;  // first bit after the gap
+
+			if (bits > gap_bits_) {
+				uint64_t const s = bits - gap_bits_;
+
+				words.resize(words_for(end() + s), 0);
+				shifting::right(words.data(), back, end(), s);
+				clear_bits(back, std::min(end(), back + s));
+			}
+			else if (bits < gap_bits_) {
+				uint64_t const s = gap_bits_ - bits;
+
+				shifting::left(words.data(), back, end(), s);
+				clear_bits(std::max(back, end() - s), end());
+				words.resize(words_for(end() - s));
+				words.shrink_to_fit();
+			}
+
+			gap_bits_ = bits;
+		}
+
+		/*
+		 * insert the n <= 64 bits of x at position i: they fill the start of
+		 * the gap, moved to i and widened by gap_words words if needed
+		 */
+		void insert_bits(uint64_t const i, uint64_t const x, uint64_t const n) {
+			assert(i <= size_ and n > 0 and n <= 64);
+
+			move_gap(i);
+
+			if (gap_bits_ < n) resize_gap(gap_bits_ + (uint64_t(gap_words) << 6));
+
+			for (uint64_t k = 0; k < n; ++k) write_bit(i + k, (x >> k) & 1);
+
+			size_ += n;
+			gap_ += n;
+			gap_bits_ -= n;
+			psum_ += __builtin_popcountll(n == 64 ? x : x & ((uint64_t(1) << n) - 1));
+
+			dir.update(words, end(), i);
+		}
+
+		bool gap_is_clear() const {
+			for (uint64_t p = gap_; p < gap_ + gap_bits_; ++p)
+				if (bit(p)) return false;
+
+			return (end() & 63) == 0 or (words[end() >> 6] >> (end() & 63)) == 0;
+		}
+
+		std::vector<uint64_t> words{};
+		uint64_t psum_ = 0;      // bits set
+		uint64_t size_ = 0;      // bits of the content
+		uint64_t gap_ = 0;       // bits of the content before the gap
+		uint64_t gap_bits_ = 0;  // zero bits of the words between bit gap_ and the rest of the content
+		directory dir;
+	};
+
+	/*
+	 * the gap leaf with a gap of 4 words (256 bits)
+	 */
+	template <class directory = no_directory>
+	using gap_packed_vector = gap_bit_vector<4, masked_shift, directory>;
+}
@@ -0,0 +1,320 @@
+#pragma once
+
+#include "b-spsi.hpp"
+#include "packed-vector.hpp"
+#include "rle-vector.hpp"
+#include "sparse-vector.hpp"
+#include "succinct-bitvector.hpp"
+#include <cstdint>
+#include <utility>
+
+/*
+ * a bitvector leaf of b_spsi that holds its content in one of three forms,
+ * whichever takes the least room (roaring-style containers):
+ *
+ * - plain: a bit array, n bits
+ * - sparse: the positions of the ones (sparse_bit_vector), 32 bits per one
+ * - runs: run-length coded (rle_bit_vector), a byte or two per run
+ *
+ * The leaf itself is a single word: a pointer to its form, with the form
+ * tagged in the 2 low bits (forms are at least 8-aligned). Operations
+ * dispatch with a switch on the tag, so there is no virtual call and no
+ * vtable pointer per leaf.
+ *
+ * All three costs are compared when the leaf is built from words (bulk
+ * builds, the right half of a split) and for the left half of a split.
+ * Between splits, insertions and removals check in O(1) that the form in
+ * use is not twice as large as another one would be (a plain leaf with a
+ * one in 64 bits or less, a sparse leaf with a one in 16 bits or more, a
+ * run-length coded leaf larger than 2n bits) and convert the leaf then.
+ * The factor 2 keeps a leaf whose density sits at a threshold from being
+ * converted back and forth. A plain leaf made of long runs of ones turns
+ * run-length coded at its next split only, as counting its runs is linear.
+ */
+
+namespace dyn {
+	template <class plain = packed_bit_vector<>, class sparse = sparse_bit_vector, class runs = rle_bit_vector<>>
+	class hybrid_bit_vector {
+		enum form : uintptr_t { plain_form = 0, sparse_form = 1, runs_form = 2 };
+
+		static_assert(alignof(plain) >= 4 and alignof(sparse) >= 4 and alignof(runs) >= 4, "the tag takes 2 bits");
+
+	public:
+		explicit hybrid_bit_vector(uint64_t const size = 0) : ptr(tag(new plain(size), plain_form)) {}
+
+		explicit hybrid_bit_vector(std::vector<uint64_t>&& _words, uint64_t const new_size)
+			: ptr(make_form(std::move(_words), new_size)) {}
+
+		hybrid_bit_vector(hybrid_bit_vector const& other)
+			: ptr(other.visit([](auto const& l) { return tag(new std::decay_t<decltype(l)>(l), form_of(l)); })) {}
+
+		hybrid_bit_vector(hybrid_bit_vector&& other) noexcept : ptr(other.ptr) {
+			other.ptr = 0;
+		}
+
+		hybrid_bit_vector& operator=(hybrid_bit_vector other) noexcept {
+			std::swap(ptr, other.ptr);
+			return *this;
+		}
+
+		~hybrid_bit_vector() {
+			if (ptr) visit([](auto& l) { delete &l; });
+		}
+
+		/*
+		 * true when the ones are stored by position
+		 */
+		bool is_sparse() const {
+			return (ptr & 3) == sparse_form;
+		}
+
+		/*
+		 * true when the leaf is run-length coded
+		 */
+		bool is_compressed() const {
+			return (ptr & 3) == runs_form;
+		}
+
+		bool at(uint64_t const i) const {
+			return visit([&](auto const& l) { return bool(l.at(i)); });
+		}
+
+		uint64_t psum() const {
+			return visit([](auto const& l) { return l.psum(); });
+		}
+
+		/*
+		 * inclusive partial sum (i.e. up to element i included)
+		 */
+		uint64_t psum(uint64_t const i) const {
+			return visit([&](auto const& l) { return l.psum(i); });
+		}
+
+		/*
+		 * smallest index j such that psum(j)>=x
+		 */
+		uint64_t search(uint64_t const x) const {
+			return visit([&](auto const& l) { return l.search(x); });
+		}
+
+		/*
+		 * first position i such that the number of zeros before i (included)
+		 * is == x
+		 */
+		uint64_t search_0(uint64_t const x) const {
+			return visit([&](auto const& l) { return l.search_0(x); });
+		}
+
+		/*
+		 * smallest index j such that psum(j)+j>=x
+		 */
+		uint64_t search_r(uint64_t const x) const {
+			return visit([&](auto const& l) { return l.search_r(x); });
+		}
+
+		bool contains(uint64_t const x) const {
+			return visit([&](auto const& l) { return l.contains(x); });
+		}
+
+		bool contains_r(uint64_t const x) const {
+			return visit([&](auto const& l) { return l.contains_r(x); });
+		}
+
+		/*
+		 * set the i-th bit to val (to 0 if subtract)
+		 */
+		void increment(uint64_t const i, bool const val, bool const subtract = false) {
+			visit([&](auto& l) { l.increment(i, val, subtract); });
+			check_form();
+		}
+
+		void append(uint64_t const x) {
+			push_back(x);
+		}
+
+		void remove(uint64_t const i) {
+			visit([&](auto& l) { l.remove(i); });
+			check_form();
+		}
+
+		void insert(uint64_t const i, uint64_t const x) {
+			visit([&](auto& l) { l.insert(i, x); });
+			check_form();
+		}
+
+		void push_back(bool const x) {
+			visit([&](auto& l) { l.push_back(x); });
+			check_form();
+		}
+
+		uint64_t size() const {
+			return visit([](auto const& l) { return l.size(); });
+		}
+
+		/*
+		 * split content of this vector into 2 blocks:
+		 * Left part remains in this block, right part in the
+		 * new returned block
+		 */
+		hybrid_bit_vector* split() {
+			return split([](std::vector<uint64_t>&& w, uint64_t n) { return new hybrid_bit_vector(std::move(w), n); });
+		}
+
+		/*
+		 * as split(), with the right block built by make_leaf(words, size)
+		 * (e.g. in the leaf pool of a tree), which picks its form. The left
+		 * half picks its form again
+		 */
+		template <class make_leaf> hybrid_bit_vector* split(make_leaf&& make) {
+			std::vector<uint64_t> right_words;
+			uint64_t right_size = 0;
+
+			visit([&](auto& l) {
+				l.split([&](std::vector<uint64_t>&& w, uint64_t const n) {
+					right_words = std::move(w);
+					right_size = n;
+
+					return static_cast<std::remove_reference_t<decltype(l)>*>(nullptr);
+				});
+			});
+
+			reform();
+
+			return make(std::move(right_words), right_size);
+		}
+
+		/*
+		 * return total number of bits occupied in memory by this object instance
+		 */
+		uint64_t bit_size() const {
+			return 8 * sizeof(hybrid_bit_vector) + visit([](auto const& l) { return l.bit_size(); });
+		}
+
+		uint64_t width() const {
+			return 1;
+		}
+
+		/*
+		 * j-th word of the content, i.e. elements 64j ... 64j+63. Bits past
+		 * the end of the vector are 0.
+		 */
+		uint64_t word(uint64_t const j) const {
+			return visit([&](auto const& l) { return l.word(j); });
+		}
+
+		/*
+		 * insert the n integers of the given width packed in word at position i
+		 */
+		void insert_word(uint64_t const i, uint64_t const word, uint8_t const width, uint8_t const n) {
+			visit([&](auto& l) { l.insert_word(i, word, width, n); });
+			check_form();
+		}
+
+	private:
+		static uintptr_t tag(void* const p, form const f) {
+			assert((reinterpret_cast<uintptr_t>(p) & 3) == 0);
+
+			return reinterpret_cast<uintptr_t>(p) | f;
+		}
+
+		static form form_of(plain const&) { return plain_form; }
+		static form form_of(sparse const&) { return sparse_form; }
+		static form form_of(runs const&) { return runs_form; }
+
+		template <class F> decltype(auto) visit(F&& f) const {
+			void* const p = reinterpret_cast<void*>(ptr & ~uintptr_t(3));
+
+			switch (ptr & 3) {
+			case sparse_form: return f(*static_cast<sparse const*>(p));
+			case runs_form: return f(*static_cast<runs const*>(p));
+			default: return f(*static_cast<plain const*>(p));
+			}
+		}
+
+		template <class F> decltype(auto) visit(F&& f) {
+			void* const p = reinterpret_cast<void*>(ptr & ~uintptr_t(3));
+
+			switch (ptr & 3) {
+			case sparse_form: return f(*static_cast<sparse*>(p));
+			case runs_form: return f(*static_cast<runs*>(p));
+			default: return f(*static_cast<plain*>(p));
+			}
+		}
+
+		/*
+		 * O(1) check that the form in use is at most twice as large as the
+		 * best one; reform() otherwise
+		 */
+		void check_form() {
+			uint64_t const n = size();
+
+			switch (ptr & 3) {
+			case plain_form:
+				if (64 * psum() < n) reform();
+				break;
+			case sparse_form:
+				if (16 * psum() > n) reform();
+				break;
+			default:
+				if (reinterpret_cast<runs const*>(ptr & ~uintptr_t(3))->coded_bits() > 2 * n) reform();
+			}
+		}
+
+		/*
+		 * rebuild the leaf in its best form, if another than the current one
+		 */
+		void reform() {
+			std::vector<uint64_t> words(words_for(size()));
+			for (uint64_t j = 0; j < words.size(); ++j) words[j] = word(j);
+
+			if (best_form(words.data(), size(), psum()) != form(ptr & 3)) {
+				hybrid_bit_vector(std::move(words), size()).swap(*this);
+			}
+		}
+
+		void swap(hybrid_bit_vector& other) {
+			std::swap(ptr, other.ptr);
+		}
+
+		/*
+		 * the smallest form for the first n bits of words, holding the given
+		 * number of ones. Ties go to sparse, then to plain
+		 */
+		static form best_form(const uint64_t* words, uint64_t const n, uint64_t const ones) {
+			uint64_t const sparse_bits = 32 * ones;
+
+			if (sparse_bits <= n) return sparse_bits <= runs::coded_bits(words, n) ? sparse_form : runs_form;
+
+			return runs::coded_bits(words, n) < n ? runs_form : plain_form;
+		}
+
+		static uintptr_t make_form(std::vector<uint64_t>&& words, uint64_t const n) {
+			uint64_t ones = 0;
+			for (uint64_t k = 0; k < words_for(n); ++k) {
+				uint64_t const w = ((k + 1) << 6) > n ? words[k] & ((uint64_t(1) << (n & 63)) - 1) : words[k];
+				ones += __builtin_popcountll(w);
+			}
+
+			switch (best_form(words.data(), n, ones)) {
+			case sparse_form: return tag(new sparse(std::move(words), n), sparse_form);
+			case runs_form: return tag(new runs(std::move(words), n), runs_form);
+			default: return tag(new plain(std::move(words), n), plain_form);
+			}
+		}
+
+		uintptr_t ptr;  // the form, tagged with its kind in the 2 low bits
+	};
+
+	/*
+	 * plain leaves with 4 buffered insertions, run-length coded ones with
+	 * blocks of 32 runs
+	 */
+	using hybrid_packed_vector = hybrid_bit_vector<buffer_4_packed_vector<>, sparse_bit_vector, rle_bit_vector<>>;
+
+	/*
+	 * succinct_bitvector in hybrid mode: every leaf a bit array, a list of
+	 * positions or run-length coded, by its density
+	 */
+	template <uint32_t B_LEAF = 4096, uint32_t B = 16>
+	using hybrid_succinct_bitvector = succinct_bitvector<hybrid_packed_vector, B_LEAF, B, 0, b_spsi>;
+}
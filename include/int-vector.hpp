@@ -0,0 +1,369 @@
+#pragma once
+
+#include "b-spsi.hpp"
+#include "bit-utils.hpp"
+#include "field-kernels.hpp"
+#include "packed-vector.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/*
+ * a leaf of b_spsi holding integers rather than bits: they are packed in
+ * fields of width 1, 2, 4, ..., 64 bits, all of the same width, so that
+ * b_spsi is a dynamic prefix-sum array (counts, offsets). The width grows
+ * (doubles, as many times as needed) when an insertion or an increment
+ * stores a value that does not fit, and is brought back to the largest
+ * value at every split. Power of two widths keep every field within a word,
+ * so that psum and search sum whole words of fields with the SWAR and SIMD
+ * kernels of field-kernels.hpp.
+ *
+ * Built from words (a bulk build of the tree), the leaf reads them as bits:
+ * integers 0 and 1 of width 1. Operations that move bits between leaves
+ * (word, serialization, splits and merges by position, redistributing fill
+ * policies) are for bitvector leaves only.
+ */
+
+namespace dyn {
+	template <uint32_t initial_width = 1>
+	class packed_int_vector {
+		static_assert(initial_width > 0 and initial_width <= 64 and (initial_width & (initial_width - 1)) == 0,
+			"fields are 1, 2, 4, ..., 64 bits wide");
+
+	public:
+		explicit packed_int_vector(uint64_t const size = 0)
+			: words(words_for(size * initial_width)), size_(size), width_(initial_width) {}
+
+		explicit packed_int_vector(std::vector<uint64_t>&& _words, uint64_t const new_size)
+			: packed_int_vector(std::move(_words), new_size, 1) {}
+
+		/*
+		 * new_size integers of the given width packed in _words, e.g. the right
+		 * half of a split
+		 */
+		explicit packed_int_vector(std::vector<uint64_t>&& _words, uint64_t const new_size, uint32_t const width)
+			: words(std::move(_words)), size_(new_size), width_(width) {
+			assert(words_for(size_ * width_) <= words.size());
+
+			words.resize(words_for(size_ * width_));
+			clear_tail();
+
+			psum_ = field_sum_words(words.data(), words.size(), width_);
+
+			fit();
+		}
+
+		uint64_t at(uint64_t const i) const {
+			assert(i < size());
+
+			return field(i);
+		}
+
+		uint64_t psum() const {
+			return psum_;
+		}
+
+		/*
+		 * inclusive partial sum (i.e. up to element i included)
+		 */
+		uint64_t psum(uint64_t const i) const {
+			assert(i < size());
+
+			uint64_t const bits = (i + 1) * width_;
+			uint64_t s = field_sum_words(words.data(), bits >> 6, width_);
+
+			if (bits & 63) s += field_sum(words[bits >> 6] & ((uint64_t(1) << (bits & 63)) - 1), width_);
+
+			return s;
+		}
+
+		/*
+		 * smallest index j such that psum(j)>=x
+		 */
+		uint64_t search(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum());
+
+			if (x == 0) return 0;
+
+			auto const prefix = field_words_below<word_weight::ones>(words.data(), words.size(), width_, x);
+			uint64_t s = prefix.weight;
+			uint64_t j = (prefix.words << 6) >> log_width();
+
+			for (; s + field(j) < x; ++j) s += field(j);
+
+			return j;
+		}
+
+		/*
+		 * first position i such that the number of integers equal to 0 up to
+		 * i (included) is == x, i.e. select_0 on a bitvector
+		 */
+		uint64_t search_0(uint64_t const x) const {
+			assert(size() > 0);
+
+			if (x == 0) return 0;
+
+			if (width_ == 1) return select0_words(words.data(), size_, x);
+
+			uint64_t zeros = 0;
+			uint64_t j = 0;
+
+			for (; zeros + (field(j) == 0) < x; ++j) zeros += field(j) == 0;
+
+			return j;
+		}
+
+		/*
+		 * smallest index j such that psum(j)+j>=x
+		 */
+		uint64_t search_r(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum() + size());
+
+			if (x == 0) return 0;
+
+			// whole words only: the fields past the end of the last one would count
+			auto const prefix = field_words_below<word_weight::ones_plus_bits>(words.data(), (size_ * width_) >> 6, width_, x);
+			uint64_t s = prefix.weight;
+			uint64_t j = (prefix.words << 6) >> log_width();
+
+			for (; s + field(j) + 1 < x; ++j) s += field(j) + 1;
+
+			return j;
+		}
+
+		/*
+		 * true iif x is one of the partial sums  0, I_0, I_0+I_1, ...
+		 */
+		bool contains(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum());
+
+			return x == 0 or psum(search(x)) == x;
+		}
+
+		/*
+		 * true iif x is one of  0, I_0+1, I_0+I_1+2, ...
+		 */
+		bool contains_r(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum() + size());
+
+			if (x == 0) return true;
+
+			uint64_t const j = search_r(x);
+
+			return psum(j) + j + 1 == x;
+		}
+
+		/*
+		 * increment (decrement if subtract) the i-th integer by delta
+		 */
+		void increment(uint64_t const i, uint64_t const delta, bool const subtract = false) {
+			assert(i < size());
+			assert(not subtract or delta <= field(i));
+
+			uint64_t const x = subtract ? field(i) - delta : field(i) + delta;
+
+			grow(x);
+			write_field(i, x);
+
+			subtract ? psum_ -= delta : psum_ += delta;
+		}
+
+		void append(uint64_t const x) {
+			push_back(x);
+		}
+
+		void remove(uint64_t const i) {
+			assert(i < size());
+
+			psum_ -= field(i);
+
+			masked_shift::left(words.data(), (i + 1) * width_, size_ * width_, width_);
+			write_field(size_ - 1, 0);
+
+			--size_;
+			words.resize(words_for(size_ * width_));
+		}
+
+		void insert(uint64_t const i, uint64_t const x) {
+			assert(i <= size());
+
+			grow(x);
+
+			words.resize(words_for((size_ + 1) * width_), 0);
+			masked_shift::right(words.data(), i * width_, size_ * width_, width_);
+
+			++size_;
+			write_field(i, x);
+
+			psum_ += x;
+		}
+
+		void push_back(uint64_t const x) {
+			insert(size_, x);
+		}
+
+		uint64_t size() const {
+			return size_;
+		}
+
+		/*
+		 * split content of this vector into 2 blocks:
+		 * Left part remains in this block, right part in the
+		 * new returned block
+		 */
+		packed_int_vector* split() {
+			return split([](std::vector<uint64_t>&& w, uint64_t n, uint32_t width) {
+				return new packed_int_vector(std::move(w), n, width);
+			});
+		}
+
+		/*
+		 * as split(), with the right block built by make_leaf(words, size,
+		 * width) (e.g. in the leaf pool of a tree). Both halves shrink to the
+		 * width of their largest integer
+		 */
+		template <class make_leaf> auto split(make_leaf&& make) {
+			uint64_t const nr_left_ints = size_ / 2;
+			uint64_t const nr_right_ints = size_ - nr_left_ints;
+			uint32_t const width = width_;
+
+			assert(nr_left_ints > 0);
+
+			std::vector<uint64_t> right_words(words_for(nr_right_ints * width));
+			copy_bits(right_words.data(), words.data(), nr_left_ints * width, nr_right_ints * width, size_ * width);
+
+			size_ = nr_left_ints;
+			words.resize(words_for(size_ * width_));
+			clear_tail();
+
+			psum_ = field_sum_words(words.data(), words.size(), width_);
+
+			fit();
+			words.shrink_to_fit();
+
+			return make(std::move(right_words), nr_right_ints, width);
+		}
+
+		/*
+		 * return total number of bits occupied in memory by this object instance
+		 */
+		uint64_t bit_size() const {
+			return 8 * (sizeof(packed_int_vector) + words.capacity() * sizeof(uint64_t));
+		}
+
+		/*
+		 * bits per integer
+		 */
+		uint64_t width() const {
+			return width_;
+		}
+
+		/*
+		 * insert the n integers of the given width packed in word at position i
+		 */
+		void insert_word(uint64_t i, uint64_t word, uint8_t const width, uint8_t const n) {
+			assert(i <= size());
+			assert(n);
+			assert(n * width <= sizeof(word) * 8);
+			assert(width * n == 64 || (word >> width * n) == 0);
+
+			const uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+			for (uint8_t k = 0; k < n; ++k) {
+				insert(i++, word & mask);
+				word >>= width;
+			}
+		}
+
+	private:
+		uint32_t log_width() const {
+			return width_log(width_);
+		}
+
+		uint64_t mask() const {
+			return width_ == 64 ? ~uint64_t(0) : (uint64_t(1) << width_) - 1;
+		}
+
+		uint64_t field(uint64_t const i) const {
+			uint64_t const pos = i << log_width();
+
+			return (words[pos >> 6] >> (pos & 63)) & mask();
+		}
+
+		void write_field(uint64_t const i, uint64_t const x) {
+			assert((x & ~mask()) == 0);
+
+			uint64_t const pos = i << log_width();
+			uint64_t& w = words[pos >> 6];
+
+			w = (w & ~(mask() << (pos & 63))) | (x << (pos & 63));
+		}
+
+		/*
+		 * smallest field width holding x
+		 */
+		static uint32_t width_of(uint64_t const x) {
+			uint32_t w = 1;
+			while (w < 64 and (x >> w) != 0) w <<= 1;
+
+			return w;
+		}
+
+		/*
+		 * widen the fields until x fits
+		 */
+		void grow(uint64_t const x) {
+			if ((x & ~mask()) != 0) repack(width_of(x));
+		}
+
+		/*
+		 * shrink the fields to the width of the largest integer
+		 */
+		void fit() {
+			uint64_t m = 0;
+			for (uint64_t const w : words) m |= w;
+
+			// the fields of m are the OR of the integers: their width is that of the largest one
+			uint32_t w = 1;
+			for (uint64_t f = 0; f < 64; f += width_) w = std::max(w, width_of((m >> f) & mask()));
+
+			if (w < width_) repack(w);
+		}
+
+		void repack(uint32_t const width) {
+			std::vector<uint64_t> packed(words_for(size_ * width), 0);
+			uint64_t const m = mask();
+
+			for (uint64_t i = 0; i < size_; ++i) {
+				uint64_t const from = i << log_width();
+				uint64_t const to = i * width;
+
+				packed[to >> 6] |= ((words[from >> 6] >> (from & 63)) & m) << (to & 63);
+			}
+
+			words = std::move(packed);
+			width_ = width;
+		}
+
+		void clear_tail() {
+			uint64_t const bits = size_ * width_;
+
+			if (bits & 63) words[bits >> 6] &= (uint64_t(1) << (bits & 63)) - 1;
+		}
+
+		std::vector<uint64_t> words{};
+		uint64_t psum_ = 0;
+		uint64_t size_ = 0;
+		uint32_t width_ = initial_width;
+	};
+
+	/*
+	 * b_spsi over integers of any width, starting with 1-bit fields
+	 */
+	template <uint32_t B_LEAF = 4096, uint32_t B = 16>
+	using packed_spsi = b_spsi<packed_int_vector<>, B_LEAF, B>;
+}
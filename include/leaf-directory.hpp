@@ -0,0 +1,134 @@
+#pragma once
+
+#include "bit-utils.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/*
+ * rank/select directories of the bitvector leaves (directory policy of
+ * basic_packed_vector).
+ *
+ * A leaf owns a directory and calls update() whenever its words change,
+ * passing the first bit that may have changed. rank and select are then
+ * answered on the words of the leaf through the directory.
+ */
+
+namespace dyn {
+	/*
+	 * no directory: rank and select scan the words from the beginning
+	 */
+	class no_directory {
+	public:
+		void update(const std::vector<uint64_t>&, uint64_t, uint64_t) {}
+
+		/*
+		 * number of bits set among the first i bits
+		 */
+		uint64_t rank(const uint64_t* words, uint64_t i) const { return rank_words(words, i); }
+
+		/*
+		 * position of the x-th (1-based) bit set
+		 */
+		uint64_t select1(const uint64_t* words, uint64_t nbits, uint64_t x) const {
+			return select1_words(words, nbits, x);
+		}
+
+		/*
+		 * position of the x-th (1-based) bit not set
+		 */
+		uint64_t select0(const uint64_t* words, uint64_t nbits, uint64_t x) const {
+			return select0_words(words, nbits, x);
+		}
+
+		uint64_t bit_size() const { return 0; }
+	};
+
+	/*
+	 * number of bits set before every block of block_bits bits. rank scans
+	 * at most one block; select binary searches the counters and then scans
+	 * one block. Takes 32 bits every block_bits bits of the leaf.
+	 */
+	template <uint64_t block_bits = 512>
+	class block_directory {
+		static_assert(block_bits % 64 == 0 and block_bits > 0, "blocks must be made of whole words");
+
+	public:
+		/*
+		 * the words of a leaf of nbits bits changed from bit from on
+		 */
+		void update(const std::vector<uint64_t>& words, uint64_t nbits, uint64_t from) {
+			uint64_t const nr_words = words_for(nbits);
+			uint64_t const nr_blocks = (nr_words + block_words - 1) / block_words;
+
+			assert(nr_words <= words.size());
+
+			// counters up to the block of from (included) did not change
+			uint64_t b = std::min<uint64_t>(from / block_bits, counts.empty() ? 0 : counts.size() - 1);
+
+			counts.resize(nr_blocks + 1);
+			counts[0] = 0;
+
+			for (; b < nr_blocks; ++b) {
+				uint64_t const end = std::min((b + 1) * block_words, nr_words);
+
+				counts[b + 1] = counts[b] + popcount_words(words.data() + b * block_words, end - b * block_words);
+			}
+		}
+
+		/*
+		 * number of bits set among the first i bits
+		 */
+		uint64_t rank(const uint64_t* words, uint64_t i) const {
+			uint64_t const b = i / block_bits;
+
+			assert(b < counts.size());
+
+			return counts[b] + rank_words(words + b * block_words, i - b * block_bits);
+		}
+
+		/*
+		 * position of the x-th (1-based) bit set
+		 */
+		uint64_t select1(const uint64_t* words, uint64_t nbits, uint64_t x) const {
+			assert(x > 0 and x <= counts.back());
+
+			// last block starting with less than x bits set
+			uint64_t const b = std::lower_bound(counts.begin(), counts.end(), x) - counts.begin() - 1;
+
+			return b * block_bits + select1_words(words + b * block_words, nbits - b * block_bits, x - counts[b]);
+		}
+
+		/*
+		 * position of the x-th (1-based) bit not set
+		 */
+		uint64_t select0(const uint64_t* words, uint64_t nbits, uint64_t x) const {
+			assert(x > 0);
+
+			// last block starting with less than x bits not set. All blocks but the
+			// last are full
+			uint64_t low = 0;
+			uint64_t high = counts.size() - 1;
+
+			while (high - low > 1) {
+				uint64_t const mid = (low + high) / 2;
+
+				if (mid * block_bits - counts[mid] < x) low = mid;
+				else high = mid;
+			}
+
+			uint64_t const zeros = low * block_bits - counts[low];
+
+			return low * block_bits + select0_words(words + low * block_words, nbits - low * block_bits, x - zeros);
+		}
+
+		uint64_t bit_size() const { return counts.capacity() * sizeof(uint32_t) * 8; }
+
+	private:
+		static constexpr uint64_t block_words = block_bits / 64;
+
+		// counts[b] = number of bits set in blocks 0, ..., b-1
+		std::vector<uint32_t> counts;
+	};
+}
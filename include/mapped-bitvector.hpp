@@ -0,0 +1,472 @@
+#pragma once
+
+#include "bit-utils.hpp"
+#include "flat-format.hpp"
+#include <cassert>
+#include <cstdint>
+#include <ios>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dyn {
+	/*
+	 * read-only bitvector over a file in the flat format (see flat-format.hpp),
+	 * as written by succinct_bitvector::serialize_flat.
+	 *
+	 * The file is memory-mapped and access, rank and select are answered
+	 * straight from the mapping: loading allocates nothing and copies nothing,
+	 * pages are brought in by the OS as queries touch them.
+	 */
+	class mapped_bitvector {
+	public:
+		/*
+		 * map the file at path
+		 */
+		explicit mapped_bitvector(const std::string& path) {
+			map(path);
+			check();
+		}
+
+		/*
+		 * view over flat data already in memory. data must be 8-byte aligned and
+		 * must outlive this object; it is not owned.
+		 */
+		mapped_bitvector(const void* data, uint64_t bytes) : base_(data), bytes_(bytes) {
+			check();
+		}
+
+		mapped_bitvector(const mapped_bitvector&) = delete;
+		mapped_bitvector& operator=(const mapped_bitvector&) = delete;
+
+		mapped_bitvector(mapped_bitvector&& m) noexcept { steal(m); }
+
+		mapped_bitvector& operator=(mapped_bitvector&& m) noexcept {
+			if (this != &m) {
+				unmap();
+				steal(m);
+			}
+
+			return *this;
+		}
+
+		~mapped_bitvector() { unmap(); }
+
+		/*
+		 * number of bits in the bitvector
+		 */
+		uint64_t size() const { return header_->size; }
+
+		/*
+		 * access
+		 */
+		bool at(uint64_t i) const {
+			assert(i < size());
+
+			const uint64_t* rec = node_record(0);
+
+			while (true) {
+				uint64_t const nr = rec[0] & 0xFFFFFFFF;
+				const uint64_t* sizes = rec + 2;
+
+				uint64_t const j = first_child(nr, [&](uint64_t k) { return sizes[k] > i; });
+				if (j > 0) i -= sizes[j - 1];
+
+				if (has_leaves(rec)) {
+					return (leaf_words(rec[1] + j)[i >> 6] >> (i & 63)) & 1;
+				}
+
+				rec = node_record(rec[1] + j);
+			}
+		}
+
+		uint64_t select(uint64_t i, bool b = true) const {
+
+			return b ? select1(i) : select0(i);
+
+		}
+
+		/*
+		 * position of i-th bit not set. 0 < i <= rank(size(),0)
+		 */
+		uint64_t select0(uint64_t x) const {
+			assert(x > 0 and x <= rank0());
+
+			uint64_t pos = 0;
+			const uint64_t* rec = node_record(0);
+
+			while (true) {
+				uint64_t const nr = rec[0] & 0xFFFFFFFF;
+				const uint64_t* sizes = rec + 2;
+				const uint64_t* psums = rec + 2 + nr;
+
+				// zero counters are monotone as well: binary search on them
+				uint64_t const j = first_child(nr, [&](uint64_t k) { return sizes[k] - psums[k] >= x; });
+				if (j > 0) {
+					pos += sizes[j - 1];
+					x -= sizes[j - 1] - psums[j - 1];
+				}
+
+				if (has_leaves(rec)) {
+					uint64_t const leaf = rec[1] + j;
+					return pos + select_in_leaf<word_weight::zeros>(leaf, x);
+				}
+
+				rec = node_record(rec[1] + j);
+			}
+		}
+
+		/*
+		 * position of i-th bit set. 0 < i <= rank(size(),1)
+		 */
+		uint64_t select1(uint64_t x) const {
+			assert(x > 0 and x <= rank1());
+
+			uint64_t pos = 0;
+			const uint64_t* rec = node_record(0);
+
+			while (true) {
+				uint64_t const nr = rec[0] & 0xFFFFFFFF;
+				const uint64_t* sizes = rec + 2;
+				const uint64_t* psums = rec + 2 + nr;
+
+				uint64_t const j = first_child(nr, [&](uint64_t k) { return psums[k] >= x; });
+				if (j > 0) {
+					pos += sizes[j - 1];
+					x -= psums[j - 1];
+				}
+
+				if (has_leaves(rec)) {
+					uint64_t const leaf = rec[1] + j;
+					return pos + select_in_leaf<word_weight::ones>(leaf, x);
+				}
+
+				rec = node_record(rec[1] + j);
+			}
+		}
+
+		/*
+		 * number of bits equal to b before position i EXCLUDED
+		 */
+		uint64_t rank(uint64_t i, bool b = true) const {
+
+			auto r1 = rank1(i);
+
+			return b ? r1 : i - r1;
+
+		}
+
+		/*
+		 * number of bits equal to 0 before position i EXCLUDED
+		 */
+		uint64_t rank0(uint64_t i) const {
+
+			return i - rank1(i);
+
+		}
+
+		/*
+		 * number of bits equal to 1 before position i EXCLUDED
+		 */
+		uint64_t rank1(uint64_t i) const {
+			assert(i <= size());
+
+			if (i == size()) return header_->psum;
+
+			uint64_t r = 0;
+			const uint64_t* rec = node_record(0);
+
+			while (true) {
+				uint64_t const nr = rec[0] & 0xFFFFFFFF;
+				const uint64_t* sizes = rec + 2;
+				const uint64_t* psums = rec + 2 + nr;
+
+				uint64_t const j = first_child(nr, [&](uint64_t k) { return sizes[k] > i; });
+				if (j > 0) {
+					i -= sizes[j - 1];
+					r += psums[j - 1];
+				}
+
+				if (has_leaves(rec)) return r + rank_words(leaf_words(rec[1] + j), i);
+
+				rec = node_record(rec[1] + j);
+			}
+		}
+
+		/*
+		 * total number of bits not set
+		 */
+		uint64_t rank0() const { return header_->size - header_->psum; }
+
+		/*
+		 * total number of bits set
+		 */
+		uint64_t rank1() const { return header_->psum; }
+
+		/*
+		 * number of levels of internal nodes
+		 */
+		uint64_t depth() const { return header_->depth; }
+
+		/*
+		 * number of bits of the mapping. Only the pages touched by queries are
+		 * actually resident in RAM.
+		 */
+		uint64_t bit_size() const { return (sizeof(mapped_bitvector) + bytes_) * 8; }
+
+	private:
+		const char* bytes() const { return static_cast<const char*>(base_); }
+
+		const uint64_t* node_record(uint64_t k) const {
+			return reinterpret_cast<const uint64_t*>(bytes() + node_offsets_[k]);
+		}
+
+		static bool has_leaves(const uint64_t* rec) { return rec[0] >> 32; }
+
+		const uint64_t* leaf_words(uint64_t leaf) const { return words_ + leaf_dir_[2 * leaf]; }
+
+		uint64_t leaf_size(uint64_t leaf) const { return leaf_dir_[2 * leaf + 1]; }
+
+		/*
+		 * first child j for which found(j) holds. found must be monotone in j
+		 * (branchless binary search, as b_spsi::node::find_child)
+		 */
+		template <class pred>
+		static uint64_t first_child(uint64_t nr, pred found) {
+			uint32_t size = nr;
+			uint32_t low = 0;
+
+			while (size > 0) {
+				uint32_t half = size / 2;
+				uint32_t other_half = size - half;
+				uint32_t probe = low + half;
+				uint32_t other_low = low + other_half;
+				size = half;
+				low = found(probe) ? low : other_low;
+			}
+
+			return low;
+		}
+
+		/*
+		 * validate the file and cache pointers to its sections. Every offset
+		 * and index a query follows is checked to stay within its section, and
+		 * the counters of every node to add up to its children: a truncated or
+		 * corrupt file throws here instead of being read out of bounds. The
+		 * words of the leaves are not read (that would page in the whole file);
+		 * a leaf whose bits disagree with its counters is caught by select.
+		 */
+		void check() {
+			if (bytes_ < sizeof(flat_header) || reinterpret_cast<uintptr_t>(base_) % sizeof(uint64_t)) {
+				fail("not a flat b_spsi bitvector");
+			}
+
+			header_ = static_cast<const flat_header*>(base_);
+
+			if (header_->magic != flat_magic) fail("not a flat b_spsi bitvector");
+			if (header_->version != flat_version) fail("unsupported flat format version");
+
+			auto const& h = *header_;
+
+			// sections in order, word-aligned: header, node offsets, node records, leaf directory, words
+			if (h.file_size > bytes_ || h.words_offset > h.file_size || h.leaves_offset > h.words_offset ||
+				h.nodes_offset < sizeof(flat_header) || h.nodes_offset > h.leaves_offset ||
+				(h.nodes_offset | h.leaves_offset | h.words_offset | h.file_size) % sizeof(uint64_t)) {
+				fail("truncated flat b_spsi bitvector");
+			}
+
+			if (h.nr_nodes == 0 || h.nr_nodes > (h.leaves_offset - h.nodes_offset) / sizeof(uint64_t) ||
+				h.nr_leaves > (h.words_offset - h.leaves_offset) / (2 * sizeof(uint64_t))) {
+				fail("truncated flat b_spsi bitvector");
+			}
+
+			node_offsets_ = reinterpret_cast<const uint64_t*>(bytes() + h.nodes_offset);
+			leaf_dir_ = reinterpret_cast<const uint64_t*>(bytes() + h.leaves_offset);
+			words_ = reinterpret_cast<const uint64_t*>(bytes() + h.words_offset);
+
+			uint64_t const records_begin = h.nodes_offset + sizeof(uint64_t) * h.nr_nodes;
+			uint64_t const nr_words = (h.file_size - h.words_offset) / sizeof(uint64_t);
+
+			// every record within the node records section, then what its fields point to
+			for (uint64_t k = 0; k < h.nr_nodes; ++k) {
+				uint64_t const off = node_offsets_[k];
+
+				if (off % sizeof(uint64_t) || off < records_begin || off > h.leaves_offset - 2 * sizeof(uint64_t)) {
+					fail("corrupt flat b_spsi bitvector: node offset");
+				}
+
+				uint64_t const nr = node_record(k)[0] & 0xFFFFFFFF;
+
+				if (nr == 0 || nr > (h.leaves_offset - off) / (2 * sizeof(uint64_t)) - 1) {
+					fail("corrupt flat b_spsi bitvector: node record");
+				}
+			}
+
+			for (uint64_t k = 0; k < h.nr_nodes; ++k) {
+				const uint64_t* rec = node_record(k);
+				uint64_t const nr = rec[0] & 0xFFFFFFFF;
+				uint64_t const first = rec[1];
+
+				// children of internal nodes come later in breadth-first order: no cycles
+				bool const leaves = has_leaves(rec);
+				uint64_t const nr_targets = leaves ? h.nr_leaves : h.nr_nodes;
+
+				if (first > nr_targets || nr > nr_targets - first || (not leaves and first <= k)) {
+					fail("corrupt flat b_spsi bitvector: node children");
+				}
+
+				const uint64_t* sizes = rec + 2;
+				const uint64_t* psums = rec + 2 + nr;
+
+				for (uint64_t j = 0; j < nr; ++j) {
+					uint64_t const size = sizes[j] - (j ? sizes[j - 1] : 0);
+					uint64_t const psum = psums[j] - (j ? psums[j - 1] : 0);
+
+					if ((j and (sizes[j] < sizes[j - 1] or psums[j] < psums[j - 1])) or psum > size) {
+						fail("corrupt flat b_spsi bitvector: node counters");
+					}
+
+					if (leaves) {
+						uint64_t const leaf = first + j;
+
+						if (leaf_size(leaf) != size || leaf_dir_[2 * leaf] > nr_words ||
+							words_for(size) > nr_words - leaf_dir_[2 * leaf]) {
+							fail("corrupt flat b_spsi bitvector: leaf directory");
+						}
+					}
+					else {
+						// the totals of the child: its last counters
+						const uint64_t* child = node_record(first + j);
+						uint64_t const child_nr = child[0] & 0xFFFFFFFF;
+
+						if (child[1 + child_nr] != size || child[1 + 2 * child_nr] != psum) {
+							fail("corrupt flat b_spsi bitvector: node counters");
+						}
+					}
+				}
+
+				if (k == 0 and (sizes[nr - 1] != h.size or psums[nr - 1] != h.psum)) {
+					fail("corrupt flat b_spsi bitvector: root counters");
+				}
+			}
+		}
+
+		/*
+		 * position of the x-th bit of weight wt in leaf, which its counters say
+		 * it has. Throws if its words hold fewer
+		 */
+		template <word_weight wt> uint64_t select_in_leaf(uint64_t const leaf, uint64_t const x) const {
+			const uint64_t* words = leaf_words(leaf);
+			uint64_t const n = words_for(leaf_size(leaf));
+
+			auto const prefix = words_below<wt>(words, n, x);
+			if (prefix.words == n) throw std::ios_base::failure("corrupt flat b_spsi bitvector: leaf words");
+
+			uint64_t const w = wt == word_weight::zeros ? ~words[prefix.words] : words[prefix.words];
+			uint64_t const pos = (prefix.words << 6) + select_in_word(w, x - prefix.weight - 1);
+
+			if (pos >= leaf_size(leaf)) throw std::ios_base::failure("corrupt flat b_spsi bitvector: leaf words");
+
+			return pos;
+		}
+
+		[[noreturn]] void fail(const char* what) {
+			unmap();
+			throw std::ios_base::failure(what);
+		}
+
+		void map(const std::string& path) {
+#if defined(_WIN32)
+			file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file_ == INVALID_HANDLE_VALUE) throw std::ios_base::failure("cannot open " + path);
+
+			LARGE_INTEGER size;
+			GetFileSizeEx(file_, &size);
+			bytes_ = size.QuadPart;
+
+			mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping_ != NULL) base_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+#else
+			int fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0) throw std::ios_base::failure("cannot open " + path);
+
+			struct stat st;
+			if (fstat(fd, &st) == 0 && st.st_size > 0) {
+				bytes_ = st.st_size;
+
+				void* p = mmap(NULL, bytes_, PROT_READ, MAP_SHARED, fd, 0);
+				base_ = p == MAP_FAILED ? NULL : p;
+			}
+
+			// the mapping stays valid after the descriptor is closed
+			close(fd);
+#endif
+			owned_ = true;
+
+			if (base_ == NULL) {
+				unmap();
+				throw std::ios_base::failure("cannot map " + path);
+			}
+		}
+
+		void unmap() {
+			if (owned_) {
+#if defined(_WIN32)
+				if (base_ != NULL) UnmapViewOfFile(base_);
+				if (mapping_ != NULL) CloseHandle(mapping_);
+				if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+
+				mapping_ = NULL;
+				file_ = INVALID_HANDLE_VALUE;
+#else
+				if (base_ != NULL) munmap(const_cast<void*>(base_), bytes_);
+#endif
+			}
+
+			owned_ = false;
+			base_ = NULL;
+			bytes_ = 0;
+		}
+
+		void steal(mapped_bitvector& m) {
+			base_ = m.base_;
+			bytes_ = m.bytes_;
+			owned_ = m.owned_;
+			header_ = m.header_;
+			node_offsets_ = m.node_offsets_;
+			leaf_dir_ = m.leaf_dir_;
+			words_ = m.words_;
+#if defined(_WIN32)
+			file_ = m.file_;
+			mapping_ = m.mapping_;
+			m.file_ = INVALID_HANDLE_VALUE;
+			m.mapping_ = NULL;
+#endif
+			m.base_ = NULL;
+			m.bytes_ = 0;
+			m.owned_ = false;
+		}
+
+		const void* base_ = NULL;
+		uint64_t bytes_ = 0;
+		bool owned_ = false;  // if true, base_ is a mapping to be released
+
+#if defined(_WIN32)
+		HANDLE file_ = INVALID_HANDLE_VALUE;
+		HANDLE mapping_ = NULL;
+#endif
+
+		const flat_header* header_ = NULL;
+		const uint64_t* node_offsets_ = NULL;
+		const uint64_t* leaf_dir_ = NULL;
+		const uint64_t* words_ = NULL;
+	};
+}
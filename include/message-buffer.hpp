@@ -0,0 +1,208 @@
+#pragma once
+
+#include "counter-kernels.hpp"
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/*
+ * pending insertions of a node of basic_b_spsi in Bε-tree mode
+ * (buffer_size > 0): integers inserted in the subtree of the node and not
+ * yet pushed down to its children. They are sorted by position in the
+ * content of the node, i.e. the content of its children with the pending
+ * insertions in between: the k-th pending insertion, at position p, comes
+ * before the (p - k)-th integer of the children (its children position).
+ *
+ * A node pushes its pending insertions down when it holds capacity of them.
+ * Merging two nodes concatenates their buffers, which may then hold more
+ * until the next push.
+ *
+ * The values are kept as running sums, so that sum(k), which psum and the
+ * searches ask every buffered node on their way down, is one read; an
+ * insertion or an increment adds to the sums after it, as it moves the
+ * positions after it already.
+ *
+ * Experimental: the buffer lives in two heap arrays next to the node, and
+ * in RAM the mode is slower than applying insertions at once (see
+ * basic_b_spsi and the RandomInsertion benchmarks).
+ */
+
+namespace dyn {
+	template <uint64_t capacity> class message_buffer {
+	public:
+		uint32_t size() const { return pos_.size(); }
+
+		bool full() const { return pos_.size() >= capacity; }
+
+		uint64_t pos(uint32_t const k) const { return pos_[k]; }
+
+		uint64_t val(uint32_t const k) const { return sums_[k] - sum(k); }
+
+		uint64_t children_pos(uint32_t const k) const { return pos_[k] - k; }
+
+		/*
+		 * pending insertions at positions up to i
+		 */
+		uint32_t up_to(uint64_t const i) const {
+			return first_greater<counter_of::a>(pos_.data(), pos_.data(), size(), i, UINT32_MAX);
+		}
+
+		/*
+		 * pending insertions before the c-th integer of the children
+		 */
+		uint32_t below(uint64_t const c) const {
+			uint32_t low = 0;
+			uint32_t n = size();
+
+			while (n > 0) {
+				uint32_t const half = n / 2;
+
+				if (children_pos(low + half) < c) {
+					low += half + 1;
+					n -= half + 1;
+				}
+				else {
+					n = half;
+				}
+			}
+
+			return low;
+		}
+
+		/*
+		 * sum of the first k pending insertions
+		 */
+		uint64_t sum(uint32_t const k) const { return k == 0 ? 0 : sums_[k - 1]; }
+
+		uint64_t sum() const { return sum(size()); }
+
+		/*
+		 * a new integer x at position i: the pending insertions at or after i
+		 * move up by one
+		 */
+		void insert(uint64_t const i, uint64_t const x) {
+			uint32_t const k = i == 0 ? 0 : up_to(i - 1);
+
+			pos_.insert(pos_.begin() + k, i);
+			sums_.insert(sums_.begin() + k, sum(k));
+
+			add_to_counters(pos_.data(), k + 1, size(), 1);
+			add_to_counters(sums_.data(), k, size(), x);
+		}
+
+		/*
+		 * remove the k-th pending insertion, and return it
+		 */
+		uint64_t erase(uint32_t const k) {
+			uint64_t const x = val(k);
+
+			pos_.erase(pos_.begin() + k);
+			sums_.erase(sums_.begin() + k);
+
+			shift_down(k);
+			add_to_counters(sums_.data(), k, size(), 0 - x);
+
+			return x;
+		}
+
+		/*
+		 * an integer of the children before the k-th pending insertion was
+		 * removed: the k-th and the following ones move down by one
+		 */
+		void shift_down(uint32_t const k) { add_to_counters(pos_.data(), k, size(), ~uint64_t(0)); }
+
+		/*
+		 * n integers were put before all the pending insertions: they all
+		 * move up by n
+		 */
+		void raise(uint64_t const n) { add_to_counters(pos_.data(), 0, size(), n); }
+
+		void add(uint32_t const k, uint64_t const delta, bool const subtract) {
+			assert(not subtract or delta <= val(k));
+
+			add_to_counters(sums_.data(), k, size(), subtract ? 0 - delta : delta);
+		}
+
+		/*
+		 * drop the first n pending insertions, pushed down to the children
+		 */
+		void pop_front(uint32_t const n) {
+			uint64_t const s = sum(n);
+
+			pos_.erase(pos_.begin(), pos_.begin() + n);
+			sums_.erase(sums_.begin(), sums_.begin() + n);
+
+			add_to_counters(sums_.data(), 0, size(), 0 - s);
+		}
+
+		/*
+		 * move the pending insertions k, k + 1, ... to a new buffer, their
+		 * positions lowered by offset
+		 */
+		message_buffer split_off(uint32_t const k, uint64_t const offset) {
+			message_buffer right;
+
+			for (uint32_t t = k; t < size(); ++t) right.push_back(pos_[t] - offset, val(t));
+
+			pos_.resize(k);
+			sums_.resize(k);
+
+			return right;
+		}
+
+		/*
+		 * append the pending insertions of other, their positions raised by
+		 * offset (the size of the content of this node)
+		 */
+		void append(message_buffer const& other, uint64_t const offset) {
+			for (uint32_t t = 0; t < other.size(); ++t) push_back(other.pos_[t] + offset, other.val(t));
+		}
+
+		/*
+		 * merge in the pending insertions of the children (positions in the
+		 * content of the children), which become pending insertions of this
+		 * node
+		 */
+		void absorb(message_buffer const& below) {
+			message_buffer merged;
+			uint32_t k = 0;
+
+			for (uint32_t t = 0; t < below.size(); ++t) {
+				uint64_t const c = below.pos_[t];
+
+				for (; k < size() and children_pos(k) <= c; ++k) merged.push_back(pos_[k], val(k));
+
+				merged.push_back(c + k, below.val(t));
+			}
+
+			for (; k < size(); ++k) merged.push_back(pos_[k], val(k));
+
+			*this = std::move(merged);
+		}
+
+		uint64_t bit_size() const {
+			return 8 * (sizeof(message_buffer) + sizeof(uint64_t) * (pos_.capacity() + sums_.capacity()));
+		}
+
+	private:
+		void push_back(uint64_t const i, uint64_t const x) {
+			assert(pos_.empty() or pos_.back() < i);
+
+			sums_.push_back(sum() + x);
+			pos_.push_back(i);
+		}
+
+		std::vector<uint64_t> pos_{};
+		std::vector<uint64_t> sums_{};  // sums_[k]: sum of the pending insertions 0 ... k
+	};
+
+	/*
+	 * no pending insertions (the default): nodes apply every insertion at once
+	 */
+	template <> class message_buffer<0> {
+	public:
+		static constexpr uint32_t size() { return 0; }
+
+		static constexpr uint64_t bit_size() { return 0; }
+	};
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * allocation policies of basic_b_spsi. A tree owns one pool<node> and one
+ * pool<leaf_type>, and creates and frees all of its nodes and leaves through
+ * them:
+ *
+ *	T* make(args...)   construct a T
+ *	void destroy(T*)   destroy a T made by this pool
+ *	uint64_t bit_size() bits held by the pool and not by live objects
+ *
+ * Pools are neither copied nor moved: the tree keeps them at a fixed address.
+ */
+
+namespace dyn {
+	/*
+	 * every object is a separate new/delete (the default)
+	 */
+	struct heap_allocation {
+		template <class T> class pool {
+		public:
+			template <class... Args> T* make(Args&&... args) { return new T(std::forward<Args>(args)...); }
+
+			void destroy(T* p) { delete p; }
+
+			uint64_t bit_size() const { return 0; }
+		};
+	};
+
+	/*
+	 * objects are carved out of slabs of slab_size objects, and freed objects
+	 * are recycled through a free list. Nodes and leaves created one after the
+	 * other (by splits and bulk builds) end up next to each other, and an
+	 * insert-heavy workload calls malloc once every slab_size splits. Slabs
+	 * are only returned when the tree is destroyed.
+	 */
+	template <uint32_t slab_size = 64> struct pooled_allocation {
+		static_assert(slab_size > 0, "slabs must hold at least one object");
+
+		template <class T> class pool {
+		public:
+			pool() = default;
+			pool(const pool&) = delete;
+			pool& operator=(const pool&) = delete;
+
+			~pool() { assert(live == 0 && "objects outlive their pool"); }
+
+			template <class... Args> T* make(Args&&... args) {
+				slot* s = take();
+
+				try {
+					T* p = new (s->storage) T(std::forward<Args>(args)...);
+					++live;
+					return p;
+				}
+				catch (...) {
+					give_back(s);
+					throw;
+				}
+			}
+
+			void destroy(T* p) {
+				if (p == NULL) return;
+
+				assert(live > 0);
+
+				p->~T();
+				give_back(reinterpret_cast<slot*>(p));
+				--live;
+			}
+
+			uint64_t bit_size() const {
+				return (slabs.size() * uint64_t(slab_size) - live) * sizeof(slot) * 8 +
+					slabs.capacity() * sizeof(slabs[0]) * 8;
+			}
+
+		private:
+			union slot {
+				slot* next;  // while on the free list
+				alignas(T) unsigned char storage[sizeof(T)];
+			};
+
+			slot* take() {
+				if (free_list != NULL) {
+					slot* s = free_list;
+					free_list = s->next;
+					return s;
+				}
+
+				if (carved == slab_size) {
+					slabs.emplace_back(new slot[slab_size]);
+					carved = 0;
+				}
+
+				return &slabs.back()[carved++];
+			}
+
+			void give_back(slot* s) {
+				s->next = free_list;
+				free_list = s;
+			}
+
+			std::vector<std::unique_ptr<slot[]>> slabs;
+			slot* free_list = NULL;
+			uint32_t carved = slab_size;  // slots of the last slab handed out
+			uint64_t live = 0;
+		};
+	};
+}
@@ -0,0 +1,609 @@
+#pragma once
+
+#include "msvc.hpp"
+#include "bit-utils.hpp"
+#include "counter-kernels.hpp"
+#include "leaf-directory.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/*
+ * the bitvector leaves of b_spsi, as one template:
+ *
+ *	buffer_depth   insertions kept aside and applied to the words together,
+ *	               in one shifting pass (0: applied one by one), up to 64.
+ *	               They are a sorted array of positions, searched with the
+ *	               SIMD kernels of counter-kernels.hpp, and a word of values
+ *	shifting       how a run of bits is moved to open or close a gap:
+ *	               masked_shift moves whole words and masks the partial
+ *	               first one, bitwise_shift moves the bits of the partial
+ *	               first word one at a time
+ *	directory      rank/select directory of the leaf (leaf-directory.hpp)
+ *
+ * Every variant has its own name below, so that one translation unit (a
+ * benchmark, a test) can use several. The old headers
+ * (unbuffered_packed_vector.hpp, dynamic_packed_vector.hpp and
+ * buffer_{2,3,4}_packed_vector.hpp) alias dyn::packed_vector to one of them.
+ */
+
+namespace dyn {
+	/*
+	 * bits of the k-th word within [from, to)
+	 */
+	inline uint64_t bits_in_word(uint64_t const k, uint64_t const from, uint64_t const to) {
+		uint64_t const lo = std::max(from, k << 6) - (k << 6);
+		uint64_t const hi = std::min(to, (k + 1) << 6) - (k << 6);
+
+		if (lo >= hi) return 0;
+
+		uint64_t const below_hi = hi == 64 ? ~uint64_t(0) : (uint64_t(1) << hi) - 1;
+
+		return below_hi & ~((uint64_t(1) << lo) - 1);
+	}
+
+	/*
+	 * moves the bits [from, to) of words by s > 0 positions, a word at a
+	 * time. The bits outside the destination keep their value: the caller
+	 * writes the gap.
+	 */
+	struct masked_shift {
+		// [from, to) to [from + s, to + s). words must hold to + s bits
+		static void right(uint64_t* words, uint64_t const from, uint64_t const to, uint64_t const s) {
+			assert(s > 0);
+
+			if (from == to) return;
+
+			uint64_t const q = s >> 6;  // whole words
+			uint64_t const r = s & 63;
+			uint64_t const first = (from + s) >> 6;
+
+			// from the last word down, so that the sources are read before being overwritten
+			for (uint64_t k = ((to + s - 1) >> 6) + 1; k-- > first;) {
+				uint64_t w = words[k - q] << r;
+				if (r > 0 and k > q) w |= words[k - q - 1] >> (64 - r);
+
+				uint64_t const mask = bits_in_word(k, from + s, to + s);
+				words[k] = (words[k] & ~mask) | (w & mask);
+			}
+		}
+
+		// [from, to) to [from - s, to - s)
+		static void left(uint64_t* words, uint64_t const from, uint64_t const to, uint64_t const s) {
+			assert(s > 0 and s <= from);
+
+			if (from == to) return;
+
+			uint64_t const q = s >> 6;
+			uint64_t const r = s & 63;
+			uint64_t const last = (to - s - 1) >> 6;
+
+			for (uint64_t k = (from - s) >> 6; k <= last; ++k) {
+				uint64_t w = words[k + q] >> r;
+				if (r > 0 and ((k + q + 1) << 6) < to) w |= words[k + q + 1] << (64 - r);
+
+				uint64_t const mask = bits_in_word(k, from - s, to - s);
+				words[k] = (words[k] & ~mask) | (w & mask);
+			}
+		}
+	};
+
+	/*
+	 * as masked_shift, but the bits of the partial first word of the run are
+	 * moved one at a time
+	 */
+	struct bitwise_shift {
+		static void right(uint64_t* words, uint64_t const from, uint64_t const to, uint64_t const s) {
+			uint64_t const head = std::min(to, (from + 63) & ~uint64_t(63));
+
+			masked_shift::right(words, head, to, s);
+
+			for (uint64_t k = head; k-- > from;) set_bit(words, k + s, get_bit(words, k));
+		}
+
+		static void left(uint64_t* words, uint64_t const from, uint64_t const to, uint64_t const s) {
+			uint64_t const head = std::min(to, (from + 63) & ~uint64_t(63));
+
+			for (uint64_t k = from; k < head; ++k) set_bit(words, k - s, get_bit(words, k));
+
+			masked_shift::left(words, head, to, s);
+		}
+
+	private:
+		static bool get_bit(const uint64_t* words, uint64_t const i) { return (words[i >> 6] >> (i & 63)) & 1; }
+
+		static void set_bit(uint64_t* words, uint64_t const i, bool const x) {
+			words[i >> 6] = (words[i >> 6] & ~(uint64_t(1) << (i & 63))) | (uint64_t(x) << (i & 63));
+		}
+	};
+
+	template <uint32_t buffer_depth = 0, class shifting = masked_shift, class directory = no_directory>
+	class packed_bit_vector {
+		static_assert(buffer_depth <= 64, "the values of the pending insertions are the bits of one word");
+
+	public:
+		explicit packed_bit_vector(uint64_t const size = 0) : words(words_for(size)), size_(size) {
+			dir.update(words, size_, 0);
+		}
+
+		explicit packed_bit_vector(std::vector<uint64_t>&& _words, uint64_t const new_size)
+			: words(std::move(_words)), size_(new_size) {
+			assert(words_for(size_) <= words.size());
+			assert(tail_is_clear() && "uninitialized non-zero values in the end of the vector");
+
+			dir.update(words, size_, 0);
+			psum_ = dir.rank(words.data(), size_);
+		}
+
+		bool at(uint64_t const i) const {
+			assert(i < size());
+
+			uint32_t const k = pending_up_to(i);
+
+			if (k > 0 and pending_pos[k - 1] == i) return (pending_val >> (k - 1)) & 1;
+
+			return bit(i - k);
+		}
+
+		uint64_t psum() const {
+			return psum_ + __builtin_popcountll(pending_val);
+		}
+
+		/*
+		 * inclusive partial sum (i.e. up to element i included)
+		 */
+		uint64_t psum(uint64_t const i) const {
+			assert(i < size());
+
+			uint32_t const k = pending_up_to(i);
+
+			return pending_ones(k) + dir.rank(words.data(), i + 1 - k);
+		}
+
+		/*
+		 * smallest index j such that psum(j)>=x
+		 */
+		uint64_t search(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum());
+
+			return x == 0 ? 0 : select<true>(x);
+		}
+
+		/*
+		 * this function works only for bitvectors, and
+		 * is designed to support select_0. Returns first
+		 * position i such that the number of zeros before
+		 * i (included) is == x
+		 */
+		uint64_t search_0(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= size() - psum());
+
+			return x == 0 ? 0 : select<false>(x);
+		}
+
+		/*
+		 * smallest index j such that psum(j)+j>=x
+		 */
+		uint64_t search_r(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum() + size());
+
+			uint64_t s = 0;
+			uint64_t pos = 0;
+
+			// whole words before the answer, when the words are the whole content
+			if (pending == 0) {
+				auto const prefix = words_below<word_weight::ones_plus_bits>(words.data(), size_ >> 6, x);
+
+				s = prefix.weight;
+				pos = prefix.words << 6;
+			}
+
+			for (; pos < size() && s < x; ++pos) {
+				s += (uint64_t(1) + at(pos));
+			}
+
+			pos -= pos != 0;
+			return pos;
+		}
+
+		/*
+		 * true iif x is one of the partial sums  0, I_0, I_0+I_1, ...
+		 */
+		bool contains(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum());
+
+			uint64_t s = 0;
+
+			for (uint64_t j = 0; j < size() && s < x; ++j) {
+				s += at(j);
+			}
+
+			return s == x;
+		}
+
+		/*
+		 * true iif x is one of  0, I_0+1, I_0+I_1+2, ...
+		 */
+		bool contains_r(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum() + size());
+
+			uint64_t s = 0;
+
+			for (uint64_t j = 0; j < size() && s < x; ++j) {
+				s += (at(j) + uint64_t(1));
+			}
+
+			return s == x;
+		}
+
+		/*
+		 * set the i-th bit to val (to 0 if subtract)
+		 */
+		void increment(uint64_t const i, bool const val, bool const subtract = false) {
+			flush();
+
+			assert(i < size_);
+
+			bool const x = subtract ? false : val;
+
+			if (bit(i) == x) return;
+
+			write_bit(i, x);
+			x ? ++psum_ : --psum_;
+
+			dir.update(words, size_, i);
+		}
+
+		void append(uint64_t const x) {
+			push_back(x);
+		}
+
+		void remove(uint64_t const i) {
+			flush();
+
+			assert(i < size_);
+
+			bool const x = bit(i);
+
+			shifting::left(words.data(), i + 1, size_, 1);
+			write_bit(size_ - 1, false);
+
+			--size_;
+			psum_ -= x;
+
+			while (words.size() > words_for(size_) + extra_) {
+				words.pop_back();
+			}
+
+			dir.update(words, size_, i);
+
+			assert(tail_is_clear());
+		}
+
+		void insert(uint64_t const i, uint64_t const x) {
+			assert(i <= size());
+
+			if constexpr (buffer_depth == 0) {
+				insert_bits(i, x & 1, 1);
+			}
+			else {
+				if (pending == buffer_depth) flush();
+
+				// the pending insertions at or after i move up by one
+				uint32_t const k = i == 0 ? 0 : pending_up_to(i - 1);
+
+				std::copy_backward(pending_pos.begin() + k, pending_pos.begin() + pending,
+					pending_pos.begin() + pending + 1);
+				add_to_counters(pending_pos.data(), k + 1, pending + 1, 1);
+				pending_pos[k] = i;
+
+				uint64_t const below = low_bits(k);
+				pending_val = (pending_val & below) | ((pending_val & ~below) << 1) | (uint64_t(x & 1) << k);
+				++pending;
+			}
+		}
+
+		/*
+		 * efficient push-back, implemented with a push-back on the underlying
+		 * container. The pending insertions all come before the new last bit,
+		 * so they stay pending
+		 */
+		void push_back(bool const x) {
+			if (size_ == (words.size() << 6)) {
+				words.push_back(0);
+			}
+
+			write_bit(size_++, x);
+			psum_ += x;
+
+			dir.update(words, size_, size_ - 1);
+		}
+
+		uint64_t size() const {
+			return size_ + pending;
+		}
+
+		/*
+		 * split content of this vector into 2 packed blocks:
+		 * Left part remains in this block, right part in the
+		 * new returned block
+		 */
+		packed_bit_vector* split() {
+			return split([](std::vector<uint64_t>&& w, uint64_t n) { return new packed_bit_vector(std::move(w), n); });
+		}
+
+		/*
+		 * as split(), with the right block built by make_leaf(words, size)
+		 * (e.g. in the leaf pool of a tree)
+		 */
+		template <class make_leaf> packed_bit_vector* split(make_leaf&& make) {
+			flush();
+
+			uint64_t const tot_words = words_for(size_);
+
+			assert(tot_words <= words.size());
+
+			uint64_t const nr_left_words = tot_words >> 1;
+
+			assert(nr_left_words > 0);
+			assert(tot_words - nr_left_words > 0);
+
+			uint64_t const nr_left_ints = nr_left_words << 6;
+
+			assert(size_ > nr_left_ints);
+			uint64_t const nr_right_ints = size_ - nr_left_ints;
+
+			std::vector<uint64_t> right_words(tot_words - nr_left_words + extra_, 0);
+			std::copy(words.begin() + nr_left_words, words.begin() + tot_words, right_words.begin());
+			words.resize(nr_left_words + extra_);
+			std::fill(words.begin() + nr_left_words, words.end(), 0);
+			words.shrink_to_fit();
+
+			size_ = nr_left_ints;
+			dir.update(words, size_, 0);
+			psum_ = dir.rank(words.data(), size_);
+
+			packed_bit_vector* right = make(std::move(right_words), nr_right_ints);
+
+			assert(tail_is_clear());
+
+			return right;
+		}
+
+		/*
+		 * return total number of bits occupied in memory by this object instance
+		 */
+		uint64_t bit_size() const {
+			return (sizeof(packed_bit_vector) + words.capacity() * sizeof(uint64_t)) * 8 + dir.bit_size();
+		}
+
+		uint64_t width() const {
+			return 1;
+		}
+
+		/*
+		 * j-th word of the content, i.e. elements 64j ... 64j+63. Bits past
+		 * the end of the vector are 0.
+		 */
+		uint64_t word(uint64_t const j) const {
+			assert((j << 6) < size());
+
+			// no pending insertions: content is the words array
+			if (pending == 0) return words[j];
+
+			uint64_t w = 0;
+			auto const end = std::min((j + 1) << 6, size());
+			for (uint64_t k = j << 6; k < end; ++k) {
+				w |= uint64_t(at(k)) << (k & 63);
+			}
+
+			return w;
+		}
+
+		/*
+		 * insert the n integers of the given width packed in word at position i
+		 */
+		void insert_word(uint64_t i, uint64_t word, uint8_t const width, uint8_t const n) {
+			assert(i <= size());
+			assert(n);
+			assert(n * width <= sizeof(word) * 8);
+			assert(width * n == 64 || (word >> width * n) == 0);
+
+			if (n == 1) {
+				insert(i, word);
+			}
+			else if (width == 1) {
+				flush();
+				insert_bits(i, word, n);
+			}
+			else {
+				const uint64_t mask = (uint64_t(1) << width) - 1;
+				for (uint8_t k = 0; k < n; ++k) {
+					insert(i++, word & mask);
+					word >>= width;
+				}
+			}
+		}
+
+	private:
+		bool bit(uint64_t const i) const {
+			assert(i < size_);
+
+			return (words[i >> 6] >> (i & 63)) & 1;
+		}
+
+		void write_bit(uint64_t const i, bool const x) {
+			words[i >> 6] = (words[i >> 6] & ~(uint64_t(1) << (i & 63))) | (uint64_t(x) << (i & 63));
+		}
+
+		/*
+		 * room in the words for n more bits
+		 */
+		void reserve(uint64_t const n) {
+			if (size_ + n > (words.size() << 6)) {
+				words.resize(words_for(size_ + n) + extra_, 0);
+			}
+		}
+
+		/*
+		 * insert the n <= 64 bits of x at position i of the words (no pending
+		 * insertions)
+		 */
+		void insert_bits(uint64_t const i, uint64_t const x, uint64_t const n) {
+			assert(pending == 0);
+			assert(i <= size_ and n > 0 and n <= 64);
+
+			reserve(n);
+
+			shifting::right(words.data(), i, size_, n);
+
+			for (uint64_t k = 0; k < n; ++k) write_bit(i + k, (x >> k) & 1);
+
+			size_ += n;
+			psum_ += __builtin_popcountll(n == 64 ? x : x & ((uint64_t(1) << n) - 1));
+
+			dir.update(words, size_, i);
+		}
+
+		/*
+		 * apply the pending insertions in one pass over the words: the run of
+		 * words after the k-th pending insertion moves by k + 1, the last run
+		 * first
+		 */
+		void flush() {
+			if constexpr (buffer_depth > 0) {
+				if (pending == 0) return;
+
+				reserve(pending);
+
+				uint64_t end = size_;  // end of the current run, before the move
+
+				for (uint32_t k = pending; k-- > 0;) {
+					uint64_t const begin = pending_pos[k] - k;
+
+					shifting::right(words.data(), begin, end, k + 1);
+					write_bit(pending_pos[k], (pending_val >> k) & 1);
+
+					end = begin;
+				}
+
+				psum_ += __builtin_popcountll(pending_val);
+				size_ += pending;
+				pending = 0;
+				pending_val = 0;
+
+				dir.update(words, size_, pending_pos[0]);
+			}
+		}
+
+		/*
+		 * position of the x-th (1-based) bit equal to one, with the pending
+		 * insertions: the answer is in the words before the first pending
+		 * insertion whose prefix reaches x, or is that insertion. The prefixes
+		 * grow with the insertions, so that one is found by binary search
+		 */
+		template <bool one> uint64_t select(uint64_t const x) const {
+			// matching bits before the k-th pending insertion, in the words and pending
+			auto const before = [&](uint32_t const k) {
+				uint64_t const w = pending_pos[k] - k;
+				uint64_t const in_words = one ? dir.rank(words.data(), w) : w - dir.rank(words.data(), w);
+				uint64_t const ones = pending_ones(k);
+
+				return in_words + (one ? ones : k - ones);
+			};
+
+			auto const matches = [&](uint32_t const k) { return ((pending_val >> k) & 1) == one; };
+
+			// first k whose prefix, up to the k-th pending insertion included, reaches x
+			uint32_t low = 0;
+			uint32_t size = pending;
+
+			while (size > 0) {
+				uint32_t const half = size / 2;
+
+				if (before(low + half) + matches(low + half) >= x) {
+					size = half;
+				}
+				else {
+					low += half + 1;
+					size -= half + 1;
+				}
+			}
+
+			uint64_t const ones = pending_ones(low);
+			uint64_t const found = one ? ones : low - ones;  // matching pending bits before the k-th
+
+			if (low < pending and before(low) < x) return pending_pos[low];
+
+			return select_words<one>(x - found) + low;
+		}
+
+		/*
+		 * pending insertions at positions up to i
+		 */
+		uint32_t pending_up_to(uint64_t const i) const {
+			if constexpr (buffer_depth == 0) return 0;
+			else return first_greater<counter_of::a>(pending_pos.data(), pending_pos.data(), pending, i, UINT32_MAX);
+		}
+
+		/*
+		 * ones among the first k pending insertions
+		 */
+		uint64_t pending_ones(uint32_t const k) const {
+			return __builtin_popcountll(pending_val & low_bits(k));
+		}
+
+		static uint64_t low_bits(uint32_t const k) {
+			return k >= 64 ? ~uint64_t(0) : (uint64_t(1) << k) - 1;
+		}
+
+		template <bool one> uint64_t select_words(uint64_t const x) const {
+			if constexpr (one) return dir.select1(words.data(), size_, x);
+			else return dir.select0(words.data(), size_, x);
+		}
+
+		bool tail_is_clear() const {
+			return (size_ & 63) == 0 or (size_ >> 6) >= words.size() or (words[size_ >> 6] >> (size_ & 63)) == 0;
+		}
+
+		static constexpr uint8_t extra_ = 2;
+		std::vector<uint64_t> words{};
+		uint64_t psum_ = 0;  // bits set in the words
+		uint64_t size_ = 0;  // bits in the words
+		directory dir;
+
+		// pending insertions, by increasing final position, and their values (bit k of pending_val)
+		std::array<uint64_t, buffer_depth> pending_pos{};
+		uint64_t pending_val = 0;
+		uint32_t pending = 0;
+	};
+
+	/*
+	 * the leaf variants: every insertion applied at once with masked or
+	 * bitwise shifts, or up to 2, 3, 4 or K insertions buffered
+	 */
+	template <class directory = no_directory>
+	using unbuffered_packed_vector = packed_bit_vector<0, masked_shift, directory>;
+
+	template <class directory = no_directory>
+	using dynamic_packed_vector = packed_bit_vector<0, bitwise_shift, directory>;
+
+	template <class directory = no_directory>
+	using buffer_2_packed_vector = packed_bit_vector<2, masked_shift, directory>;
+
+	template <class directory = no_directory>
+	using buffer_3_packed_vector = packed_bit_vector<3, masked_shift, directory>;
+
+	template <class directory = no_directory>
+	using buffer_4_packed_vector = packed_bit_vector<4, masked_shift, directory>;
+
+	template <uint32_t K, class directory = no_directory>
+	using buffer_k_packed_vector = packed_bit_vector<K, masked_shift, directory>;
+}
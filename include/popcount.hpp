@@ -0,0 +1,230 @@
+#pragma once
+
+#include "cpu-features.hpp"
+#include "msvc.hpp"
+#include <cassert>
+#include <cstdint>
+
+#if DYN_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/*
+ * popcount kernels over arrays of words: total count, and the prefix scan
+ * that select uses to skip the words before its answer. Every kernel has a
+ * scalar, an SSE4.2 (POPCNT), an AVX2 and an AVX-512 (VPOPCNTQ) version;
+ * the one of the active tier (see cpu-features.hpp) is picked at run time.
+ */
+
+namespace dyn {
+	/*
+	 * what a word weighs in a prefix scan: its bits set, its bits not set, or
+	 * its bits set plus one per bit (the psum(j) + j of search_r)
+	 */
+	enum class word_weight { ones, zeros, ones_plus_bits };
+
+	/*
+	 * weight of nr_words words holding ones bits set
+	 */
+	template <word_weight wt> inline uint64_t weigh(uint64_t const ones, uint64_t const nr_words) {
+		if constexpr (wt == word_weight::ones) return ones;
+		else if constexpr (wt == word_weight::zeros) return (nr_words << 6) - ones;
+		else return (nr_words << 6) + ones;
+	}
+
+	/*
+	 * leading words of an array and their total weight
+	 */
+	struct word_prefix {
+		uint64_t words;
+		uint64_t weight;
+	};
+
+	inline uint64_t popcount_words_scalar(const uint64_t* words, uint64_t const n) {
+		uint64_t s = 0;
+
+		for (uint64_t j = 0; j < n; ++j) s += __builtin_popcountll(words[j]);
+
+		return s;
+	}
+
+	/*
+	 * longest prefix of words[0, n) weighing less than x
+	 */
+	template <word_weight wt>
+	inline word_prefix words_below_scalar(const uint64_t* words, uint64_t const n, uint64_t const x) {
+		uint64_t s = 0;
+		uint64_t j = 0;
+
+		for (; j < n; ++j) {
+			auto const w = weigh<wt>(__builtin_popcountll(words[j]), 1);
+			if (s + w >= x) break;
+			s += w;
+		}
+
+		return { j, s };
+	}
+
+#if DYN_X86_DISPATCH
+	/*
+	 * the scalar loops, with the POPCNT instruction instead of a bit trick
+	 */
+	DYN_TARGET("popcnt") inline uint64_t popcount_words_sse42(const uint64_t* words, uint64_t const n) {
+		uint64_t s = 0;
+
+		for (uint64_t j = 0; j < n; ++j) s += _mm_popcnt_u64(words[j]);
+
+		return s;
+	}
+
+	template <word_weight wt>
+	DYN_TARGET("popcnt") inline word_prefix words_below_sse42(const uint64_t* words, uint64_t const n,
+		uint64_t const x) {
+		uint64_t s = 0;
+		uint64_t j = 0;
+
+		for (; j < n; ++j) {
+			auto const w = weigh<wt>(_mm_popcnt_u64(words[j]), 1);
+			if (s + w >= x) break;
+			s += w;
+		}
+
+		return { j, s };
+	}
+
+	/*
+	 * counts of the 4 words of v (nibble lookup table, then sum of the bytes
+	 * of each word)
+	 */
+	DYN_TARGET("avx2") inline __m256i popcount4_avx2(__m256i const v) {
+		__m256i const table = _mm256_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		__m256i const low = _mm256_set1_epi8(0x0F);
+
+		__m256i const lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low));
+		__m256i const hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+
+		return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+	}
+
+	DYN_TARGET("avx2") inline uint64_t sum4_avx2(__m256i const v) {
+		__m128i const s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+
+		return uint64_t(_mm_cvtsi128_si64(s)) + uint64_t(_mm_extract_epi64(s, 1));
+	}
+
+	DYN_TARGET("avx2,popcnt") inline uint64_t popcount_words_avx2(const uint64_t* words, uint64_t const n) {
+		__m256i acc = _mm256_setzero_si256();
+		uint64_t j = 0;
+
+		for (; j + 4 <= n; j += 4) {
+			acc = _mm256_add_epi64(acc, popcount4_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + j))));
+		}
+
+		uint64_t s = sum4_avx2(acc);
+		for (; j < n; ++j) s += _mm_popcnt_u64(words[j]);
+
+		return s;
+	}
+
+	template <word_weight wt>
+	DYN_TARGET("avx2,popcnt") inline word_prefix words_below_avx2(const uint64_t* words, uint64_t const n,
+		uint64_t const x) {
+		uint64_t s = 0;
+		uint64_t j = 0;
+
+		// whole blocks of 4 words, then word by word in the block reaching x
+		for (; j + 4 <= n; j += 4) {
+			auto const ones = sum4_avx2(popcount4_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + j))));
+			auto const w = weigh<wt>(ones, 4);
+			if (s + w >= x) break;
+			s += w;
+		}
+
+		for (; j < n; ++j) {
+			auto const w = weigh<wt>(_mm_popcnt_u64(words[j]), 1);
+			if (s + w >= x) break;
+			s += w;
+		}
+
+		return { j, s };
+	}
+
+	/*
+	 * sum of the 8 words of v. _mm512_reduce_add_epi64 would do, but the
+	 * undefined vectors in its extracts trip -Wuninitialized in GCC 12
+	 */
+	DYN_TARGET("avx512f") inline uint64_t sum8_avx512(__m512i const v) {
+		return sum4_avx2(_mm256_add_epi64(_mm512_maskz_extracti64x4_epi64(0xF, v, 0), _mm512_maskz_extracti64x4_epi64(0xF, v, 1)));
+	}
+
+	DYN_TARGET("avx512f,avx512vpopcntdq") inline uint64_t popcount_words_avx512(const uint64_t* words,
+		uint64_t const n) {
+		__m512i acc = _mm512_setzero_si512();
+		uint64_t j = 0;
+
+		for (; j + 8 <= n; j += 8) {
+			acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512(words + j)));
+		}
+
+		// the last words with a masked load
+		if (j < n) {
+			__mmask8 const mask = (1u << (n - j)) - 1;
+			acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(mask, words + j)));
+		}
+
+		return sum8_avx512(acc);
+	}
+
+	template <word_weight wt>
+	DYN_TARGET("avx512f,avx512vpopcntdq,popcnt") inline word_prefix words_below_avx512(const uint64_t* words,
+		uint64_t const n, uint64_t const x) {
+		uint64_t s = 0;
+		uint64_t j = 0;
+
+		for (; j + 8 <= n; j += 8) {
+			auto const ones = sum8_avx512(_mm512_popcnt_epi64(_mm512_loadu_si512(words + j)));
+			auto const w = weigh<wt>(ones, 8);
+			if (s + w >= x) break;
+			s += w;
+		}
+
+		for (; j < n; ++j) {
+			auto const w = weigh<wt>(_mm_popcnt_u64(words[j]), 1);
+			if (s + w >= x) break;
+			s += w;
+		}
+
+		return { j, s };
+	}
+#endif
+
+	/*
+	 * number of bits set in words[0, n)
+	 */
+	inline uint64_t popcount_words(const uint64_t* words, uint64_t const n) {
+#if DYN_X86_DISPATCH
+		if (simd_enabled(simd_tier::avx512) and cpu.avx512_popcnt) return popcount_words_avx512(words, n);
+		if (simd_enabled(simd_tier::avx2)) return popcount_words_avx2(words, n);
+		if (simd_enabled(simd_tier::sse42)) return popcount_words_sse42(words, n);
+#endif
+
+		return popcount_words_scalar(words, n);
+	}
+
+	/*
+	 * longest prefix of words[0, n) weighing less than x, with its weight.
+	 * If it is shorter than n, the x-th unit of weight is in the next word.
+	 */
+	template <word_weight wt>
+	inline word_prefix words_below(const uint64_t* words, uint64_t const n, uint64_t const x) {
+#if DYN_X86_DISPATCH
+		if (simd_enabled(simd_tier::avx512) and cpu.avx512_popcnt) return words_below_avx512<wt>(words, n, x);
+		if (simd_enabled(simd_tier::avx2)) return words_below_avx2<wt>(words, n, x);
+		if (simd_enabled(simd_tier::sse42)) return words_below_sse42<wt>(words, n, x);
+#endif
+
+		return words_below_scalar<wt>(words, n, x);
+	}
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dyn {
+	/*
+	 * fixed set of threads running the tasks 0, ..., n-1 of a job. Tasks are
+	 * handed out one at a time from a shared counter, so that threads that
+	 * finish early keep taking work from the slow ones. The calling thread
+	 * takes part in the job.
+	 */
+	class thread_pool {
+	public:
+		/*
+		 * pool of nr_threads threads, the calling one included
+		 */
+		explicit thread_pool(unsigned nr_threads) {
+			assert(nr_threads > 0);
+
+			for (unsigned t = 1; t < nr_threads; ++t) workers.emplace_back([this] { work(); });
+		}
+
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+
+		~thread_pool() {
+			{
+				std::lock_guard<std::mutex> lock(m);
+				stop = true;
+			}
+
+			start.notify_all();
+
+			for (auto& w : workers) w.join();
+		}
+
+		unsigned size() const { return workers.size() + 1; }
+
+		/*
+		 * run task(k) for every k < nr_tasks, and return when all are done
+		 */
+		void run(uint64_t nr_tasks, const std::function<void(uint64_t)>& task) {
+			{
+				std::lock_guard<std::mutex> lock(m);
+				job = &task;
+				tasks = nr_tasks;
+				next = 0;
+				busy = workers.size();
+				++generation;
+			}
+
+			start.notify_all();
+
+			drain(task, nr_tasks);
+
+			std::unique_lock<std::mutex> lock(m);
+			done.wait(lock, [this] { return busy == 0; });
+			job = nullptr;
+		}
+
+	private:
+		void drain(const std::function<void(uint64_t)>& task, uint64_t nr_tasks) {
+			for (uint64_t k = next++; k < nr_tasks; k = next++) task(k);
+		}
+
+		void work() {
+			uint64_t seen = 0;
+
+			while (true) {
+				const std::function<void(uint64_t)>* task;
+				uint64_t nr_tasks;
+
+				{
+					std::unique_lock<std::mutex> lock(m);
+					start.wait(lock, [&] { return stop or generation != seen; });
+
+					if (stop) return;
+
+					seen = generation;
+					task = job;
+					nr_tasks = tasks;
+				}
+
+				drain(*task, nr_tasks);
+
+				std::lock_guard<std::mutex> lock(m);
+				if (--busy == 0) done.notify_one();
+			}
+		}
+
+		std::vector<std::thread> workers;
+
+		std::mutex m;
+		std::condition_variable start;
+		std::condition_variable done;
+
+		const std::function<void(uint64_t)>* job = nullptr;
+		uint64_t tasks = 0;
+		std::atomic<uint64_t> next{ 0 };
+		uint64_t generation = 0;
+		uint64_t busy = 0;
+		bool stop = false;
+	};
+
+	/*
+	 * answers batches of access/rank/select queries on a bitvector using
+	 * several threads. The bitvector must not be modified while a batch runs.
+	 *
+	 * The batch is bucketed by key (a counting sort on the high part of the
+	 * key) and cut into slices holding the same number of queries. A slice
+	 * thus covers a narrow range of positions (or of ranks, for select) and
+	 * is answered with one batched traversal of the few subtrees covering
+	 * it. Slices are taken by the threads of the pool as they become idle.
+	 * Results are returned in the original order.
+	 */
+	template <class bitvector_type>
+	class query_executor {
+	public:
+		/*
+		 * executor on bv, with nr_threads threads (default: one per core)
+		 */
+		explicit query_executor(const bitvector_type& bv, unsigned nr_threads = 0)
+			: bv(bv), pool(nr_threads ? nr_threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+		unsigned threads() const { return pool.size(); }
+
+		/*
+		 * out[k] = bv.at(i[k]) for k < n
+		 */
+		void at(const uint64_t* i, uint64_t n, uint64_t* out) {
+			execute(i, n, bv.size(), out, [this](const uint64_t* q, uint64_t m, uint64_t* r) {
+				bv.at_batch(q, m, r);
+			});
+		}
+
+		/*
+		 * out[k] = bv.rank(i[k], b) for k < n
+		 */
+		void rank(const uint64_t* i, uint64_t n, uint64_t* out, bool b = true) {
+			execute(i, n, bv.size() + 1, out, [this, b](const uint64_t* q, uint64_t m, uint64_t* r) {
+				bv.rank_batch(q, m, r, b);
+			});
+		}
+
+		/*
+		 * out[k] = bv.select(i[k], b) for k < n
+		 */
+		void select(const uint64_t* i, uint64_t n, uint64_t* out, bool b = true) {
+			execute(i, n, b ? bv.rank1() + 1 : bv.rank0() + 1, out,
+				[this, b](const uint64_t* q, uint64_t m, uint64_t* r) {
+					bv.select_batch(q, m, r, b);
+				});
+		}
+
+	private:
+		// batches smaller than this are not worth waking up the pool
+		static constexpr uint64_t min_parallel_batch = 4096;
+
+		// number of slices per thread: more slices balance the load better
+		static constexpr uint64_t slices_per_thread = 8;
+
+		// number of key buckets per slice of the counting sort
+		static constexpr uint64_t buckets_per_slice = 64;
+
+		/*
+		 * keys are in [0, universe)
+		 */
+		template <class batch_function>
+		void execute(const uint64_t* keys, uint64_t n, uint64_t universe, uint64_t* out,
+			const batch_function& batch) {
+			if (n < min_parallel_batch or threads() == 1) {
+				batch(keys, n, out);
+				return;
+			}
+
+			uint64_t const nr_slices = slices_per_thread * threads();
+			uint64_t const nr_buckets = buckets_per_slice * nr_slices;
+			uint64_t const width = universe / nr_buckets + 1;
+
+			// counting sort of the queries by bucket
+			std::vector<uint64_t> begin(nr_buckets + 1, 0);
+			for (uint64_t k = 0; k < n; ++k) {
+				assert(keys[k] < universe);
+				++begin[keys[k] / width + 1];
+			}
+
+			for (uint64_t b = 0; b < nr_buckets; ++b) begin[b + 1] += begin[b];
+
+			std::vector<uint64_t> sorted_keys(n);
+			std::vector<uint64_t> index(n);
+
+			for (uint64_t k = 0; k < n; ++k) {
+				auto const p = begin[keys[k] / width]++;
+				sorted_keys[p] = keys[k];
+				index[p] = k;
+			}
+
+			std::vector<uint64_t> results(n);
+
+			// slices of (almost) the same size, whatever the distribution of the
+			// keys. Each slice is sorted by the batched traversal itself
+			pool.run(nr_slices, [&](uint64_t s) {
+				uint64_t const b = (n * s) / nr_slices;
+				uint64_t const e = (n * (s + 1)) / nr_slices;
+
+				if (b == e) return;
+
+				batch(sorted_keys.data() + b, e - b, results.data() + b);
+
+				for (uint64_t k = b; k < e; ++k) out[index[k]] = results[k];
+			});
+		}
+
+		const bitvector_type& bv;
+		thread_pool pool;
+	};
+}
@@ -0,0 +1,631 @@
+#pragma once
+
+#include "bit-utils.hpp"
+#include "packed-vector.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/*
+ * a run-length coded bitvector leaf of b_spsi, for sparse or clustered
+ * bitvectors: the content is a sequence of runs of zeros and ones,
+ * alternating and starting with zeros (the first run may be empty). Run
+ * lengths are varints (7 bits per byte), so a run shorter than 128 bits
+ * takes one byte.
+ *
+ * The runs are cut into blocks of about block_runs runs (an even number, so
+ * that every block starts with a run of zeros). Three arrays of headers keep,
+ * for every block, the bits and the ones before it and the offset of its
+ * code; queries binary search them and decode one block. An update decodes
+ * the block it falls in, edits its runs and codes it again; a block twice
+ * as long as block_runs is split in two.
+ */
+
+namespace dyn {
+	/*
+	 * number of runs of equal bits among the first n bits of words
+	 */
+	inline uint64_t count_runs(const uint64_t* words, uint64_t const n) {
+		if (n == 0) return 0;
+
+		uint64_t changes = 0;
+		uint64_t carry = words[0] & 1;  // bit before the current one: no change at bit 0
+
+		for (uint64_t k = 0; k < words_for(n); ++k) {
+			uint64_t const w = words[k];
+			uint64_t x = w ^ ((w << 1) | carry);
+
+			if (((k + 1) << 6) > n) x &= (uint64_t(1) << (n & 63)) - 1;
+
+			changes += __builtin_popcountll(x);
+			carry = w >> 63;
+		}
+
+		return changes + 1;
+	}
+
+	template <uint32_t block_runs = 32>
+	class rle_bit_vector {
+		static_assert(block_runs >= 2 and block_runs % 2 == 0, "blocks start with a run of zeros");
+
+	public:
+		explicit rle_bit_vector(uint64_t const size = 0) {
+			std::vector<uint64_t> runs;
+			if (size > 0) runs.push_back(size);
+
+			build(runs);
+		}
+
+		explicit rle_bit_vector(std::vector<uint64_t>&& _words, uint64_t const new_size) {
+			assert(words_for(new_size) <= _words.size());
+
+			build(runs_of(_words.data(), new_size));
+		}
+
+		bool at(uint64_t const i) const {
+			assert(i < size());
+
+			bool found = false;
+
+			scan(block_of(i), [&](uint64_t const pos, uint64_t, uint64_t const len, bool const one) {
+				if (pos + len <= i) return true;
+
+				found = one;
+				return false;
+			});
+
+			return found;
+		}
+
+		uint64_t psum() const {
+			return block_ones.back();
+		}
+
+		/*
+		 * inclusive partial sum (i.e. up to element i included)
+		 */
+		uint64_t psum(uint64_t const i) const {
+			assert(i < size());
+
+			uint64_t s = 0;
+
+			scan(block_of(i), [&](uint64_t const pos, uint64_t const ones, uint64_t const len, bool const one) {
+				if (pos + len <= i) return true;
+
+				s = ones + (one ? i - pos + 1 : 0);
+				return false;
+			});
+
+			return s;
+		}
+
+		/*
+		 * smallest index j such that psum(j)>=x
+		 */
+		uint64_t search(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum());
+
+			return x == 0 ? 0 : select<true>(x);
+		}
+
+		/*
+		 * this function works only for bitvectors, and
+		 * is designed to support select_0. Returns first
+		 * position i such that the number of zeros before
+		 * i (included) is == x
+		 */
+		uint64_t search_0(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= size() - psum());
+
+			return x == 0 ? 0 : select<false>(x);
+		}
+
+		/*
+		 * smallest index j such that psum(j)+j>=x
+		 */
+		uint64_t search_r(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum() + size());
+
+			if (x == 0) return 0;
+
+			// every bit weighs 1 plus its value: the first block whose prefix reaches x
+			uint32_t const b = last_block_below([&](uint32_t const k) { return block_bits[k] + block_ones[k]; }, x);
+			uint64_t j = 0;
+
+			scan(b, [&](uint64_t const pos, uint64_t const ones, uint64_t const len, bool const one) {
+				uint64_t const s = pos + ones;  // weight before the run
+
+				if (s + len * (1 + one) < x) return true;
+
+				j = pos + (x - s + one) / (1 + one) - 1;
+				return false;
+			});
+
+			return j;
+		}
+
+		/*
+		 * true iif x is one of the partial sums  0, I_0, I_0+I_1, ...
+		 */
+		bool contains(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum());
+
+			return x == 0 or psum(search(x)) == x;
+		}
+
+		/*
+		 * true iif x is one of  0, I_0+1, I_0+I_1+2, ...
+		 */
+		bool contains_r(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum() + size());
+
+			if (x == 0) return true;
+
+			uint64_t const j = search_r(x);
+
+			return psum(j) + j + 1 == x;
+		}
+
+		/*
+		 * set the i-th bit to val (to 0 if subtract)
+		 */
+		void increment(uint64_t const i, bool const val, bool const subtract = false) {
+			assert(i < size());
+
+			bool const x = subtract ? false : val;
+
+			if (at(i) == x) return;
+
+			uint32_t const b = block_of(i);
+			auto runs = decode(b);
+
+			remove_from(runs, i - block_bits[b]);
+			insert_into(runs, i - block_bits[b], x);
+
+			update(b, runs, 0, x ? 1 : -1);
+		}
+
+		void append(uint64_t const x) {
+			push_back(x);
+		}
+
+		void remove(uint64_t const i) {
+			assert(i < size());
+
+			bool const x = at(i);
+			uint32_t const b = block_of(i);
+			auto runs = decode(b);
+
+			remove_from(runs, i - block_bits[b]);
+
+			update(b, runs, -1, x ? -1 : 0);
+		}
+
+		void insert(uint64_t const i, uint64_t const x) {
+			assert(i <= size());
+
+			bool const one = x & 1;
+			uint32_t const b = i == size() ? nr_blocks() - 1 : block_of(i);
+			auto runs = decode(b);
+
+			insert_into(runs, i - block_bits[b], one);
+
+			update(b, runs, 1, one);
+		}
+
+		void push_back(bool const x) {
+			insert(size(), x);
+		}
+
+		uint64_t size() const {
+			return block_bits.back();
+		}
+
+		/*
+		 * number of runs (an empty first run of zeros included)
+		 */
+		uint64_t runs() const {
+			uint64_t n = 0;
+
+			for (uint32_t b = 0; b < nr_blocks(); ++b) {
+				scan(b, [&](uint64_t, uint64_t, uint64_t, bool) {
+					++n;
+					return true;
+				});
+			}
+
+			return n;
+		}
+
+		/*
+		 * bits taken by the code and the block headers
+		 */
+		uint64_t coded_bits() const {
+			return 8 * code.size() + 96 * (nr_blocks() + 1);
+		}
+
+		/*
+		 * coded_bits() of the first n bits of words, once run-length coded
+		 */
+		static uint64_t coded_bits(const uint64_t* words, uint64_t const n) {
+			auto const runs = runs_of(words, n);
+			uint64_t bytes = 0;
+
+			for (uint64_t const r : runs) bytes += 1 + (63 - __builtin_clzll(r | 1)) / 7;
+
+			return 8 * bytes + 96 * ((runs.size() + block_runs - 1) / block_runs + 1);
+		}
+
+		/*
+		 * split content of this vector into 2 blocks:
+		 * Left part remains in this block, right part in the
+		 * new returned block
+		 */
+		rle_bit_vector* split() {
+			return split([](std::vector<uint64_t>&& w, uint64_t n) { return new rle_bit_vector(std::move(w), n); });
+		}
+
+		/*
+		 * as split(), with the right block built by make_leaf(words, size)
+		 * (e.g. in the leaf pool of a tree). The halves are cut at a word
+		 * boundary, as in packed_bit_vector
+		 */
+		template <class make_leaf> auto split(make_leaf&& make) {
+			auto words = to_words();
+
+			uint64_t const tot_words = words_for(size());
+			uint64_t const nr_left_words = tot_words >> 1;
+
+			assert(nr_left_words > 0);
+			assert(tot_words - nr_left_words > 0);
+
+			uint64_t const nr_left_ints = nr_left_words << 6;
+
+			assert(size() > nr_left_ints);
+			uint64_t const nr_right_ints = size() - nr_left_ints;
+
+			std::vector<uint64_t> right_words(words.begin() + nr_left_words, words.begin() + tot_words);
+
+			build(runs_of(words.data(), nr_left_ints));
+
+			return make(std::move(right_words), nr_right_ints);
+		}
+
+		/*
+		 * return total number of bits occupied in memory by this object instance
+		 */
+		uint64_t bit_size() const {
+			return 8 * (sizeof(rle_bit_vector) + code.capacity() +
+				sizeof(uint32_t) * (block_bits.capacity() + block_ones.capacity() + block_byte.capacity()));
+		}
+
+		uint64_t width() const {
+			return 1;
+		}
+
+		/*
+		 * j-th word of the content, i.e. elements 64j ... 64j+63. Bits past
+		 * the end of the vector are 0.
+		 */
+		uint64_t word(uint64_t const j) const {
+			assert((j << 6) < size());
+
+			uint64_t const from = j << 6;
+			uint64_t const to = std::min(from + 64, size());
+			uint64_t w = 0;
+
+			for (uint32_t b = block_of(from); b < nr_blocks() and block_bits[b] < to; ++b) {
+				scan(b, [&](uint64_t const pos, uint64_t, uint64_t const len, bool const one) {
+					if (one and pos + len > from) w |= bits_in_word(0, std::max(pos, from) - from, std::min(pos + len, to) - from);
+
+					return pos + len < to;
+				});
+			}
+
+			return w;
+		}
+
+		/*
+		 * insert the n integers of the given width packed in word at position i
+		 */
+		void insert_word(uint64_t i, uint64_t word, uint8_t const width, uint8_t const n) {
+			assert(i <= size());
+			assert(n);
+			assert(n * width <= sizeof(word) * 8);
+			assert(width * n == 64 || (word >> width * n) == 0);
+
+			const uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+			for (uint8_t k = 0; k < n; ++k) {
+				insert(i++, word & mask);
+				word >>= width;
+			}
+		}
+
+	private:
+		uint32_t nr_blocks() const {
+			return block_bits.size() - 1;
+		}
+
+		/*
+		 * block holding the i-th bit (i < size)
+		 */
+		uint32_t block_of(uint64_t const i) const {
+			return std::upper_bound(block_bits.begin(), block_bits.end(), i) - block_bits.begin() - 1;
+		}
+
+		/*
+		 * last block b with before(b) < x, where before grows with b and
+		 * before(0) = 0 < x <= before(nr_blocks())
+		 */
+		template <class weight> uint32_t last_block_below(weight&& before, uint64_t const x) const {
+			uint32_t low = 0;
+			uint32_t n = nr_blocks();
+
+			while (n > 1) {
+				uint32_t const half = n / 2;
+
+				if (before(low + half) < x) low += half;
+				n -= half;
+			}
+
+			return low;
+		}
+
+		template <bool one> uint64_t select(uint64_t const x) const {
+			auto const matching = [&](uint32_t const k) {
+				return one ? block_ones[k] : block_bits[k] - block_ones[k];
+			};
+
+			uint64_t j = 0;
+
+			scan(last_block_below(matching, x), [&](uint64_t const pos, uint64_t const ones, uint64_t const len, bool const bit) {
+				uint64_t const before = one ? ones : pos - ones;
+
+				if (bit != one or before + len < x) return true;
+
+				j = pos + (x - before) - 1;
+				return false;
+			});
+
+			return j;
+		}
+
+		/*
+		 * f(position, ones before, length, bit) on the runs of block b, in
+		 * order, while f returns true
+		 */
+		template <class visit> void scan(uint32_t const b, visit&& f) const {
+			const uint8_t* p = code.data() + block_byte[b];
+			const uint8_t* const end = code.data() + block_byte[b + 1];
+
+			uint64_t pos = block_bits[b];
+			uint64_t ones = block_ones[b];
+
+			for (bool one = false; p < end; one = not one) {
+				uint64_t const len = get_varint(p);
+
+				if (not f(pos, ones, len, one)) return;
+
+				pos += len;
+				if (one) ones += len;
+			}
+		}
+
+		std::vector<uint64_t> decode(uint32_t const b) const {
+			std::vector<uint64_t> runs;
+
+			scan(b, [&](uint64_t, uint64_t, uint64_t const len, bool) {
+				runs.push_back(len);
+				return true;
+			});
+
+			return runs;
+		}
+
+		/*
+		 * a bit x at offset i of the runs: one run grows, or splits around a
+		 * new run of one bit
+		 */
+		static void insert_into(std::vector<uint64_t>& runs, uint64_t const i, bool const x) {
+			uint64_t pos = 0;
+			uint64_t k = 0;
+
+			for (; k < runs.size() and pos + runs[k] <= i; ++k) pos += runs[k];
+
+			if (k == runs.size()) {
+				// at the end: the last run grows, or a new one starts
+				if (runs.empty() and x) runs.push_back(0);
+
+				if (not runs.empty() and ((runs.size() - 1) & 1) == x) ++runs.back();
+				else runs.push_back(1);
+			}
+			else if ((k & 1) == x) {
+				++runs[k];
+			}
+			else if (i == pos and k > 0) {
+				++runs[k - 1];
+			}
+			else {
+				uint64_t const after = pos + runs[k] - i;
+
+				runs[k] = i - pos;
+				runs.insert(runs.begin() + k + 1, { 1, after });
+			}
+		}
+
+		/*
+		 * remove the bit at offset i of the runs; an emptied run merges its
+		 * neighbours (only the first run may stay empty)
+		 */
+		static void remove_from(std::vector<uint64_t>& runs, uint64_t const i) {
+			uint64_t pos = 0;
+			uint64_t k = 0;
+
+			for (; pos + runs[k] <= i; ++k) pos += runs[k];
+
+			if (--runs[k] > 0) return;
+
+			if (k + 1 == runs.size()) {
+				runs.pop_back();
+				if (runs.size() == 1 and runs[0] == 0) runs.clear();
+			}
+			else if (k > 0) {
+				runs[k - 1] += runs[k + 1];
+				runs.erase(runs.begin() + k, runs.begin() + k + 2);
+			}
+		}
+
+		/*
+		 * block b now has the given runs, with delta_bits bits and delta_ones
+		 * ones more: code it again (in two blocks if it grew too long, in none
+		 * if it is empty) and move the headers after it
+		 */
+		void update(uint32_t const b, std::vector<uint64_t> const& runs, int64_t const delta_bits, int64_t const delta_ones) {
+			uint64_t const half = runs.size() > 2 * block_runs ? (runs.size() / 2) & ~uint64_t(1) : runs.size();
+
+			std::vector<uint8_t> bytes;
+			uint64_t half_bits = 0;
+			uint64_t half_ones = 0;
+
+			for (uint64_t k = 0; k < half; ++k) {
+				put_varint(bytes, runs[k]);
+				half_bits += runs[k];
+				if (k & 1) half_ones += runs[k];
+			}
+
+			uint64_t const half_bytes = bytes.size();
+
+			for (uint64_t k = half; k < runs.size(); ++k) put_varint(bytes, runs[k]);
+
+			int64_t const delta_bytes = int64_t(bytes.size()) - int64_t(block_byte[b + 1] - block_byte[b]);
+
+			code.erase(code.begin() + block_byte[b], code.begin() + block_byte[b + 1]);
+			code.insert(code.begin() + block_byte[b], bytes.begin(), bytes.end());
+
+			for (uint32_t k = b + 1; k <= nr_blocks(); ++k) {
+				block_bits[k] += delta_bits;
+				block_ones[k] += delta_ones;
+				block_byte[k] += delta_bytes;
+			}
+
+			if (half < runs.size()) {
+				block_bits.insert(block_bits.begin() + b + 1, block_bits[b] + half_bits);
+				block_ones.insert(block_ones.begin() + b + 1, block_ones[b] + half_ones);
+				block_byte.insert(block_byte.begin() + b + 1, block_byte[b] + half_bytes);
+			}
+			else if (runs.empty() and nr_blocks() > 1) {
+				block_bits.erase(block_bits.begin() + b);
+				block_ones.erase(block_ones.begin() + b);
+				block_byte.erase(block_byte.begin() + b);
+			}
+
+			assert(block_bits[0] == 0 and block_ones[0] == 0 and block_byte[0] == 0);
+		}
+
+		/*
+		 * code the runs, block_runs per block
+		 */
+		void build(std::vector<uint64_t> const& runs) {
+			code.clear();
+			block_bits.assign(1, 0);
+			block_ones.assign(1, 0);
+			block_byte.assign(1, 0);
+
+			uint64_t bits = 0;
+			uint64_t ones = 0;
+
+			for (uint64_t k = 0; k < runs.size(); ++k) {
+				put_varint(code, runs[k]);
+				bits += runs[k];
+				if (k & 1) ones += runs[k];
+
+				if ((k + 1) % block_runs == 0 and k + 1 < runs.size()) push_header(bits, ones);
+			}
+
+			push_header(bits, ones);
+
+			code.shrink_to_fit();
+		}
+
+		void push_header(uint64_t const bits, uint64_t const ones) {
+			assert(bits <= UINT32_MAX);
+
+			block_bits.push_back(bits);
+			block_ones.push_back(ones);
+			block_byte.push_back(code.size());
+		}
+
+		/*
+		 * lengths of the runs of the first n bits of words, starting with zeros
+		 */
+		static std::vector<uint64_t> runs_of(const uint64_t* words, uint64_t const n) {
+			std::vector<uint64_t> runs;
+			uint64_t pos = 0;
+
+			for (bool one = false; pos < n; one = not one) {
+				// first bit at or after pos that differs from one
+				uint64_t next = n;
+
+				for (uint64_t k = pos >> 6; (k << 6) < n; ++k) {
+					uint64_t w = one ? ~words[k] : words[k];
+					if (k == (pos >> 6)) w &= ~uint64_t(0) << (pos & 63);
+
+					if (w) {
+						next = std::min(n, (k << 6) + __builtin_ctzll(w));
+						break;
+					}
+				}
+
+				runs.push_back(next - pos);
+				pos = next;
+			}
+
+			return runs;
+		}
+
+		std::vector<uint64_t> to_words() const {
+			std::vector<uint64_t> words(words_for(size()), 0);
+
+			for (uint32_t b = 0; b < nr_blocks(); ++b) {
+				scan(b, [&](uint64_t const pos, uint64_t, uint64_t const len, bool const one) {
+					if (one and len > 0) {
+						for (uint64_t k = pos >> 6; k <= (pos + len - 1) >> 6; ++k) words[k] |= bits_in_word(k, pos, pos + len);
+					}
+
+					return true;
+				});
+			}
+
+			return words;
+		}
+
+		static void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+			for (; v >= 128; v >>= 7) out.push_back(uint8_t(v) | 128);
+
+			out.push_back(uint8_t(v));
+		}
+
+		static uint64_t get_varint(const uint8_t*& p) {
+			uint64_t v = 0;
+
+			for (uint32_t s = 0;; s += 7) {
+				uint8_t const b = *p++;
+				v |= uint64_t(b & 127) << s;
+
+				if (b < 128) return v;
+			}
+		}
+
+		std::vector<uint8_t> code{};
+		// per block, and after the last one: bits and ones before it, offset of its code
+		std::vector<uint32_t> block_bits{};
+		std::vector<uint32_t> block_ones{};
+		std::vector<uint32_t> block_byte{};
+	};
+}
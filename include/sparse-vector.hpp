@@ -0,0 +1,288 @@
+#pragma once
+
+#include "bit-utils.hpp"
+#include "counter-kernels.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/*
+ * a bitvector leaf of b_spsi for very sparse content: the sorted positions
+ * of its ones, 32 bits each. rank and select are binary searches on the
+ * positions; an insertion or a removal moves up or down the positions after
+ * it (with the SIMD counter kernels of counter-kernels.hpp). Takes less room
+ * than a bit array below one bit set in 32.
+ */
+
+namespace dyn {
+	class sparse_bit_vector {
+	public:
+		explicit sparse_bit_vector(uint64_t const size = 0) : size_(size) {
+			assert(size <= UINT32_MAX);
+		}
+
+		explicit sparse_bit_vector(std::vector<uint64_t>&& _words, uint64_t const new_size) : size_(new_size) {
+			assert(new_size <= UINT32_MAX);
+			assert(words_for(new_size) <= _words.size());
+
+			for (uint64_t k = 0; k < words_for(size_); ++k) {
+				for (uint64_t w = _words[k]; w; w &= w - 1) {
+					uint64_t const p = (k << 6) + __builtin_ctzll(w);
+					if (p < size_) ones.push_back(p);
+				}
+			}
+
+			ones.shrink_to_fit();
+		}
+
+		bool at(uint64_t const i) const {
+			assert(i < size());
+
+			return std::binary_search(ones.begin(), ones.end(), i);
+		}
+
+		uint64_t psum() const {
+			return ones.size();
+		}
+
+		/*
+		 * inclusive partial sum (i.e. up to element i included)
+		 */
+		uint64_t psum(uint64_t const i) const {
+			assert(i < size());
+
+			return std::upper_bound(ones.begin(), ones.end(), i) - ones.begin();
+		}
+
+		/*
+		 * smallest index j such that psum(j)>=x
+		 */
+		uint64_t search(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum());
+
+			return x == 0 ? 0 : ones[x - 1];
+		}
+
+		/*
+		 * this function works only for bitvectors, and
+		 * is designed to support select_0. Returns first
+		 * position i such that the number of zeros before
+		 * i (included) is == x
+		 */
+		uint64_t search_0(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= size() - psum());
+
+			if (x == 0) return 0;
+
+			// the ones before the x-th zero: those with fewer than x zeros before them
+			uint64_t low = 0;
+			uint64_t n = ones.size();
+
+			while (n > 0) {
+				uint64_t const half = n / 2;
+
+				if (ones[low + half] - (low + half) < x) {
+					low += half + 1;
+					n -= half + 1;
+				}
+				else {
+					n = half;
+				}
+			}
+
+			return x - 1 + low;
+		}
+
+		/*
+		 * smallest index j such that psum(j)+j>=x
+		 */
+		uint64_t search_r(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum() + size());
+
+			if (x == 0) return 0;
+
+			// the ones before j: those whose prefix psum + position + 1 stays below x
+			uint64_t low = 0;
+			uint64_t n = ones.size();
+
+			while (n > 0) {
+				uint64_t const half = n / 2;
+
+				if (ones[low + half] + low + half + 2 < x) {
+					low += half + 1;
+					n -= half + 1;
+				}
+				else {
+					n = half;
+				}
+			}
+
+			// each bit weighs 1, and 2 if it is the next one
+			uint64_t const j = x - 1 - low;
+
+			return low < ones.size() and ones[low] < j ? ones[low] : j;
+		}
+
+		/*
+		 * true iif x is one of the partial sums  0, I_0, I_0+I_1, ...
+		 */
+		bool contains([[maybe_unused]] uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum());
+
+			// every count of ones up to psum() is reached by some prefix
+			return true;
+		}
+
+		/*
+		 * true iif x is one of  0, I_0+1, I_0+I_1+2, ...
+		 */
+		bool contains_r(uint64_t const x) const {
+			assert(size() > 0);
+			assert(x <= psum() + size());
+
+			if (x == 0) return true;
+
+			uint64_t const j = search_r(x);
+
+			return psum(j) + j + 1 == x;
+		}
+
+		/*
+		 * set the i-th bit to val (to 0 if subtract)
+		 */
+		void increment(uint64_t const i, bool const val, bool const subtract = false) {
+			assert(i < size());
+
+			bool const x = subtract ? false : val;
+			auto const it = std::lower_bound(ones.begin(), ones.end(), i);
+			bool const set = it != ones.end() and *it == i;
+
+			if (set and not x) ones.erase(it);
+			if (x and not set) ones.insert(it, i);
+		}
+
+		void append(uint64_t const x) {
+			push_back(x);
+		}
+
+		void remove(uint64_t const i) {
+			assert(i < size());
+
+			uint32_t k = std::lower_bound(ones.begin(), ones.end(), i) - ones.begin();
+
+			if (k < ones.size() and ones[k] == i) ones.erase(ones.begin() + k);
+
+			add_to_counters(ones.data(), k, ones.size(), ~uint64_t(0));
+			--size_;
+		}
+
+		void insert(uint64_t const i, uint64_t const x) {
+			assert(i <= size());
+			assert(size_ < UINT32_MAX);
+
+			uint32_t const k = std::lower_bound(ones.begin(), ones.end(), i) - ones.begin();
+
+			add_to_counters(ones.data(), k, ones.size(), 1);
+			if (x & 1) ones.insert(ones.begin() + k, i);
+
+			++size_;
+		}
+
+		void push_back(bool const x) {
+			if (x) ones.push_back(size_);
+
+			++size_;
+		}
+
+		uint64_t size() const {
+			return size_;
+		}
+
+		/*
+		 * as split() below, with the right block built by make_leaf(words,
+		 * size) (e.g. in the leaf pool of a tree). The halves are cut at a
+		 * word boundary, as in packed_bit_vector
+		 */
+		template <class make_leaf> auto split(make_leaf&& make) {
+			uint64_t const nr_left_ints = (words_for(size_) >> 1) << 6;
+
+			assert(nr_left_ints > 0 and size_ > nr_left_ints);
+
+			uint64_t const nr_right_ints = size_ - nr_left_ints;
+			auto const first_right = std::lower_bound(ones.begin(), ones.end(), nr_left_ints);
+
+			std::vector<uint64_t> right_words(words_for(nr_right_ints), 0);
+			for (auto it = first_right; it != ones.end(); ++it) {
+				uint64_t const p = *it - nr_left_ints;
+				right_words[p >> 6] |= uint64_t(1) << (p & 63);
+			}
+
+			ones.erase(first_right, ones.end());
+			ones.shrink_to_fit();
+			size_ = nr_left_ints;
+
+			return make(std::move(right_words), nr_right_ints);
+		}
+
+		/*
+		 * split content of this vector into 2 blocks:
+		 * Left part remains in this block, right part in the
+		 * new returned block
+		 */
+		sparse_bit_vector* split() {
+			return split([](std::vector<uint64_t>&& w, uint64_t n) { return new sparse_bit_vector(std::move(w), n); });
+		}
+
+		/*
+		 * return total number of bits occupied in memory by this object instance
+		 */
+		uint64_t bit_size() const {
+			return 8 * (sizeof(sparse_bit_vector) + ones.capacity() * sizeof(uint32_t));
+		}
+
+		uint64_t width() const {
+			return 1;
+		}
+
+		/*
+		 * j-th word of the content, i.e. elements 64j ... 64j+63. Bits past
+		 * the end of the vector are 0.
+		 */
+		uint64_t word(uint64_t const j) const {
+			assert((j << 6) < size());
+
+			uint64_t w = 0;
+
+			for (auto it = std::lower_bound(ones.begin(), ones.end(), j << 6); it != ones.end() and (*it >> 6) == j; ++it) {
+				w |= uint64_t(1) << (*it & 63);
+			}
+
+			return w;
+		}
+
+		/*
+		 * insert the n integers of the given width packed in word at position i
+		 */
+		void insert_word(uint64_t i, uint64_t word, uint8_t const width, uint8_t const n) {
+			assert(i <= size());
+			assert(n);
+			assert(n * width <= sizeof(word) * 8);
+			assert(width * n == 64 || (word >> width * n) == 0);
+
+			const uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+			for (uint8_t k = 0; k < n; ++k) {
+				insert(i++, word & mask);
+				word >>= width;
+			}
+		}
+
+	private:
+		std::vector<uint32_t> ones{};  // positions of the ones, increasing
+		uint64_t size_ = 0;
+	};
+}
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <istream>
+#include <vector>
 #include <ostream>
 #include "bv_reference.hpp"
 
@@ -38,6 +39,13 @@ namespace dyn {
 				spsi_ = spsi_type <leaf_type, B_LEAF, B, buffer_size>();
 			}
 
+			/*
+			 * build the bitvector from nbits bits packed into words (bit i is
+			 * bit i % 64 of words[i / 64]). The underlying tree is built bottom-up,
+			 * without going through insert.
+			 */
+			succinct_bitvector(const uint64_t* words, uint64_t nbits) : spsi_(words, nbits) {}
+
 			/*
 			 * number of bits in the bitvector
 			 */
@@ -74,21 +82,21 @@ namespace dyn {
 			}
 
 			/*
-			 * position of i-th bit not set. 0 =< i < rank(size(),0)
+			 * position of i-th bit not set. 0 < i <= rank(size(),0)
 			 */
 			uint64_t select0(uint64_t i) const {
 
-				assert(i < rank0(size()));
+				assert(i > 0 and i <= rank0(size()));
 				return spsi_.search_0(i);
 
 			}
 
 			/*
-			 * position of i-th bit set. 0 =< i < rank(size(),1)
+			 * position of i-th bit set. 0 < i <= rank(size(),1)
 			 */
 			uint64_t select1(uint64_t i) const {
 
-				assert(i < rank1(size()));
+				assert(i > 0 and i <= rank1(size()));
 				return spsi_.search(i);
 
 			}
@@ -145,6 +153,57 @@ namespace dyn {
 
 			}
 
+			/*
+			 * batched access: out[k] = at(i[k]) for k < n. The queries are
+			 * answered in a single traversal of the tree, sharing every node
+			 * visit among the queries that fall in its subtree.
+			 */
+			void at_batch(const uint64_t* i, uint64_t n, uint64_t* out) const {
+
+				spsi_.at_batch(i, n, out);
+
+			}
+
+			/*
+			 * batched rank: out[k] = rank(i[k], b) for k < n
+			 */
+			void rank_batch(const uint64_t* i, uint64_t n, uint64_t* out, bool b = true) const {
+
+				// rank(i) = psum(i - 1): rank(0) = 0 is answered here
+				vector<uint64_t> pos;
+				vector<uint64_t> idx;
+
+				for (uint64_t k = 0; k < n; ++k) {
+					assert(i[k] <= size());
+
+					if (i[k] == 0) {
+						out[k] = 0;
+					}
+					else {
+						pos.push_back(i[k] - 1);
+						idx.push_back(k);
+					}
+				}
+
+				vector<uint64_t> r1(pos.size());
+				spsi_.psum_batch(pos.data(), pos.size(), r1.data());
+
+				for (uint64_t k = 0; k < idx.size(); ++k) {
+					out[idx[k]] = b ? r1[k] : i[idx[k]] - r1[k];
+				}
+
+			}
+
+			/*
+			 * batched select: out[k] = select(i[k], b) for k < n
+			 */
+			void select_batch(const uint64_t* i, uint64_t n, uint64_t* out, bool b = true) const {
+
+				if (b) spsi_.search_batch(i, n, out);
+				else spsi_.search_0_batch(i, n, out);
+
+			}
+
 			/*
 			 * insert a bit b at position i
 			 */
@@ -154,6 +213,18 @@ namespace dyn {
 
 			}
 
+			/*
+			 * insert a bit b at position i and return rank(i, b), in one descent
+			 * of the tree
+			 */
+			uint64_t insert_rank(uint64_t i, bool b) {
+
+				auto r1 = spsi_.insert_psum(i, b);
+
+				return b ? r1 : i - r1;
+
+			}
+
 			/*
 			 * remove the bit at position i
 			 */
@@ -163,6 +234,40 @@ namespace dyn {
 
 			}
 
+			/*
+			 * remove the bit at position i and return it, with the number of bits
+			 * equal to it before position i in rank, in one descent of the tree
+			 */
+			bool remove_rank(uint64_t i, uint64_t& rank) {
+
+				uint64_t r1;
+				bool b = spsi_.remove_psum(i, r1);
+
+				rank = b ? r1 : i - r1;
+
+				return b;
+
+			}
+
+			/*
+			 * insert the nbits bits packed into words (bit k is bit k % 64 of
+			 * words[k / 64]) at position i
+			 */
+			void insert_range(uint64_t i, const uint64_t* words, uint64_t nbits) {
+
+				spsi_.insert_range(i, words, nbits);
+
+			}
+
+			/*
+			 * remove the bits in positions [i, j)
+			 */
+			void erase_range(uint64_t i, uint64_t j) {
+
+				spsi_.erase_range(i, j);
+
+			}
+
 			/* append b at the end of the bitvector */
 			void push_back(bool b) {
 				insert(size(), b);
@@ -231,10 +336,33 @@ namespace dyn {
 
 			}
 
+			/*
+			 * write the bitvector in the flat format of flat-format.hpp, which a
+			 * mapped_bitvector queries in place. Returns the number of bytes written.
+			 */
+			uint64_t serialize_flat(ostream& out) const {
+
+				return spsi_.serialize_flat(out);
+
+			}
+
 			uint64_t depth() const {
 				return spsi_.depth();
 			}
 
+			/*
+			 * with buffer_size > 0, insertions still pending in the nodes of the
+			 * tree, and their application down to the leaves (e.g. at the end
+			 * of an ingest phase)
+			 */
+			uint64_t pending_insertions() const {
+				return spsi_.pending_insertions();
+			}
+
+			void flush() {
+				spsi_.flush();
+			}
+
 		private:
 			//underlying Searchable partial sum with inserts structure.
 			//the spsi contains only integers 0 and 1
@@ -0,0 +1,397 @@
+#pragma once
+
+#include "b-spsi.hpp"
+#include "packed-vector.hpp"
+#include "succinct-bitvector.hpp"
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * dynamic sequences over an alphabet [0, sigma), as levels of dynamic
+ * bitvectors: symbols are read from their most significant of
+ * ceil(log sigma) bits down, one bit per level. Both structures support
+ * access, rank(c, i), select(c, j), insert and remove, and are templated on
+ * the bitvector (succinct_bitvector by default).
+ *
+ *	wavelet_tree     a binary trie of bitvectors: the node of a prefix holds
+ *	                 the next bit of the symbols with that prefix, in order.
+ *	                 Nodes are created when their first symbol comes, for
+ *	                 alphabets of up to 2^20 symbols
+ *	wavelet_matrix   one bitvector of n bits per level: every level holds the
+ *	                 next bit of all symbols, ordered by the bits read so far
+ *	                 (the symbols with a 0 first, stably). Better for large
+ *	                 alphabets: no node per prefix
+ *
+ * An insertion or a removal updates every level with insert_rank and
+ * remove_rank, which return the rank the next level needs from the same
+ * descent of the bitvector: one descent per level rather than an update and
+ * a rank.
+ */
+
+namespace dyn {
+	/*
+	 * bits of the symbols of an alphabet [0, sigma)
+	 */
+	inline uint32_t symbol_bits(uint64_t const sigma) {
+		uint32_t bits = 1;
+		while (bits < 64 and (sigma - 1) >> bits) ++bits;
+
+		return bits;
+	}
+
+	template <class bitvector = succinct_bitvector<buffer_4_packed_vector<>, 4096, 16, 0, b_spsi>>
+	class wavelet_tree {
+	public:
+		/*
+		 * empty sequence over [0, sigma)
+		 */
+		explicit wavelet_tree(uint64_t const sigma = 256) : levels(symbol_bits(sigma)) {
+			// a slot per prefix, whether its node exists or not
+			if (levels > max_levels) throw std::length_error("wavelet_tree: alphabet too large, use wavelet_matrix");
+
+			nodes.resize((uint64_t(1) << levels) - 1);
+		}
+
+		/*
+		 * the n symbols of seq, over [0, sigma). Every node is built from its
+		 * bits at once, without going through insert
+		 */
+		wavelet_tree(uint64_t const sigma, const uint64_t* seq, uint64_t const n) : wavelet_tree(sigma) {
+			build(0, 0, std::vector<uint64_t>(seq, seq + n));
+			size_ = n;
+		}
+
+		uint64_t size() const {
+			return size_;
+		}
+
+		/*
+		 * the alphabet is [0, 2^bits)
+		 */
+		uint32_t bits() const {
+			return levels;
+		}
+
+		/*
+		 * i-th symbol
+		 */
+		uint64_t at(uint64_t i) const {
+			assert(i < size());
+
+			uint64_t c = 0;
+			uint64_t k = 0;
+
+			for (uint32_t d = 0; d < levels; ++d) {
+				bool const b = nodes[k]->at(i);
+
+				i = nodes[k]->rank(i, b);
+				c = (c << 1) | b;
+				k = child(k, b);
+			}
+
+			return c;
+		}
+
+		/*
+		 * number of symbols c before position i EXCLUDED
+		 */
+		uint64_t rank(uint64_t const c, uint64_t i) const {
+			assert(i <= size());
+
+			uint64_t k = 0;
+
+			for (uint32_t d = 0; d < levels and i > 0; ++d) {
+				if (not nodes[k]) return 0;
+
+				bool const b = bit(c, d);
+
+				i = nodes[k]->rank(i, b);
+				k = child(k, b);
+			}
+
+			return i;
+		}
+
+		/*
+		 * position of the j-th symbol c. 0 < j <= rank(c, size())
+		 */
+		uint64_t select(uint64_t const c, uint64_t j) const {
+			assert(j > 0 and j <= rank(c, size()));
+
+			// the node of every prefix of c, from the leaf level up
+			std::vector<uint64_t> path(levels);
+			for (uint32_t d = 0, k = 0; d < levels; k = child(k, bit(c, d)), ++d) path[d] = k;
+
+			for (uint32_t d = levels; d-- > 0;) j = nodes[path[d]]->select(j, bit(c, d)) + 1;
+
+			return j - 1;
+		}
+
+		/*
+		 * insert symbol c at position i
+		 */
+		void insert(uint64_t i, uint64_t const c) {
+			assert(i <= size());
+			assert(levels == 64 or (c >> levels) == 0);
+
+			uint64_t k = 0;
+
+			for (uint32_t d = 0; d < levels; ++d) {
+				if (not nodes[k]) nodes[k] = std::make_unique<bitvector>();
+
+				bool const b = bit(c, d);
+
+				i = nodes[k]->insert_rank(i, b);
+				k = child(k, b);
+			}
+
+			++size_;
+		}
+
+		void push_back(uint64_t const c) {
+			insert(size(), c);
+		}
+
+		/*
+		 * remove the symbol at position i
+		 */
+		void remove(uint64_t i) {
+			assert(i < size());
+
+			uint64_t k = 0;
+
+			for (uint32_t d = 0; d < levels; ++d) {
+				uint64_t r;
+				bool const b = nodes[k]->remove_rank(i, r);
+
+				i = r;
+				k = child(k, b);
+			}
+
+			--size_;
+		}
+
+		/*
+		 * Total number of bits allocated in RAM for this structure
+		 */
+		uint64_t bit_size() const {
+			uint64_t bs = 8 * (sizeof(wavelet_tree) + nodes.capacity() * sizeof(nodes[0]));
+
+			for (auto const& n : nodes) {
+				if (n) bs += n->bit_size();
+			}
+
+			return bs;
+		}
+
+	private:
+		static constexpr uint32_t max_levels = 20;
+
+		bool bit(uint64_t const c, uint32_t const d) const {
+			return (c >> (levels - 1 - d)) & 1;
+		}
+
+		/*
+		 * child of node k for bit b: nodes are numbered level by level
+		 */
+		uint64_t child(uint64_t const k, bool const b) const {
+			return 2 * k + 1 + b;
+		}
+
+		/*
+		 * build node k, at depth d, from its symbols in order
+		 */
+		void build(uint64_t const k, uint32_t const d, std::vector<uint64_t>&& seq) {
+			if (d == levels or seq.empty()) return;
+
+			std::vector<uint64_t> words(words_for(seq.size()), 0);
+			std::vector<uint64_t> zeros;
+			std::vector<uint64_t> ones;
+
+			for (uint64_t i = 0; i < seq.size(); ++i) {
+				bool const b = bit(seq[i], d);
+
+				words[i >> 6] |= uint64_t(b) << (i & 63);
+				(b ? ones : zeros).push_back(seq[i]);
+			}
+
+			nodes[k] = std::make_unique<bitvector>(words.data(), seq.size());
+
+			seq.clear();
+			seq.shrink_to_fit();
+
+			build(child(k, false), d + 1, std::move(zeros));
+			build(child(k, true), d + 1, std::move(ones));
+		}
+
+		uint32_t levels;
+		std::vector<std::unique_ptr<bitvector>> nodes;  // heap order: the children of k are 2k + 1 and 2k + 2
+		uint64_t size_ = 0;
+	};
+
+	template <class bitvector = succinct_bitvector<buffer_4_packed_vector<>, 4096, 16, 0, b_spsi>>
+	class wavelet_matrix {
+	public:
+		/*
+		 * empty sequence over [0, sigma)
+		 */
+		explicit wavelet_matrix(uint64_t const sigma = 256) : levels(symbol_bits(sigma)) {}
+
+		/*
+		 * the n symbols of seq, over [0, sigma). Every level is built from its
+		 * bits at once, without going through insert
+		 */
+		wavelet_matrix(uint64_t const sigma, const uint64_t* seq, uint64_t const n) : wavelet_matrix(sigma) {
+			std::vector<uint64_t> order(seq, seq + n);
+			std::vector<uint64_t> ones;
+
+			for (uint32_t d = 0; d < levels.size(); ++d) {
+				std::vector<uint64_t> words(words_for(n), 0);
+				uint64_t z = 0;
+
+				// the symbols with a 0 first, stably: the order of the next level
+				for (uint64_t i = 0; i < n; ++i) {
+					bool const b = bit(order[i], d);
+
+					words[i >> 6] |= uint64_t(b) << (i & 63);
+
+					if (b) ones.push_back(order[i]);
+					else order[z++] = order[i];
+				}
+
+				std::copy(ones.begin(), ones.end(), order.begin() + z);
+				ones.clear();
+
+				levels[d] = bitvector(words.data(), n);
+			}
+		}
+
+		uint64_t size() const {
+			return levels[0].size();
+		}
+
+		/*
+		 * the alphabet is [0, 2^bits)
+		 */
+		uint32_t bits() const {
+			return levels.size();
+		}
+
+		/*
+		 * i-th symbol
+		 */
+		uint64_t at(uint64_t i) const {
+			assert(i < size());
+
+			uint64_t c = 0;
+
+			for (auto const& level : levels) {
+				bool const b = level.at(i);
+
+				i = b ? level.rank0() + level.rank1(i) : level.rank0(i);
+				c = (c << 1) | b;
+			}
+
+			return c;
+		}
+
+		/*
+		 * number of symbols c before position i EXCLUDED
+		 */
+		uint64_t rank(uint64_t const c, uint64_t i) const {
+			assert(i <= size());
+
+			// [p, i) holds the symbols with the prefix of c read so far
+			uint64_t p = 0;
+
+			for (uint32_t d = 0; d < levels.size() and p < i; ++d) {
+				p = next(d, p, bit(c, d));
+				i = next(d, i, bit(c, d));
+			}
+
+			return i - p;
+		}
+
+		/*
+		 * position of the j-th symbol c. 0 < j <= rank(c, size())
+		 */
+		uint64_t select(uint64_t const c, uint64_t const j) const {
+			assert(j > 0 and j <= rank(c, size()));
+
+			// the symbols c start at p in the last level
+			uint64_t p = 0;
+			for (uint32_t d = 0; d < levels.size(); ++d) p = next(d, p, bit(c, d));
+
+			uint64_t pos = p + j - 1;
+
+			for (uint32_t d = levels.size(); d-- > 0;) {
+				pos = bit(c, d) ? levels[d].select1(pos - levels[d].rank0() + 1) : levels[d].select0(pos + 1);
+			}
+
+			return pos;
+		}
+
+		/*
+		 * insert symbol c at position i
+		 */
+		void insert(uint64_t i, uint64_t const c) {
+			assert(i <= size());
+			assert(levels.size() == 64 or (c >> levels.size()) == 0);
+
+			for (uint32_t d = 0; d < levels.size(); ++d) {
+				bool const b = bit(c, d);
+
+				// inserting a 1 leaves the zeros in front where they were
+				uint64_t const r = levels[d].insert_rank(i, b);
+				i = b ? levels[d].rank0() + r : r;
+			}
+		}
+
+		void push_back(uint64_t const c) {
+			insert(size(), c);
+		}
+
+		/*
+		 * remove the symbol at position i
+		 */
+		void remove(uint64_t i) {
+			assert(i < size());
+
+			for (auto& level : levels) {
+				uint64_t r;
+				bool const b = level.remove_rank(i, r);
+
+				i = b ? level.rank0() + r : r;
+			}
+		}
+
+		/*
+		 * Total number of bits allocated in RAM for this structure
+		 */
+		uint64_t bit_size() const {
+			uint64_t bs = 8 * sizeof(wavelet_matrix);
+
+			for (auto const& level : levels) bs += level.bit_size();
+
+			return bs;
+		}
+
+	private:
+		bool bit(uint64_t const c, uint32_t const d) const {
+			return (c >> (levels.size() - 1 - d)) & 1;
+		}
+
+		/*
+		 * position in level d + 1 of position i of level d, for a symbol with
+		 * bit b at level d
+		 */
+		uint64_t next(uint32_t const d, uint64_t const i, bool const b) const {
+			return b ? levels[d].rank0() + levels[d].rank1(i) : levels[d].rank0(i);
+		}
+
+		std::vector<bitvector> levels;
+	};
+}
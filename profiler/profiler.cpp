@@ -1,6 +1,7 @@
 #include "buffer_4_packed_vector.hpp"
 #include "succinct-bitvector.hpp"
 #include "b-spsi.hpp"
+#include "query-executor.hpp"
 #include <chrono>
 #include <random>
 #include <iostream>
@@ -32,7 +33,8 @@ struct test_message
 	}
 };
 
-template <int64_t B_LEAF, int64_t B> uint64_t test_tree()
+template <int64_t B_LEAF, int64_t B,
+	template <class, uint32_t, uint32_t, uint64_t> class spsi = b_spsi> uint64_t test_tree()
 {
 	const uint64_t inserts = 8000000000;
 	const uint64_t ranks = 100000000;
@@ -44,19 +46,28 @@ template <int64_t B_LEAF, int64_t B> uint64_t test_tree()
 
 	uint64_t count = 0;
 
-	succinct_bitvector<packed_vector, B_LEAF, B, 0, b_spsi> tree;
-
 	std::random_device rd;
 
 	std::default_random_engine generator(rd());
 
 	std::uniform_int_distribution<uint64_t> distribution(0, 0xFFFFFFFFFFFFFFFF);
 
-	for (uint64_t i = 0; i < inserts / 64; ++i)
+	vector<uint64_t> words(inserts / 64);
+
+	for (auto& word : words)
 	{
-		tree.push_word(distribution(generator), 64);
+		word = distribution(generator);
 	}
 
+	const auto b1 = high_resolution_clock::now();
+
+	succinct_bitvector<packed_vector, B_LEAF, B, 0, spsi> tree(words.data(), inserts);
+
+	const auto b2 = high_resolution_clock::now();
+
+	words = vector<uint64_t>();
+
+	cout << "Build time in microseconds: " << duration_cast<microseconds>(b2 - b1).count() << "\n";
 	cout << "Total size in bits: " << tree.bit_size() << "\n";
 
 	vector<test_message> messages;
@@ -77,15 +88,63 @@ template <int64_t B_LEAF, int64_t B> uint64_t test_tree()
 
 	const auto duration = duration_cast<microseconds>(t2 - t1).count();
 
+	// same queries, answered in a single traversal of the tree
+	vector<uint64_t> positions(ranks);
+	vector<uint64_t> results(ranks);
+
+	for (uint64_t i = 0; i < ranks; ++i)
+	{
+		positions[i] = messages[i].index;
+	}
+
+	const auto t3 = high_resolution_clock::now();
+
+	tree.rank_batch(positions.data(), ranks, results.data());
+
+	const auto t4 = high_resolution_clock::now();
+
+	for (const auto r : results)
+	{
+		count += r;
+	}
+
+	query_executor<decltype(tree)> executor(tree);
+
+	const auto t5 = high_resolution_clock::now();
+
+	executor.rank(positions.data(), ranks, results.data());
+
+	const auto t6 = high_resolution_clock::now();
+
+	for (const auto r : results)
+	{
+		count += r;
+	}
+
 	cout << "Tree depth: " << tree.depth() << "\n";
 	cout << "Size (amount of bits inserted): " << tree.size() << "\n";
 	cout << "Time taken in microseconds: " << duration << "\n";
+	cout << "Batched time taken in microseconds: " << duration_cast<microseconds>(t4 - t3).count() << "\n";
+	cout << "Parallel time taken in microseconds (" << executor.threads() << " threads): " << duration_cast<microseconds>(t6 - t5).count() << "\n";
 	cout << "\n";
 
 	return count;
 }
 
-template <int64_t B_LEAF, int64_t B> uint64_t test_tree_insert()
+/*
+ * fill policies compared by the insert sweep (fill-policy.hpp): bulk builds
+ * packed full, and the default fill with redistribution before splits
+ */
+template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size>
+using full_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, simd_child_search<>, heap_allocation, uint64_t,
+	ones_counters<>, fill_policy<100, 50, false>>;
+
+template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size>
+using redistributing_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, simd_child_search<>, heap_allocation, uint64_t,
+	ones_counters<>, fill_policy<75, 50, true>>;
+
+template <int64_t B_LEAF, int64_t B,
+	template <class, uint32_t, uint32_t, uint64_t> class spsi = b_spsi> uint64_t test_tree_insert()
 {
 	const uint64_t inserts = 5000000000;
 	const uint64_t additional_inserts = 100000000;
@@ -97,19 +156,28 @@ template <int64_t B_LEAF, int64_t B> uint64_t test_tree_insert()
 
 	uint64_t count = 0;
 
-	succinct_bitvector<packed_vector, B_LEAF, B, 0, b_spsi> tree;
-
 	std::random_device rd;
 
 	std::default_random_engine generator(rd());
 
 	std::uniform_int_distribution<uint64_t> distribution(0, 0xFFFFFFFFFFFFFFFF);
 
-	for (uint64_t i = 0; i < inserts / 64; ++i)
+	vector<uint64_t> words(inserts / 64);
+
+	for (auto& word : words)
 	{
-		tree.push_word(distribution(generator), 64);
+		word = distribution(generator);
 	}
 
+	const auto b1 = high_resolution_clock::now();
+
+	succinct_bitvector<packed_vector, B_LEAF, B, 0, spsi> tree(words.data(), inserts);
+
+	const auto b2 = high_resolution_clock::now();
+
+	words = vector<uint64_t>();
+
+	cout << "Build time in microseconds: " << duration_cast<microseconds>(b2 - b1).count() << "\n";
 	cout << "Total size in bits: " << tree.bit_size() << "\n";
 
 	vector<uint64_t> messages;
@@ -141,7 +209,9 @@ template <int64_t B_LEAF, int64_t B> uint64_t test_tree_insert()
 
 	cout << "Tree depth: " << tree.depth() << "\n";
 	cout << "Size (amount of bits inserted): " << tree.size() << "\n";
+	cout << "Total size in bits after inserts: " << tree.bit_size() << "\n";
 	cout << "Time taken in microseconds: " << duration << "\n";
+	cout << "Inserts per second: " << (duration ? additional_inserts * 1000000 / duration : 0) << "\n";
 	cout << "\n";
 
 	return count;
@@ -327,6 +397,15 @@ int main() {
 	 count += test_tree< 4096, 1024>();
 	 count += test_tree< 4096, 4096>();
 	 count += test_tree< 4096, 8192>();
+	 // wide nodes searched through an S-tree index of their counters
+	 count += test_tree< 4096, 1024, blocked_b_spsi>();
+	 count += test_tree< 4096, 4096, blocked_b_spsi>();
+	 count += test_tree< 4096, 8192, blocked_b_spsi>();
+	 // space and insert throughput of the fill policies
+	 count += test_tree_insert< 4096, 256>();
+	 count += test_tree_insert< 4096, 256, full_b_spsi>();
+	 count += test_tree_insert< 4096, 256, redistributing_b_spsi>();
+	 count += test_tree_insert< 4096, 256, dense_b_spsi>();
 	//count += test_tree_insert< 4096, 16>();
 	//count += test_tree_insert< 4096, 256>();
 	//count += test_tree_insert< 4096, 1024>();
@@ -1,5 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include "counter-kernels.hpp"
+#include "field-kernels.hpp"
+#include "mapped-bitvector.hpp"
+#include "query-executor.hpp"
+
 template<class T> T* generate_tree(const uint64_t amount) {
 	auto tree = new T();
 
@@ -130,4 +143,1079 @@ template <class T> void remove_test(const uint64_t size) {
 		}
 	}
 	delete tree;
-}
\ No newline at end of file
+}
+/*
+ * deterministic pseudo-random words (xorshift64)
+ */
+inline std::vector<uint64_t> random_words(const uint64_t amount, uint64_t seed = 88172645463325252ull) {
+	std::vector<uint64_t> words(amount);
+
+	for (auto& w : words) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		w = seed;
+	}
+
+	return words;
+}
+
+inline bool bit_of(const std::vector<uint64_t>& words, const uint64_t i) {
+	return (words[i / 64] >> (i % 64)) & 1;
+}
+
+/*
+ * every in-word select kernel available on this host, against a bit by bit
+ * scan, on random words of every density
+ */
+inline void select_in_word_test(const uint64_t nr_words) {
+	auto words = random_words(nr_words);
+
+	for (uint64_t j = 0; j < nr_words; ++j) {
+		// sparser and sparser words
+		uint64_t w = words[j];
+		for (uint64_t d = 0; d < j % 4; ++d) w &= words[(j + d + 1) % nr_words];
+
+		uint64_t k = 0;
+		for (uint64_t i = 0; i < 64; ++i) {
+			if (!((w >> i) & 1)) continue;
+
+			EXPECT_EQ(dyn::select_in_word_broadword(w, k), i);
+#if DYN_X86_DISPATCH
+			if (dyn::cpu.bmi2) {
+				EXPECT_EQ(dyn::select_in_word_bmi2(w, k), i);
+			}
+#endif
+			EXPECT_EQ(dyn::select_in_word(w, k), i);
+			++k;
+		}
+	}
+
+	EXPECT_EQ(dyn::select_in_word_broadword(~uint64_t(0), 63), 63u);
+	EXPECT_EQ(dyn::select_in_word_broadword(uint64_t(1) << 63, 0), 63u);
+}
+
+/*
+ * every popcount kernel available on this host against the scalar one, on
+ * every prefix of an array of random words
+ */
+template <dyn::word_weight wt> void popcount_kernels_test(const uint64_t nr_words) {
+	auto words = random_words(nr_words);
+	auto const total = dyn::popcount_words_scalar(words.data(), nr_words);
+
+	for (uint64_t n = 0; n <= nr_words; ++n) {
+		auto const ones = dyn::popcount_words_scalar(words.data(), n);
+		EXPECT_EQ(dyn::popcount_words(words.data(), n), ones);
+
+		auto const x = dyn::weigh<wt>(ones, n) + 1;
+		auto const expected = dyn::words_below_scalar<wt>(words.data(), nr_words, x);
+		auto const found = dyn::words_below<wt>(words.data(), nr_words, x);
+
+		EXPECT_EQ(found.words, expected.words);
+		EXPECT_EQ(found.weight, expected.weight);
+
+#if DYN_X86_DISPATCH
+		if (dyn::cpu.avx2) {
+			EXPECT_EQ(dyn::popcount_words_avx2(words.data(), n), ones);
+			EXPECT_EQ(dyn::words_below_avx2<wt>(words.data(), nr_words, x).words, expected.words);
+		}
+
+		if (dyn::cpu.avx512_popcnt) {
+			EXPECT_EQ(dyn::popcount_words_avx512(words.data(), n), ones);
+			EXPECT_EQ(dyn::words_below_avx512<wt>(words.data(), nr_words, x).words, expected.words);
+		}
+#endif
+	}
+
+	// x past the total weight: every word is taken
+	auto const all = dyn::words_below<wt>(words.data(), nr_words, dyn::weigh<wt>(total, nr_words) + 1);
+	EXPECT_EQ(all.words, nr_words);
+}
+
+template <class T> void bulk_load_test(const uint64_t size) {
+	auto words = random_words(size / 64 + 1);
+	T tree(words.data(), size);
+
+	EXPECT_EQ(tree.size(), size);
+
+	uint64_t ones = 0;
+	for (uint64_t i = 0; i < size; i++) {
+		auto val = tree.at(i);
+		EXPECT_EQ(val, bit_of(words, i));
+		if (val != bit_of(words, i)) {
+			break;
+		}
+
+		EXPECT_EQ(tree.rank(i), ones);
+		if (tree.rank(i) != ones) {
+			break;
+		}
+
+		if (val) {
+			++ones;
+			auto pos = tree.select(ones);
+			EXPECT_EQ(pos, i);
+			if (pos != i) {
+				break;
+			}
+		}
+	}
+
+	EXPECT_EQ(tree.rank(size), ones);
+
+	// the tree must keep working (and splitting) after the bulk build
+	for (uint64_t i = 0; i < 1000; i++) {
+		tree.push_back(i % 2);
+	}
+
+	EXPECT_EQ(tree.size(), size + 1000);
+	for (uint64_t i = 0; i < 1000; i++) {
+		EXPECT_EQ(tree.at(size + i), i % 2);
+	}
+	EXPECT_EQ(tree.rank(size + 1000), ones + 500);
+}
+
+template <class V, class T> void check_flat_view(const V& view, const T& tree) {
+	EXPECT_EQ(view.size(), tree.size());
+	EXPECT_EQ(view.rank1(), tree.rank1());
+
+	uint64_t ones = 0;
+	for (uint64_t i = 0; i < tree.size(); i++) {
+		auto val = tree.at(i);
+		EXPECT_EQ(view.at(i), val);
+		if (view.at(i) != val) {
+			break;
+		}
+
+		EXPECT_EQ(view.rank(i), ones);
+		if (view.rank(i) != ones) {
+			break;
+		}
+
+		if (val) {
+			++ones;
+			EXPECT_EQ(view.select1(ones), i);
+			if (view.select1(ones) != i) {
+				break;
+			}
+		}
+		else {
+			EXPECT_EQ(view.select0(i - ones + 1), i);
+			if (view.select0(i - ones + 1) != i) {
+				break;
+			}
+		}
+	}
+
+	EXPECT_EQ(view.rank(tree.size()), ones);
+}
+
+template <class T> void flat_test(const uint64_t size) {
+	auto words = random_words(size / 64 + 1);
+	T tree(words.data(), size);
+
+	std::stringstream ss;
+	auto bytes = tree.serialize_flat(ss);
+	auto str = ss.str();
+	EXPECT_EQ(bytes, str.size());
+
+	// in-memory view: the buffer must be 8-byte aligned
+	std::vector<uint64_t> buffer(dyn::words_for(bytes * 8));
+	memcpy(buffer.data(), str.data(), bytes);
+	check_flat_view(dyn::mapped_bitvector(buffer.data(), bytes), tree);
+
+	const char* path = "flat_test.bin";
+	{
+		std::ofstream out(path, std::ios::binary);
+		tree.serialize_flat(out);
+	}
+	{
+		dyn::mapped_bitvector view(path);
+		check_flat_view(view, tree);
+	}
+	std::remove(path);
+}
+
+/*
+ * truncated or corrupted flat files: the view must throw on load, or answer
+ * queries without reading out of the mapping (run under ASan)
+ */
+template <class T> void flat_corrupt_test(const uint64_t size) {
+	auto words = random_words(size / 64 + 1);
+	T tree(words.data(), size);
+
+	std::stringstream ss;
+	auto bytes = tree.serialize_flat(ss);
+	auto str = ss.str();
+
+	std::vector<uint64_t> clean(dyn::words_for(bytes * 8));
+	memcpy(clean.data(), str.data(), bytes);
+
+	dyn::flat_header h;
+	memcpy(&h, clean.data(), sizeof(h));
+
+	auto load = [&](std::vector<uint64_t> const& buffer, uint64_t const n) {
+		return dyn::mapped_bitvector(buffer.data(), n);
+	};
+
+	for (uint64_t cut = 8; cut < bytes; cut += std::max<uint64_t>(8, bytes / 64)) {
+		EXPECT_THROW(load(clean, cut), std::ios_base::failure);
+	}
+
+	auto corrupted = [&](uint64_t const word, uint64_t const value) {
+		auto buffer = clean;
+		buffer[word] = value;
+		return buffer;
+	};
+
+	uint64_t const root = clean[h.nodes_offset / 8] / 8;
+	uint64_t const last_node = clean[h.nodes_offset / 8 + h.nr_nodes - 1] / 8;
+	uint64_t const last_leaf = h.leaves_offset / 8 + 2 * (h.nr_leaves - 1);
+
+	EXPECT_THROW(load(corrupted(offsetof(dyn::flat_header, nodes_offset) / 8, bytes), bytes), std::ios_base::failure);
+	EXPECT_THROW(load(corrupted(offsetof(dyn::flat_header, nr_nodes) / 8, uint64_t(1) << 60), bytes), std::ios_base::failure);
+	EXPECT_THROW(load(corrupted(offsetof(dyn::flat_header, nr_leaves) / 8, h.nr_leaves + 1), bytes), std::ios_base::failure);
+	EXPECT_THROW(load(corrupted(h.nodes_offset / 8, bytes), bytes), std::ios_base::failure);
+	EXPECT_THROW(load(corrupted(h.nodes_offset / 8 + h.nr_nodes - 1, h.words_offset), bytes), std::ios_base::failure);
+	EXPECT_THROW(load(corrupted(root, clean[root] + 1000), bytes), std::ios_base::failure);
+	EXPECT_THROW(load(corrupted(root + 1, clean[root + 1] + h.nr_nodes + h.nr_leaves), bytes), std::ios_base::failure);
+	EXPECT_THROW(load(corrupted(last_node + 2, clean[last_node + 2] + 1), bytes), std::ios_base::failure);
+	EXPECT_THROW(load(corrupted(last_leaf, clean[last_leaf] + 1), bytes), std::ios_base::failure);
+	EXPECT_THROW(load(corrupted(last_leaf + 1, clean[last_leaf + 1] + 64), bytes), std::ios_base::failure);
+
+	// random words of the metadata overwritten
+	auto r = random_words(3 * 200, 7);
+	for (uint64_t k = 0; k < 200; ++k) {
+		uint64_t const word = r[3 * k] % (h.words_offset / 8);
+		uint64_t const value = r[3 * k + 1] & 1 ? clean[word] ^ (uint64_t(1) << (r[3 * k + 2] & 63)) : r[3 * k + 2];
+		auto buffer = corrupted(word, value);
+
+		try {
+			auto view = load(buffer, bytes);
+
+			for (uint64_t i = 0; i < view.size(); i += 1 + view.size() / 50) {
+				view.at(i);
+				view.rank1(i);
+			}
+
+			for (uint64_t x = 1; x <= view.rank1(); x += 1 + view.rank1() / 50) view.select1(x);
+			for (uint64_t x = 1; x <= view.rank0(); x += 1 + view.rank0() / 50) view.select0(x);
+		}
+		catch (std::ios_base::failure const&) {
+		}
+	}
+
+	// leaf words that disagree with the counters
+	auto buffer = clean;
+	for (uint64_t w = h.words_offset / 8; w < bytes / 8; ++w) buffer[w] = 0;
+
+	auto view = load(buffer, bytes);
+	ASSERT_GT(view.rank1(), 0u);
+	EXPECT_THROW(view.select1(view.rank1()), std::ios_base::failure);
+}
+
+template <class T> void batch_test(const uint64_t size, const uint64_t queries) {
+	auto words = random_words(size / 64 + 1);
+	T tree(words.data(), size);
+
+	auto ones = tree.rank1();
+	auto zeros = size - ones;
+
+	auto r = random_words(3 * queries, 42);
+	std::vector<uint64_t> pos(queries), sel1(queries), sel0(queries);
+	for (uint64_t k = 0; k < queries; k++) {
+		pos[k] = r[3 * k] % (size + 1);
+		sel1[k] = r[3 * k + 1] % ones + 1;
+		sel0[k] = r[3 * k + 2] % zeros + 1;
+	}
+
+	std::vector<uint64_t> out(queries);
+
+	tree.rank_batch(pos.data(), queries, out.data());
+	for (uint64_t k = 0; k < queries; k++) {
+		EXPECT_EQ(out[k], tree.rank(pos[k]));
+	}
+
+	tree.rank_batch(pos.data(), queries, out.data(), false);
+	for (uint64_t k = 0; k < queries; k++) {
+		EXPECT_EQ(out[k], tree.rank(pos[k], false));
+	}
+
+	// at is defined on [0, size)
+	for (auto& p : pos) {
+		p = p == size ? 0 : p;
+	}
+
+	tree.at_batch(pos.data(), queries, out.data());
+	for (uint64_t k = 0; k < queries; k++) {
+		EXPECT_EQ(out[k], tree.at(pos[k]));
+	}
+
+	tree.select_batch(sel1.data(), queries, out.data());
+	for (uint64_t k = 0; k < queries; k++) {
+		EXPECT_EQ(out[k], tree.select1(sel1[k]));
+	}
+
+	tree.select_batch(sel0.data(), queries, out.data(), false);
+	for (uint64_t k = 0; k < queries; k++) {
+		EXPECT_EQ(out[k], tree.select0(sel0[k]));
+	}
+
+	// already sorted batch, with repeated queries
+	std::sort(sel1.begin(), sel1.end());
+	tree.select_batch(sel1.data(), queries, out.data());
+	for (uint64_t k = 0; k < queries; k++) {
+		EXPECT_EQ(out[k], tree.select1(sel1[k]));
+	}
+}
+
+template <class T> void executor_test(const uint64_t size, const uint64_t queries, unsigned threads) {
+	auto words = random_words(size / 64 + 1);
+	T tree(words.data(), size);
+	dyn::query_executor<T> executor(tree, threads);
+
+	EXPECT_EQ(executor.threads(), threads);
+
+	auto r = random_words(2 * queries, 7);
+	std::vector<uint64_t> pos(queries), sel(queries);
+	for (uint64_t k = 0; k < queries; k++) {
+		pos[k] = r[2 * k] % size;
+		sel[k] = r[2 * k + 1] % tree.rank1() + 1;
+	}
+
+	// skewed batch: half of the queries on the same few positions
+	for (uint64_t k = 0; k < queries / 2; k++) {
+		pos[k] = k % 16;
+	}
+
+	std::vector<uint64_t> out(queries);
+
+	executor.at(pos.data(), queries, out.data());
+	for (uint64_t k = 0; k < queries; k++) {
+		EXPECT_EQ(out[k], tree.at(pos[k]));
+	}
+
+	// run a second batch on the same pool
+	executor.rank(pos.data(), queries, out.data(), false);
+	for (uint64_t k = 0; k < queries; k++) {
+		EXPECT_EQ(out[k], tree.rank(pos[k], false));
+	}
+
+	executor.select(sel.data(), queries, out.data());
+	for (uint64_t k = 0; k < queries; k++) {
+		EXPECT_EQ(out[k], tree.select1(sel[k]));
+	}
+}
+
+template <class T> void check_against(const T& tree, const std::vector<bool>& ref) {
+	EXPECT_EQ(tree.size(), ref.size());
+
+	uint64_t ones = 0;
+	for (uint64_t i = 0; i < ref.size(); i++) {
+		EXPECT_EQ(tree.at(i), ref[i]);
+		if (tree.at(i) != ref[i]) {
+			break;
+		}
+
+		if (i % 97 == 0) {
+			EXPECT_EQ(tree.rank(i), ones);
+		}
+
+		if (ref[i]) {
+			++ones;
+			if (ones % 89 == 0) {
+				EXPECT_EQ(tree.select1(ones), i);
+			}
+		}
+	}
+
+	EXPECT_EQ(tree.rank(ref.size()), ones);
+}
+
+/*
+ * set every bit to its own value, then to random values
+ */
+template <class T> void set_test(const uint64_t size) {
+	auto words = random_words(size / 64 + 1);
+	T tree(words.data(), size);
+	std::vector<bool> ref(size);
+
+	for (uint64_t i = 0; i < size; i++) {
+		ref[i] = (words[i / 64] >> (i % 64)) & 1;
+	}
+
+	for (uint64_t i = 0; i < size; i++) {
+		tree.set(i, ref[i]);
+	}
+
+	check_against(tree, ref);
+
+	auto r = random_words(size, 5);
+	for (uint64_t i = 0; i < size; i++) {
+		tree.set(i, r[i] & 1);
+		ref[i] = r[i] & 1;
+	}
+
+	check_against(tree, ref);
+}
+
+template <class T> void range_test(const uint64_t size) {
+	auto words = random_words(size / 64 + 1);
+	T tree(words.data(), size);
+
+	std::vector<bool> ref(size);
+	for (uint64_t i = 0; i < size; i++) {
+		ref[i] = bit_of(words, i);
+	}
+
+	auto erase = [&](uint64_t i, uint64_t j) {
+		tree.erase_range(i, j);
+		ref.erase(ref.begin() + i, ref.begin() + j);
+		check_against(tree, ref);
+	};
+
+	auto insert = [&](uint64_t i, uint64_t nbits, uint64_t seed) {
+		auto w = random_words(nbits / 64 + 1, seed);
+		tree.insert_range(i, w.data(), nbits);
+		std::vector<bool> bits(nbits);
+		for (uint64_t k = 0; k < nbits; k++) {
+			bits[k] = bit_of(w, k);
+		}
+		ref.insert(ref.begin() + i, bits.begin(), bits.end());
+		check_against(tree, ref);
+	};
+
+	// inside the tree, at unaligned positions
+	erase(size / 10 + 3, size / 3 + 17);
+	insert(size / 20 + 5, size / 5 + 11, 1);
+
+	// both ends
+	erase(ref.size() - size / 10, ref.size());
+	insert(0, size / 7 + 1, 2);
+	insert(ref.size(), size / 9 + 63, 3);
+	erase(0, size / 8);
+
+	// everything, then start again from an empty tree
+	erase(0, ref.size());
+	insert(0, size / 2 + 1, 4);
+
+	// the tree must keep working with single-bit updates
+	for (uint64_t i = 0; i < 1000; i++) {
+		tree.push_back(i % 2);
+		ref.push_back(i % 2);
+	}
+	check_against(tree, ref);
+}
+
+/*
+ * short and long ranges erased and inserted at random positions, mixed with
+ * single-bit updates, so that the boundary paths split, join and mend nodes
+ * at every height, against a vector
+ */
+template <class T> void range_churn_test(const uint64_t size, const uint64_t rounds) {
+	auto words = random_words(size / 64 + 1);
+	T tree(words.data(), size);
+
+	std::vector<bool> ref(size);
+	for (uint64_t i = 0; i < size; i++) {
+		ref[i] = bit_of(words, i);
+	}
+
+	auto r = random_words(4 * rounds, 7);
+
+	for (uint64_t k = 0; k < rounds; k++) {
+		// lengths up to size / 4, mostly short
+		uint64_t const len = (r[4 * k] >> 32) % (k % 2 ? 300 : size / 4 + 1);
+		uint64_t const i = r[4 * k + 1] % (ref.size() + 1);
+
+		if (r[4 * k] % 2 and ref.size() >= len) {
+			uint64_t const from = std::min(i, ref.size() - len);
+
+			tree.erase_range(from, from + len);
+			ref.erase(ref.begin() + from, ref.begin() + from + len);
+		}
+		else {
+			auto w = random_words(len / 64 + 1, r[4 * k + 2]);
+			tree.insert_range(i, w.data(), len);
+
+			std::vector<bool> bits(len);
+			for (uint64_t b = 0; b < len; b++) {
+				bits[b] = bit_of(w, b);
+			}
+			ref.insert(ref.begin() + i, bits.begin(), bits.end());
+		}
+
+		auto const j = r[4 * k + 3] % (ref.size() + 1);
+		tree.insert(j, k % 2);
+		ref.insert(ref.begin() + j, k % 2);
+
+		if (k % 16 == 0) check_against(tree, ref);
+	}
+
+	check_against(tree, ref);
+}
+
+/*
+ * random inserts into a bulk-built tree, then removes at scattered positions
+ * (splits, merges and steals between leaves and nodes), against a vector
+ */
+template <class T> void churn_test(const uint64_t size) {
+	auto words = random_words(size / 64 + 1);
+	T tree(words.data(), size);
+
+	std::vector<bool> ref(size);
+	for (uint64_t i = 0; i < size; i++) {
+		ref[i] = bit_of(words, i);
+	}
+
+	auto positions = random_words(2 * size, 5);
+
+	for (uint64_t k = 0; k < size; k++) {
+		auto const i = positions[k] % (ref.size() + 1);
+		auto const val = (positions[k] >> 32) & 1;
+		tree.insert(i, val);
+		ref.insert(ref.begin() + i, val);
+	}
+	check_against(tree, ref);
+
+	for (uint64_t k = 0; k < size + size / 2; k++) {
+		auto const i = positions[size + k % size] % ref.size();
+		tree.remove(i);
+		ref.erase(ref.begin() + i);
+	}
+	check_against(tree, ref);
+}
+
+/*
+ * a vector made of a sparse region (one bit in 256 set), a region of long
+ * runs and a dense one: T, with adaptive leaves, against plain, in space
+ * (T takes less than half) and under sparse inserts and removes
+ */
+template <class T, class plain> void sparse_test(const uint64_t size) {
+	auto r = random_words(size, 11);
+	std::vector<uint64_t> words(size / 64 + 1, 0);
+	std::vector<bool> ref(size);
+
+	bool run = false;
+	for (uint64_t i = 0; i < size; i++) {
+		if (i < size / 3) ref[i] = r[i] % 256 == 0;
+		else if (i < 2 * size / 3) ref[i] = run = run != (r[i] % 512 == 0);
+		else ref[i] = r[i] & 1;
+
+		words[i >> 6] |= uint64_t(ref[i]) << (i & 63);
+	}
+
+	T tree(words.data(), size);
+	plain reference(words.data(), size);
+
+	check_against(tree, ref);
+	EXPECT_LT(tree.bit_size(), reference.bit_size() / 2);
+
+	auto positions = random_words(2 * size, 5);
+
+	for (uint64_t k = 0; k < size / 4; k++) {
+		auto const i = positions[k] % (ref.size() + 1);
+		auto const val = (positions[k] >> 32 & 63) == 0;
+		tree.insert(i, val);
+		ref.insert(ref.begin() + i, val);
+	}
+	check_against(tree, ref);
+
+	for (uint64_t k = 0; k < size / 2; k++) {
+		auto const i = positions[size + k] % ref.size();
+		tree.remove(i);
+		ref.erase(ref.begin() + i);
+	}
+	check_against(tree, ref);
+}
+
+/*
+ * random inserts, removes and updates with insertions pending in the nodes
+ * (Bε-tree mode): queries, batches and flat serialization past them, then the same
+ * after a flush, against a vector
+ */
+template <class T> void pending_test(const uint64_t steps) {
+	T tree;
+	std::vector<bool> ref;
+
+	auto r = random_words(steps, 11);
+
+	for (uint64_t k = 0; k < steps; k++) {
+		auto const x = r[k];
+		auto const i = (x >> 8) % (ref.size() + 1);
+		bool const b = (x >> 4) & 1;
+
+		// inserts first, then mostly removes, so that nodes split and merge
+		if (x % 8 < (k < steps / 2 ? 6u : 3u) or ref.size() < 16) {
+			tree.insert(i, b);
+			ref.insert(ref.begin() + i, b);
+		}
+		else if (x % 8 < 7) {
+			tree.remove(i % ref.size());
+			ref.erase(ref.begin() + i % ref.size());
+		}
+		else {
+			tree.set(i % ref.size(), b);
+			ref[i % ref.size()] = b;
+		}
+	}
+
+	EXPECT_GT(tree.pending_insertions(), 0u);
+	check_against(tree, ref);
+
+	uint64_t const ones = tree.rank1();
+	std::vector<uint64_t> pos(ref.size()), out(ref.size());
+	for (uint64_t i = 0; i < ref.size(); i++) {
+		pos[i] = i;
+	}
+
+	tree.rank_batch(pos.data(), pos.size(), out.data());
+	for (uint64_t i = 0; i < ref.size(); i++) {
+		EXPECT_EQ(out[i], tree.rank(i));
+	}
+
+	for (uint64_t i = 0; i < ref.size() - ones; i++) {
+		pos[i] = i + 1;
+	}
+
+	tree.select_batch(pos.data(), ref.size() - ones, out.data(), false);
+	for (uint64_t i = 0; i < ref.size() - ones; i++) {
+		EXPECT_EQ(out[i], tree.select0(i + 1));
+	}
+
+	// the flat format holds the pending insertions applied
+	std::stringstream ss;
+	auto bytes = tree.serialize_flat(ss);
+	auto str = ss.str();
+	std::vector<uint64_t> buffer(dyn::words_for(bytes * 8));
+	memcpy(buffer.data(), str.data(), bytes);
+	check_flat_view(dyn::mapped_bitvector(buffer.data(), bytes), tree);
+	EXPECT_GT(tree.pending_insertions(), 0u);
+
+	tree.flush();
+	EXPECT_EQ(tree.pending_insertions(), 0u);
+	check_against(tree, ref);
+}
+
+/*
+ * random inserts, word inserts, removes, updates and push_backs on a leaf,
+ * split when it grows past 4096 bits, against a vector
+ */
+template <class leaf> void leaf_test(const uint64_t steps) {
+	leaf v;
+	std::vector<bool> ref;
+
+	auto check = [&]() {
+		EXPECT_EQ(v.size(), ref.size());
+
+		uint64_t ones = 0;
+		for (uint64_t i = 0; i < ref.size(); i++) {
+			EXPECT_EQ(v.at(i), ref[i]);
+			if (v.at(i) != ref[i]) {
+				break;
+			}
+
+			ones += ref[i];
+			EXPECT_EQ(v.psum(i), ones);
+
+			if (ref[i]) {
+				EXPECT_EQ(v.search(ones), i);
+			}
+			else {
+				EXPECT_EQ(v.search_0(i + 1 - ones), i);
+			}
+		}
+
+		EXPECT_EQ(v.psum(), ones);
+	};
+
+	auto r = random_words(2 * steps, 7);
+
+	for (uint64_t k = 0; k < steps; k++) {
+		auto const x = r[k];
+		auto const i = (x >> 8) % (ref.size() + 1);
+		bool const b = (x >> 4) & 1;
+
+		switch (x % 8) {
+		case 4:
+			if (i < ref.size()) {
+				v.remove(i);
+				ref.erase(ref.begin() + i);
+			}
+			break;
+		case 5:
+			if (i < ref.size()) {
+				v.increment(i, b, not b);
+				ref[i] = b;
+			}
+			break;
+		case 6:
+			v.push_back(b);
+			ref.push_back(b);
+			break;
+		case 7: {
+			uint8_t const n = 2 + (x >> 58) % 63;
+			auto const w = n == 64 ? r[steps + k] : r[steps + k] & ((uint64_t(1) << n) - 1);
+			v.insert_word(i, w, 1, n);
+			for (uint8_t j = 0; j < n; j++) {
+				ref.insert(ref.begin() + i + j, (w >> j) & 1);
+			}
+			break;
+		}
+		default:
+			v.insert(i, b);
+			ref.insert(ref.begin() + i, b);
+		}
+
+		if (ref.size() > 4096) {
+			check();
+
+			std::unique_ptr<leaf> right(v.split());
+			uint64_t const left = v.size();
+
+			EXPECT_EQ(left + right->size(), ref.size());
+			for (uint64_t j = 0; j < right->size(); j++) {
+				EXPECT_EQ(right->at(j), ref[left + j]);
+			}
+
+			ref.resize(left);
+		}
+
+		if (k % 256 == 0) {
+			check();
+		}
+	}
+
+	check();
+}
+
+/*
+ * first counter greater than i for the counters of a node (sizes, psums
+ * and the ones derived from them) with every window and child search policy,
+ * against the linear scan. Keys are 0 and [lo, hi].
+ */
+template <dyn::counter_of op, class T, class U>
+void child_search_test(const std::vector<T>& a, const std::vector<U>& b, uint64_t const lo, uint64_t const hi) {
+	for (uint32_t len = 0; len <= a.size(); ++len) {
+		for (uint64_t i = lo - 1; i != hi + 1; ++i) {
+			uint64_t const key = i == lo - 1 ? 0 : i;
+			auto const expected = dyn::first_greater_linear<op>(a.data(), b.data(), len, key);
+
+			for (uint32_t window : { 0u, 3u, 16u, UINT32_MAX }) {
+				EXPECT_EQ(dyn::first_greater<op>(a.data(), b.data(), len, key, window), expected);
+			}
+
+			EXPECT_EQ(dyn::binary_child_search::search<op>(a.data(), b.data(), len, key), expected);
+			EXPECT_EQ(dyn::simd_count_child_search::search<op>(a.data(), b.data(), len, key), expected);
+			EXPECT_EQ(dyn::simd_child_search<>::search<op>(a.data(), b.data(), len, key), expected);
+		}
+	}
+}
+
+/*
+ * child search and counter updates of the active tier against the scalar
+ * ones, on counters with runs of equal values. The counters start high, so
+ * that 32-bit counters use their top bit and their sums overflow 32 bits.
+ */
+template <class T> void counter_kernels_test(const uint32_t n) {
+	uint64_t const base = sizeof(T) == 4 ? 0xF0000000u : uint64_t(1) << 40;
+
+	auto steps = random_words(n);
+	std::vector<T> sizes(n);
+	std::vector<T> psums(n);
+	std::vector<T> zeros(n);
+
+	uint64_t total = 0;
+	uint64_t ones = 0;
+	for (uint32_t k = 0; k < n; ++k) {
+		auto const size = steps[k] % 3;
+
+		total += size;
+		ones += (steps[k] >> 8) % (size + 1);
+		sizes[k] = base + total;
+		psums[k] = base / 2 + ones;
+		zeros[k] = sizes[k] - psums[k];
+	}
+
+	child_search_test<dyn::counter_of::a>(sizes, sizes, base, base + total);
+	child_search_test<dyn::counter_of::a_minus_b>(sizes, psums, base / 2, base / 2 + total);
+	child_search_test<dyn::counter_of::a_plus_b>(psums, sizes, base + base / 2, base + base / 2 + 2 * total);
+	child_search_test<dyn::counter_of::twice_a_minus_b>(sizes, zeros, base + base / 2, base + base / 2 + 2 * total);
+
+	// 64-bit sizes next to a second array of type T
+	std::vector<uint64_t> const wide_sizes(sizes.begin(), sizes.end());
+	child_search_test<dyn::counter_of::a_minus_b>(wide_sizes, psums, base / 2, base / 2 + total);
+	child_search_test<dyn::counter_of::twice_a_minus_b>(wide_sizes, zeros, base + base / 2, base + base / 2 + 2 * total);
+
+	for (uint32_t from = 0; from <= n; ++from) {
+		auto expected = sizes;
+		auto found = sizes;
+
+		dyn::add_to_counters_scalar(expected.data(), from, n - (n - from) / 3, 5);
+		dyn::add_to_counters(found.data(), from, n - (n - from) / 3, 5);
+
+		EXPECT_EQ(found, expected);
+	}
+}
+
+/*
+ * child search through an S-tree index of N counters (counter_blocks), for
+ * every number of counters, against the linear scan
+ */
+template <uint32_t N, uint32_t block> void counter_blocks_test() {
+	auto steps = random_words(N);
+	std::vector<uint64_t> sizes(N);
+	std::vector<uint32_t> psums(N);
+
+	uint64_t total = 0;
+	uint64_t ones = 0;
+	for (uint32_t k = 0; k < N; ++k) {
+		auto const size = steps[k] % 3;
+
+		total += size;
+		ones += (steps[k] >> 8) % (size + 1);
+		sizes[k] = total;
+		psums[k] = ones;
+	}
+
+	dyn::counter_blocks<uint64_t, uint32_t, N, block> index;
+
+	for (uint32_t n = 0; n <= N; ++n) {
+		index.sync(sizes.data(), psums.data(), n);
+
+		for (uint64_t i = 0; i <= total + 1; ++i) {
+			EXPECT_EQ((index.template search<dyn::counter_of::a>(sizes.data(), sizes.data(), index.a(), index.a(), n, i)),
+				dyn::first_greater_linear<dyn::counter_of::a>(sizes.data(), sizes.data(), n, i));
+			EXPECT_EQ((index.template search<dyn::counter_of::a_minus_b>(sizes.data(), psums.data(), index.a(), index.b(), n, i)),
+				dyn::first_greater_linear<dyn::counter_of::a_minus_b>(sizes.data(), psums.data(), n, i));
+			EXPECT_EQ((index.template search<dyn::counter_of::a_plus_b>(psums.data(), sizes.data(), index.b(), index.a(), n, i)),
+				dyn::first_greater_linear<dyn::counter_of::a_plus_b>(psums.data(), sizes.data(), n, i));
+		}
+	}
+}
+
+/*
+ * the field kernels of every width against a sum of the fields one by one,
+ * on every prefix of an array of random words
+ */
+template <dyn::word_weight wt> void field_kernels_test(const uint64_t nr_words) {
+	auto words = random_words(nr_words, 3);
+
+	for (uint32_t width = 1; width <= 64; width <<= 1) {
+		uint64_t const mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+		uint64_t sum = 0;
+
+		// fields of 64 bits would wrap around the sum: keep them small
+		if (width == 64) {
+			for (auto& w : words) w >>= 16;
+		}
+
+		for (uint64_t n = 0; n <= nr_words; ++n) {
+			EXPECT_EQ(dyn::field_sum_words(words.data(), n, width), sum);
+
+			auto const x = dyn::weigh_fields<wt>(sum, n, width) + 1;
+			auto const found = dyn::field_words_below<wt>(words.data(), nr_words, width, x);
+
+			EXPECT_EQ(found.words, n);
+			EXPECT_EQ(found.weight, x - 1);
+
+			if (n == nr_words) break;
+
+			for (uint32_t f = 0; f < 64; f += width) sum += (words[n] >> f) & mask;
+		}
+	}
+}
+
+/*
+ * b_spsi over integers (T) against a vector: integers of 1 to 64 bits,
+ * mostly small, inserted, removed, incremented, decremented and set
+ */
+template <class T> void int_spsi_test(const uint64_t steps) {
+	T tree;
+	std::vector<uint64_t> ref;
+
+	auto check = [&]() {
+		EXPECT_EQ(tree.size(), ref.size());
+
+		uint64_t s = 0;
+		for (uint64_t i = 0; i < ref.size(); i++) {
+			EXPECT_EQ(tree.at(i), ref[i]);
+			if (tree.at(i) != ref[i]) {
+				break;
+			}
+
+			s += ref[i];
+			if (i % 31 == 0) {
+				EXPECT_EQ(tree.psum(i), s);
+			}
+
+			// the first integer reaching a sum, when it is not 0
+			if (ref[i] > 0 and i % 7 == 0) {
+				EXPECT_EQ(tree.search(s), i);
+				EXPECT_EQ(tree.search(s - ref[i] + 1), i);
+				EXPECT_TRUE(tree.contains(s));
+			}
+		}
+
+		EXPECT_EQ(tree.psum(), s);
+	};
+
+	auto r = random_words(3 * steps, 13);
+
+	for (uint64_t k = 0; k < steps; k++) {
+		auto const x = r[k];
+		auto const i = (x >> 8) % (ref.size() + 1);
+
+		// one in 64 is up to 48 bits long, the others below 16
+		uint64_t const val = (x & 63) == 0 ? r[steps + k] >> (16 + (x >> 58) % 48) : r[steps + k] & 15;
+
+		switch (x % 8) {
+		case 5:
+		case 6:
+			if (i < ref.size()) {
+				tree.remove(i);
+				ref.erase(ref.begin() + i);
+			}
+			break;
+		case 7:
+			if (i < ref.size()) {
+				uint64_t const delta = r[2 * steps + k] % 1000;
+				if ((x >> 4) & 1 and delta <= ref[i]) {
+					tree.decrement(i, delta);
+					ref[i] -= delta;
+				}
+				else {
+					tree.increment(i, delta);
+					ref[i] += delta;
+				}
+			}
+			break;
+		case 4:
+			if (i < ref.size()) {
+				tree[i] = val;
+				ref[i] = val;
+			}
+			break;
+		default:
+			tree.insert(i, val);
+			ref.insert(ref.begin() + i, val);
+		}
+
+		if (k % (steps / 4) == 0) check();
+	}
+
+	check();
+}
+
+/*
+ * insert_rank and remove_rank against rank, then insert or remove
+ */
+template <class T> void insert_rank_test(const uint64_t size) {
+	T tree;
+	std::vector<bool> ref;
+
+	auto r = random_words(2 * size, 17);
+
+	for (uint64_t k = 0; k < size; k++) {
+		auto const i = r[k] % (ref.size() + 1);
+		bool const b = (r[k] >> 40) & 1;
+
+		auto const rank = tree.rank(i, b);
+		EXPECT_EQ(tree.insert_rank(i, b), rank);
+		ref.insert(ref.begin() + i, b);
+	}
+
+	for (uint64_t k = 0; k < size / 2; k++) {
+		auto const i = r[size + k] % ref.size();
+		auto const rank = tree.rank(i, ref[i]);
+
+		uint64_t found;
+		EXPECT_EQ(tree.remove_rank(i, found), ref[i]);
+		EXPECT_EQ(found, rank);
+		ref.erase(ref.begin() + i);
+	}
+
+	check_against(tree, ref);
+}
+
+/*
+ * a wavelet structure T over [0, sigma) against a vector: bulk built, then
+ * under inserts and removes of symbols (a few frequent ones, and the rest
+ * uniform), with access, rank and select checked after each phase
+ */
+template <class T> void wavelet_test(const uint64_t sigma, const uint64_t size) {
+	auto r = random_words(3 * size, 19);
+	std::vector<uint64_t> ref(size);
+
+	for (uint64_t i = 0; i < size; i++) ref[i] = r[i] % 4 == 0 ? r[i] % sigma : (r[i] >> 8) % 4;
+
+	T seq(sigma, ref.data(), ref.size());
+
+	auto check = [&]() {
+		EXPECT_EQ(seq.size(), ref.size());
+
+		std::vector<uint64_t> count(sigma, 0);
+		for (uint64_t i = 0; i < ref.size(); i++) {
+			EXPECT_EQ(seq.at(i), ref[i]);
+			if (seq.at(i) != ref[i]) {
+				break;
+			}
+
+			if (i % 13 == 0) {
+				EXPECT_EQ(seq.rank(ref[i], i), count[ref[i]]);
+				EXPECT_EQ(seq.rank((ref[i] + 1) % sigma, i), count[(ref[i] + 1) % sigma]);
+			}
+
+			++count[ref[i]];
+			if (i % 7 == 0) {
+				EXPECT_EQ(seq.select(ref[i], count[ref[i]]), i);
+			}
+		}
+
+		for (uint64_t c = 0; c < sigma; c++) {
+			EXPECT_EQ(seq.rank(c, ref.size()), count[c]);
+		}
+	};
+
+	check();
+
+	for (uint64_t k = 0; k < size; k++) {
+		auto const x = r[size + k];
+		auto const i = x % (ref.size() + 1);
+		auto const c = (x >> 32) % 4 == 0 ? (x >> 34) % sigma : (x >> 40) % 4;
+
+		seq.insert(i, c);
+		ref.insert(ref.begin() + i, c);
+	}
+	check();
+
+	for (uint64_t k = 0; k < size + size / 2; k++) {
+		auto const i = r[2 * size + k % size] % ref.size();
+
+		seq.remove(i);
+		ref.erase(ref.begin() + i);
+	}
+	check();
+}
+
+/*
+ * the kernel tests and some tree tests with every tier the host supports
+ * forced in turn
+ */
+template <class T> void simd_tiers_test(const uint64_t size) {
+	auto const initial = dyn::active_simd_tier;
+
+	for (auto t : { dyn::simd_tier::scalar, dyn::simd_tier::sse42, dyn::simd_tier::avx2, dyn::simd_tier::avx512 }) {
+		dyn::force_simd_tier(t);
+
+		select_in_word_test(1000);
+		popcount_kernels_test<dyn::word_weight::zeros>(100);
+		field_kernels_test<dyn::word_weight::ones_plus_bits>(100);
+		counter_kernels_test<uint64_t>(40);
+		counter_kernels_test<uint32_t>(40);
+		insert_test<T>(size);
+		bulk_load_test<T>(size);
+	}
+
+	dyn::force_simd_tier(initial);
+}
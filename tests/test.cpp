@@ -2,12 +2,65 @@
 #include "helpers.hpp"
 #include "succinct-bitvector.hpp"
 #include "buffer_2_packed_vector.hpp"
+#include "gap-vector.hpp"
+#include "adaptive-leaf.hpp"
+#include "hybrid-leaf.hpp"
+#include "int-vector.hpp"
+#include "wavelet.hpp"
 #include "b-spsi.hpp"
+#include "mapped-bitvector.hpp"
 
 using namespace dyn;
 
 typedef succinct_bitvector<packed_vector, 4056, 256, 0, b_spsi> bbv;
 
+// small nodes and leaves, to get deep trees on small inputs
+typedef succinct_bitvector<packed_vector, 256, 4, 0, b_spsi> small_bbv;
+
+// leaves with a rank/select directory
+typedef succinct_bitvector<basic_packed_vector<block_directory<>>, 4056, 256, 0, b_spsi> dir_bbv;
+
+// the other child search policies of the internal nodes
+template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size>
+using linear_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, linear_child_search>;
+
+template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size>
+using binary_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, binary_child_search>;
+
+template <class leaf_type, uint32_t B_LEAF, uint32_t B, uint64_t buffer_size>
+using simd_count_b_spsi = basic_b_spsi<leaf_type, B_LEAF, B, buffer_size, simd_count_child_search>;
+
+typedef succinct_bitvector<packed_vector, 256, 16, 0, linear_b_spsi> linear_bbv;
+typedef succinct_bitvector<packed_vector, 256, 16, 0, binary_b_spsi> binary_bbv;
+typedef succinct_bitvector<packed_vector, 256, 16, 0, simd_count_b_spsi> simd_count_bbv;
+
+// nodes and leaves allocated in slabs
+typedef succinct_bitvector<packed_vector, 256, 4, 0, pooled_b_spsi> pooled_bbv;
+
+// 32-bit node counters
+typedef succinct_bitvector<packed_vector, 256, 4, 0, compact_b_spsi> compact_bbv;
+
+// wide nodes, searched through an S-tree index of their counters
+typedef succinct_bitvector<packed_vector, 256, 64, 0, blocked_b_spsi> blocked_bbv;
+
+// nodes counting zeros instead of ones, and 32-bit ones next to 64-bit sizes
+typedef succinct_bitvector<packed_vector, 256, 4, 0, zeros_b_spsi> zeros_bbv;
+typedef succinct_bitvector<packed_vector, 256, 4, 0, compact_ones_b_spsi> compact_ones_bbv;
+
+// leaves and nodes kept fuller: denser bulk builds, redistribution before splits
+typedef succinct_bitvector<packed_vector, 256, 4, 0, dense_b_spsi> dense_bbv;
+
+// Bε-tree mode: up to 16 insertions pending in every node
+typedef succinct_bitvector<packed_vector, 256, 4, 16, b_spsi> buffered_bbv;
+
+// leaves with a movable gap in their words
+typedef succinct_bitvector<gap_packed_vector<>, 256, 4, 0, b_spsi> gap_bbv;
+
+// run-length coded leaves, and leaves picking plain or run-length coding
+typedef succinct_bitvector<rle_bit_vector<>, 256, 4, 0, b_spsi> rle_bbv;
+typedef adaptive_succinct_bitvector<> adaptive_bbv;
+typedef hybrid_succinct_bitvector<> hybrid_bbv;
+
 TEST(BBV, Insertion10) {
 	insert_test<bbv>(10);
 }
@@ -150,4 +203,473 @@ TEST(BBV, Select100000) {
 
 TEST(BBV, Select1000000) {
 	select_test<bbv>(1000000);
-}
\ No newline at end of file
+}
+TEST(PackedVector, Unbuffered) {
+	leaf_test<unbuffered_packed_vector<>>(20000);
+}
+
+TEST(PackedVector, Dynamic) {
+	leaf_test<dynamic_packed_vector<>>(20000);
+}
+
+TEST(PackedVector, Buffer2) {
+	leaf_test<buffer_2_packed_vector<>>(20000);
+}
+
+TEST(PackedVector, Buffer3) {
+	leaf_test<buffer_3_packed_vector<>>(20000);
+}
+
+TEST(PackedVector, Buffer4BlockDirectory) {
+	leaf_test<buffer_4_packed_vector<block_directory<>>>(20000);
+}
+
+TEST(PackedVector, Buffer8) {
+	leaf_test<buffer_k_packed_vector<8>>(20000);
+}
+
+TEST(PackedVector, Buffer64) {
+	leaf_test<buffer_k_packed_vector<64>>(20000);
+}
+
+TEST(PackedVector, Buffer32BitwiseShift) {
+	leaf_test<packed_bit_vector<32, bitwise_shift>>(20000);
+}
+
+TEST(GapVector, Gap4) {
+	leaf_test<gap_packed_vector<>>(20000);
+}
+
+TEST(GapVector, Gap4BlockDirectory) {
+	leaf_test<gap_packed_vector<block_directory<>>>(20000);
+}
+
+TEST(GapVector, Gap1BitwiseShift) {
+	leaf_test<gap_bit_vector<1, bitwise_shift>>(20000);
+}
+
+TEST(RleVector, Blocks32) {
+	leaf_test<rle_bit_vector<>>(20000);
+}
+
+TEST(RleVector, Blocks2) {
+	leaf_test<rle_bit_vector<2>>(20000);
+}
+
+TEST(AdaptiveLeaf, Adaptive) {
+	leaf_test<adaptive_packed_vector>(20000);
+}
+
+TEST(SparseVector, Positions) {
+	leaf_test<sparse_bit_vector>(20000);
+}
+
+TEST(HybridLeaf, Hybrid) {
+	leaf_test<hybrid_packed_vector>(20000);
+}
+
+TEST(BitUtils, SelectInWord) {
+	select_in_word_test(10000);
+}
+
+TEST(BitUtils, PopcountKernelsOnes) {
+	popcount_kernels_test<word_weight::ones>(300);
+}
+
+TEST(BitUtils, PopcountKernelsZeros) {
+	popcount_kernels_test<word_weight::zeros>(300);
+}
+
+TEST(BitUtils, PopcountKernelsOnesPlusBits) {
+	popcount_kernels_test<word_weight::ones_plus_bits>(300);
+}
+
+TEST(BitUtils, FieldKernelsOnes) {
+	field_kernels_test<word_weight::ones>(300);
+}
+
+TEST(BitUtils, FieldKernelsOnesPlusBits) {
+	field_kernels_test<word_weight::ones_plus_bits>(300);
+}
+
+TEST(BitUtils, CounterKernels) {
+	counter_kernels_test<uint64_t>(100);
+}
+
+TEST(BitUtils, CompactCounterKernels) {
+	counter_kernels_test<uint32_t>(100);
+}
+
+TEST(BitUtils, CounterBlocks) {
+	counter_blocks_test<70, 2>();
+	counter_blocks_test<130, 8>();
+}
+
+TEST(SmallBBV, SimdTiers100000) {
+	simd_tiers_test<small_bbv>(100000);
+}
+
+TEST(PooledBBV, Insertion100000) {
+	insert_test<pooled_bbv>(100000);
+}
+
+TEST(PooledBBV, BulkLoad1000000) {
+	bulk_load_test<pooled_bbv>(1000000);
+}
+
+TEST(PooledBBV, Range100000) {
+	range_test<pooled_bbv>(100000);
+}
+
+TEST(CompactBBV, Insertion100000) {
+	insert_test<compact_bbv>(100000);
+}
+
+TEST(CompactBBV, Select100000) {
+	select_test<compact_bbv>(100000);
+}
+
+TEST(CompactBBV, Batch1000000) {
+	batch_test<compact_bbv>(1000000, 100000);
+}
+
+TEST(CompactBBV, Range1000000) {
+	range_test<compact_bbv>(1000000);
+}
+
+TEST(ZerosBBV, Insertion100000) {
+	insert_test<zeros_bbv>(100000);
+}
+
+TEST(ZerosBBV, Select100000) {
+	select_test<zeros_bbv>(100000);
+}
+
+TEST(ZerosBBV, Batch1000000) {
+	batch_test<zeros_bbv>(1000000, 100000);
+}
+
+TEST(ZerosBBV, Range1000000) {
+	range_test<zeros_bbv>(1000000);
+}
+
+TEST(CompactOnesBBV, Insertion100000) {
+	insert_test<compact_ones_bbv>(100000);
+}
+
+TEST(CompactOnesBBV, Select100000) {
+	select_test<compact_ones_bbv>(100000);
+}
+
+TEST(CompactOnesBBV, Range1000000) {
+	range_test<compact_ones_bbv>(1000000);
+}
+
+TEST(DenseBBV, Insertion100000) {
+	insert_test<dense_bbv>(100000);
+}
+
+TEST(DenseBBV, BulkLoad1000000) {
+	bulk_load_test<dense_bbv>(1000000);
+}
+
+TEST(DenseBBV, Range1000000) {
+	range_test<dense_bbv>(1000000);
+}
+
+TEST(DenseBBV, Churn20000) {
+	churn_test<dense_bbv>(20000);
+}
+
+TEST(BufferedBBV, Insertion100000) {
+	insert_test<buffered_bbv>(100000);
+}
+
+TEST(BufferedBBV, Mixture10000) {
+	mixture_test<buffered_bbv>(10000);
+}
+
+TEST(BufferedBBV, Range1000000) {
+	range_test<buffered_bbv>(1000000);
+}
+
+TEST(BufferedBBV, RangeChurn100000) {
+	range_churn_test<buffered_bbv>(100000, 500);
+}
+
+TEST(BufferedBBV, Churn20000) {
+	churn_test<buffered_bbv>(20000);
+}
+
+TEST(BufferedBBV, Pending50000) {
+	pending_test<buffered_bbv>(50000);
+}
+
+TEST(GapBBV, Insertion100000) {
+	insert_test<gap_bbv>(100000);
+}
+
+TEST(GapBBV, Mixture10000) {
+	mixture_test<gap_bbv>(10000);
+}
+
+TEST(GapBBV, Range1000000) {
+	range_test<gap_bbv>(1000000);
+}
+
+TEST(GapBBV, Churn20000) {
+	churn_test<gap_bbv>(20000);
+}
+
+TEST(RleBBV, Mixture10000) {
+	mixture_test<rle_bbv>(10000);
+}
+
+TEST(RleBBV, Churn20000) {
+	churn_test<rle_bbv>(20000);
+}
+
+TEST(AdaptiveBBV, Range1000000) {
+	range_test<adaptive_bbv>(1000000);
+}
+
+TEST(AdaptiveBBV, Churn20000) {
+	churn_test<adaptive_bbv>(20000);
+}
+
+TEST(AdaptiveBBV, Sparse60000) {
+	sparse_test<adaptive_bbv, bbv>(60000);
+}
+
+TEST(HybridBBV, Range1000000) {
+	range_test<hybrid_bbv>(1000000);
+}
+
+TEST(HybridBBV, Churn20000) {
+	churn_test<hybrid_bbv>(20000);
+}
+
+TEST(HybridBBV, Sparse60000) {
+	sparse_test<hybrid_bbv, bbv>(60000);
+}
+
+TEST(IntSPSI, SmallLeaves20000) {
+	int_spsi_test<packed_spsi<64, 2>>(20000);
+}
+
+TEST(IntSPSI, Mixture20000) {
+	int_spsi_test<packed_spsi<256, 4>>(20000);
+}
+
+TEST(IntSPSI, Mixture100000) {
+	int_spsi_test<packed_spsi<>>(100000);
+}
+
+TEST(InsertRank, BBV20000) {
+	insert_rank_test<bbv>(20000);
+}
+
+TEST(InsertRank, SmallBBV20000) {
+	insert_rank_test<small_bbv>(20000);
+}
+
+TEST(InsertRank, BufferedBBV20000) {
+	insert_rank_test<buffered_bbv>(20000);
+}
+
+TEST(WaveletTree, Bytes20000) {
+	wavelet_test<wavelet_tree<small_bbv>>(256, 20000);
+}
+
+TEST(WaveletTree, Sigma5) {
+	wavelet_test<wavelet_tree<small_bbv>>(5, 20000);
+}
+
+TEST(WaveletMatrix, Bytes20000) {
+	wavelet_test<wavelet_matrix<small_bbv>>(256, 20000);
+}
+
+TEST(WaveletMatrix, Sigma100000) {
+	wavelet_test<wavelet_matrix<small_bbv>>(100000, 20000);
+}
+
+TEST(BlockedChildSearch, Insertion100000) {
+	insert_test<blocked_bbv>(100000);
+}
+
+TEST(BlockedChildSearch, Select100000) {
+	select_test<blocked_bbv>(100000);
+}
+
+TEST(BlockedChildSearch, Batch1000000) {
+	batch_test<blocked_bbv>(1000000, 100000);
+}
+
+TEST(BlockedChildSearch, Range1000000) {
+	range_test<blocked_bbv>(1000000);
+}
+
+TEST(LinearChildSearch, Insertion100000) {
+	insert_test<linear_bbv>(100000);
+}
+
+TEST(LinearChildSearch, Select100000) {
+	select_test<linear_bbv>(100000);
+}
+
+TEST(LinearChildSearch, Batch1000000) {
+	batch_test<linear_bbv>(1000000, 100000);
+}
+
+TEST(BinaryChildSearch, Insertion100000) {
+	insert_test<binary_bbv>(100000);
+}
+
+TEST(BinaryChildSearch, Select100000) {
+	select_test<binary_bbv>(100000);
+}
+
+TEST(BinaryChildSearch, Batch1000000) {
+	batch_test<binary_bbv>(1000000, 100000);
+}
+
+TEST(SimdCountChildSearch, Insertion100000) {
+	insert_test<simd_count_bbv>(100000);
+}
+
+TEST(SimdCountChildSearch, Select100000) {
+	select_test<simd_count_bbv>(100000);
+}
+
+TEST(SimdCountChildSearch, Batch1000000) {
+	batch_test<simd_count_bbv>(1000000, 100000);
+}
+
+TEST(BBV, BulkLoad10) {
+	bulk_load_test<bbv>(10);
+}
+
+TEST(BBV, BulkLoad1000) {
+	bulk_load_test<bbv>(1000);
+}
+
+TEST(BBV, BulkLoad100000) {
+	bulk_load_test<bbv>(100000);
+}
+
+TEST(BBV, BulkLoad1000000) {
+	bulk_load_test<bbv>(1000000);
+}
+
+TEST(SmallBBV, BulkLoad100000) {
+	bulk_load_test<small_bbv>(100000);
+}
+
+TEST(SmallBBV, BulkLoad1000000) {
+	bulk_load_test<small_bbv>(1000000);
+}
+
+TEST(BBV, Flat10) {
+	flat_test<bbv>(10);
+}
+
+TEST(BBV, Flat100000) {
+	flat_test<bbv>(100000);
+}
+
+TEST(BBV, Flat1000000) {
+	flat_test<bbv>(1000000);
+}
+
+TEST(SmallBBV, Flat1000000) {
+	flat_test<small_bbv>(1000000);
+}
+
+TEST(BBV, SetSameValue) {
+	set_test<bbv>(100000);
+}
+
+TEST(SmallBBV, SetSameValue) {
+	set_test<small_bbv>(10000);
+}
+
+TEST(BBV, FlatCorrupt) {
+	flat_corrupt_test<bbv>(100000);
+}
+
+TEST(SmallBBV, FlatCorrupt) {
+	flat_corrupt_test<small_bbv>(100000);
+}
+
+TEST(BBV, FlatBadMagic) {
+	std::vector<uint64_t> buffer(32, 0);
+	EXPECT_THROW(dyn::mapped_bitvector(buffer.data(), buffer.size() * 8), std::ios_base::failure);
+}
+
+TEST(BBV, Batch1000) {
+	batch_test<bbv>(1000, 100);
+}
+
+TEST(BBV, Batch1000000) {
+	batch_test<bbv>(1000000, 100000);
+}
+
+TEST(SmallBBV, Batch1000000) {
+	batch_test<small_bbv>(1000000, 100000);
+}
+
+TEST(BBV, Executor1Thread) {
+	executor_test<bbv>(1000000, 100000, 1);
+}
+
+TEST(BBV, Executor4Threads) {
+	executor_test<bbv>(1000000, 100000, 4);
+}
+
+TEST(SmallBBV, Executor8Threads) {
+	executor_test<small_bbv>(1000000, 100000, 8);
+}
+
+TEST(BBV, Range100000) {
+	range_test<bbv>(100000);
+}
+
+TEST(BBV, Range1000000) {
+	range_test<bbv>(1000000);
+}
+
+TEST(BBV, Churn20000) {
+	churn_test<bbv>(20000);
+}
+
+TEST(SmallBBV, Range1000000) {
+	range_test<small_bbv>(1000000);
+}
+
+TEST(SmallBBV, RangeChurn100000) {
+	range_churn_test<small_bbv>(100000, 500);
+}
+
+TEST(DirBBV, Insertion100000) {
+	insert_test<dir_bbv>(100000);
+}
+
+TEST(DirBBV, Rank100000) {
+	rank_test<dir_bbv>(100000);
+}
+
+TEST(DirBBV, Select100000) {
+	select_test<dir_bbv>(100000);
+}
+
+TEST(DirBBV, BulkLoad1000000) {
+	bulk_load_test<dir_bbv>(1000000);
+}
+
+TEST(DirBBV, Batch1000000) {
+	batch_test<dir_bbv>(1000000, 100000);
+}
+
+TEST(DirBBV, Range1000000) {
+	range_test<dir_bbv>(1000000);
+}